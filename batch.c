@@ -0,0 +1,643 @@
+/*!
+ * \file batch.c
+ * \brief Exécution d'un grand nombre de programmes indépendants.
+ *
+ * La tranche de travaux d'un thread est un intervalle <tt>[lo, hi[</tt>
+ * rangé dans un seul mot de 64 bits (\c lo dans les poids faibles) : le
+ * thread propriétaire prend \c lo en l'incrémentant, un voleur prend la
+ * moitié haute en abaissant \c hi, chacun par un compare-and-swap sur le
+ * mot entier. Seul le propriétaire remplit une tranche vide, avec le butin
+ * d'un vol.
+ *
+ * Les processus de batch_fork() se partagent un seul compteur de travaux,
+ * incrémenté par fetch-and-add dans une projection anonyme partagée : le
+ * coordinateur n'intervient qu'à la fin d'un processus.
+ */
+
+#include "batch.h"
+#include "lockstep.h"
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+//! Tranche de travaux d'un thread
+/*!
+ * Une tranche par ligne de cache, pour que les prises d'un thread ne
+ * ralentissent pas celles de ses voisins.
+ */
+typedef struct
+{
+	uint64_t _range;	//!< lo | hi << 32
+	char _pad[64 - sizeof(uint64_t)];
+} __attribute__((aligned(64))) Batch_Queue;
+
+//! Lot de travaux en cours d'exécution
+typedef struct
+{
+	Batch_Queue *_queues;	//!< Une tranche par thread
+	unsigned _nthreads;	//!< Nombre de threads
+	Batch_Job _job;		//!< Le travail
+	void *_ctx;		//!< Son contexte
+} Batch;
+
+//! Paramètres d'un thread du lot
+typedef struct
+{
+	Batch *_batch;		//!< Le lot
+	unsigned _worker;	//!< Numéro du thread
+} Batch_Worker;
+
+//! Intervalle <tt>[lo, hi[</tt> sous forme de mot.
+static inline uint64_t range(unsigned lo, unsigned hi)
+{
+	return (uint64_t) lo | (uint64_t) hi << 32;
+}
+
+//! Prise du premier travail d'une tranche.
+/*!
+ * \return faux si la tranche est vide
+ */
+static bool take(Batch_Queue *queue, unsigned *index)
+{
+	uint64_t r = __atomic_load_n(&queue->_range, __ATOMIC_ACQUIRE);
+	for (;;) {
+		unsigned lo = (unsigned) r, hi = (unsigned) (r >> 32);
+		if (lo >= hi)
+			return false;
+		if (__atomic_compare_exchange_n(&queue->_range, &r, range(lo + 1, hi), true,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*index = lo;
+			return true;
+		}
+	}
+}
+
+//! Vol de la moitié haute d'une tranche.
+/*!
+ * \return faux si la tranche est vide
+ */
+static bool steal(Batch_Queue *victim, unsigned *lo_out, unsigned *hi_out)
+{
+	uint64_t r = __atomic_load_n(&victim->_range, __ATOMIC_ACQUIRE);
+	for (;;) {
+		unsigned lo = (unsigned) r, hi = (unsigned) (r >> 32);
+		if (lo >= hi)
+			return false;
+		unsigned mid = lo + (hi - lo) / 2;
+		if (__atomic_compare_exchange_n(&victim->_range, &r, range(lo, mid), true,
+						__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*lo_out = mid;
+			*hi_out = hi;
+			return true;
+		}
+	}
+}
+
+//! Boucle d'un thread : sa tranche, puis celles des autres.
+/*!
+ * Le thread s'arrête quand il a trouvé toutes les tranches vides. Un vol en
+ * cours peut lui avoir échappé : le voleur exécute alors seul son butin, ce
+ * qui ne coûte que du parallélisme, en toute fin de lot.
+ */
+static void *batch_worker(void *arg)
+{
+	Batch_Worker *w = arg;
+	Batch *batch = w->_batch;
+	Batch_Queue *own = &batch->_queues[w->_worker];
+	unsigned index;
+
+	for (;;) {
+		while (take(own, &index))
+			batch->_job(batch->_ctx, w->_worker, index);
+
+		bool stolen = false;
+		for (unsigned i = 1; i < batch->_nthreads && !stolen; i++) {
+			unsigned lo, hi;
+			Batch_Queue *victim = &batch->_queues[(w->_worker + i) % batch->_nthreads];
+			if (steal(victim, &lo, &hi)) {
+				__atomic_store_n(&own->_range, range(lo, hi), __ATOMIC_RELEASE);
+				stolen = true;
+			}
+		}
+		if (!stolen)
+			return NULL;
+	}
+}
+
+//! Nombre de threads par défaut : le nombre de cœurs de l'hôte
+unsigned batch_threads(void)
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned) n : 1;
+}
+
+//! Exécution d'un lot de travaux par vol de travail
+/*!
+ * \param njobs nombre de travaux
+ * \param nthreads nombre de threads
+ * \param job le travail
+ * \param ctx contexte passé à \c job
+ */
+void batch_for(unsigned njobs, unsigned nthreads, Batch_Job job, void *ctx)
+{
+	if (nthreads == 0)
+		nthreads = 1;
+	if (nthreads > njobs && njobs > 0)
+		nthreads = njobs;
+
+	Batch batch = { NULL, nthreads, job, ctx };
+	Batch_Worker *workers = malloc(nthreads * sizeof(Batch_Worker));
+	pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+	if (posix_memalign((void **) &batch._queues, sizeof(Batch_Queue), nthreads * sizeof(Batch_Queue)) != 0
+	    || workers == NULL || threads == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <batch.c:batch_for>\n");
+		exit(1);
+	}
+
+	//Tranches contiguës de tailles égales, à un travail près :
+	for (unsigned t = 0; t < nthreads; t++) {
+		unsigned lo = (unsigned) ((uint64_t) njobs * t / nthreads);
+		unsigned hi = (unsigned) ((uint64_t) njobs * (t + 1) / nthreads);
+		batch._queues[t]._range = range(lo, hi);
+		workers[t] = (Batch_Worker) { &batch, t };
+	}
+
+	//Le thread appelant est le thread 0 :
+	for (unsigned t = 1; t < nthreads; t++)
+		if (pthread_create(&threads[t], NULL, batch_worker, &workers[t]) != 0) {
+			fprintf(stderr, "Erreur de création de thread dans <batch.c:batch_for>\n");
+			exit(1);
+		}
+	batch_worker(&workers[0]);
+	for (unsigned t = 1; t < nthreads; t++)
+		pthread_join(threads[t], NULL);
+
+	free(batch._queues);
+	free(workers);
+	free(threads);
+}
+
+//! Aucun travail en cours (voir Batch_Slot)
+#define BATCH_IDLE UINT32_MAX
+
+//! Travail en cours d'un processus, une ligne de cache par processus
+typedef struct
+{
+	uint32_t _current;	//!< Numéro du travail, ou \c BATCH_IDLE
+	char _pad[64 - sizeof(uint32_t)];
+} __attribute__((aligned(64))) Batch_Slot;
+
+//! État partagé entre le coordinateur et les processus de batch_fork()
+typedef struct
+{
+	uint32_t _next;		//!< Prochain travail à prendre
+	char _pad[64 - sizeof(uint32_t)];
+	Batch_Slot _slots[];	//!< Un par processus
+} __attribute__((aligned(64))) Batch_Shared;
+
+//! Boucle d'un processus : prend les travaux jusqu'au dernier, puis se termine.
+static void __attribute__((noreturn))
+fork_worker(Batch_Shared *shared, unsigned worker, unsigned njobs, Batch_Job job, void *ctx)
+{
+	Batch_Slot *slot = &shared->_slots[worker];
+	for (;;) {
+		unsigned index = __atomic_fetch_add(&shared->_next, 1, __ATOMIC_RELAXED);
+		if (index >= njobs)
+			break;
+		__atomic_store_n(&slot->_current, index, __ATOMIC_RELAXED);
+		job(ctx, worker, index);
+		__atomic_store_n(&slot->_current, BATCH_IDLE, __ATOMIC_RELEASE);
+	}
+	//Pas de exit() : les tampons de stdio hérités du père ne sont pas vidés.
+	_exit(0);
+}
+
+//! Création du processus numéro \c worker.
+static pid_t fork_spawn(Batch_Shared *shared, unsigned worker, unsigned njobs, Batch_Job job, void *ctx)
+{
+	shared->_slots[worker]._current = BATCH_IDLE;
+	pid_t pid = fork();
+	if (pid < 0) {
+		fprintf(stderr, "Erreur de création de processus dans <batch.c:batch_fork>\n");
+		exit(1);
+	}
+	if (pid == 0)
+		fork_worker(shared, worker, njobs, job, ctx);
+	return pid;
+}
+
+//! Exécution d'un lot de travaux par des processus
+/*!
+ * Un processus qui se termine anormalement en cours de travail est remplacé
+ * par un nouveau processus de même numéro, tant qu'il reste des travaux ; le
+ * travail interrompu est signalé sur la sortie d'erreur et n'est pas repris,
+ * l'exécution étant déterministe.
+ *
+ * \param njobs nombre de travaux
+ * \param nprocs nombre de processus
+ * \param job le travail
+ * \param ctx contexte passé à \c job
+ * \return nombre de travaux interrompus
+ */
+unsigned batch_fork(unsigned njobs, unsigned nprocs, Batch_Job job, void *ctx)
+{
+	if (nprocs == 0)
+		nprocs = 1;
+	if (nprocs > njobs && njobs > 0)
+		nprocs = njobs;
+
+	size_t maplen = sizeof(Batch_Shared) + nprocs * sizeof(Batch_Slot);
+	Batch_Shared *shared = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pid_t *pids = malloc(nprocs * sizeof(pid_t));
+	if (shared == MAP_FAILED || pids == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <batch.c:batch_fork>\n");
+		exit(1);
+	}
+	shared->_next = 0;
+
+	//Les fils héritent des tampons de stdio : on les vide avant.
+	fflush(NULL);
+	for (unsigned w = 0; w < nprocs; w++)
+		pids[w] = fork_spawn(shared, w, njobs, job, ctx);
+
+	unsigned running = nprocs, lost = 0;
+	while (running > 0) {
+		int status;
+		pid_t pid = wait(&status);
+		if (pid < 0) {
+			fprintf(stderr, "Erreur d'attente des processus dans <batch.c:batch_fork>\n");
+			exit(1);
+		}
+		unsigned w = 0;
+		while (w < nprocs && pids[w] != pid)
+			w++;
+		if (w == nprocs)
+			continue;	// Fils créé par l'appelant
+
+		unsigned index = __atomic_load_n(&shared->_slots[w]._current, __ATOMIC_ACQUIRE);
+		if (index != BATCH_IDLE) {
+			if (WIFSIGNALED(status))
+				fprintf(stderr, "Travail %u interrompu : processus %d tué par le signal %d\n",
+					index, (int) pid, WTERMSIG(status));
+			else
+				fprintf(stderr, "Travail %u interrompu : processus %d terminé avec le code %d\n",
+					index, (int) pid, WEXITSTATUS(status));
+			lost++;
+		}
+		if (index != BATCH_IDLE && __atomic_load_n(&shared->_next, __ATOMIC_RELAXED) < njobs) {
+			fflush(NULL);
+			pids[w] = fork_spawn(shared, w, njobs, job, ctx);
+		}
+		else
+			running--;
+	}
+
+	munmap(shared, maplen);
+	free(pids);
+	return lost;
+}
+
+//! Enregistrement du résultat d'une exécution
+/*!
+ * \param res l'enregistrement
+ * \param pmach la machine
+ * \param fault le résultat de simul_run()
+ */
+void batch_record(Batch_Result *res, const Machine *pmach, Fault fault)
+{
+	res->_instrs = pmach->_instrs;
+	memcpy(res->_registers, pmach->_registers, sizeof(res->_registers));
+	res->_pc = pmach->_pc;
+	res->_addr = fault._addr;
+	res->_cc = pmach->_cc;
+	res->_error = fault._error;
+	res->_done = 1;
+	memset(res->_pad, 0, sizeof(res->_pad));
+}
+
+//! Exécution d'un lot par des threads ou par des processus.
+static void batch_dispatch(unsigned njobs, unsigned nworkers, bool processes, Batch_Job job, void *ctx)
+{
+	if (processes)
+		batch_fork(njobs, nworkers, job, ctx);
+	else
+		batch_for(njobs, nworkers, job, ctx);
+}
+
+//! Exécution d'une machine, sauf si son résultat est dans le cache.
+/*!
+ * \param cache le cache, ou NULL
+ * \param pmach la machine, dans son état initial
+ * \param count taille de l'image initiale de son segment de données
+ * \param image cette image
+ * \return le résultat de simul_run()
+ */
+static Fault run_cached(Result_Cache *cache, Machine *pmach, unsigned count, const Word *image)
+{
+	if (cache == NULL)
+		return simul_run(pmach, false);
+
+	Cache_Key key = cache_key(pmach, count);
+	Fault fault;
+	if (!cache_lookup(cache, &key, pmach, &fault)) {
+		fault = simul_run(pmach, false);
+		cache_store(cache, &key, pmach, fault, count, image);
+	}
+	return fault;
+}
+
+//! Contexte de batch_run()
+typedef struct
+{
+	char *const *_files;	//!< Noms des fichiers binaires
+	Batch_Result *_results;	//!< Enregistrements
+	Engine _engine;		//!< Moteur d'exécution
+	Machine_Pool **_pools;	//!< Une réserve par thread
+	Result_Cache *_cache;	//!< Cache des résultats, ou NULL
+} Batch_Run;
+
+//! Exécution d'un programme binaire de la liste.
+static void run_file(void *ctx, unsigned worker, unsigned index)
+{
+	Batch_Run *run = ctx;
+
+	Program *prog = program_load(run->_files[index]);
+	Machine *pmach = machine_create(run->_pools[worker], prog);
+	pmach->_engine = run->_engine;
+	pmach->_trace = TRACE_OFF;
+
+	const Machine *image = program_image(prog);
+	Fault fault = run_cached(run->_cache, pmach, image->_dataimage, image->_data);
+	batch_record(&run->_results[index], pmach, fault);
+	machine_destroy(pmach);
+	program_release(prog);
+}
+
+//! Exécution d'une liste de programmes binaires
+/*!
+ * Chaque thread a sa propre réserve de machines : les segments de données
+ * sont réutilisés d'un programme au suivant sans contention entre threads.
+ * Les réserves sont créées avant les processus, qui en reçoivent chacun une
+ * copie.
+ *
+ * \param nfiles nombre de programmes
+ * \param files noms des fichiers binaires
+ * \param results les enregistrements
+ * \param engine moteur d'exécution
+ * \param nthreads nombre de threads ou de processus
+ * \param processes vrai pour des processus
+ * \param cache le cache des résultats, ou NULL
+ */
+void batch_run(unsigned nfiles, char *const files[nfiles], Batch_Result results[nfiles],
+	       Engine engine, unsigned nthreads, bool processes, Result_Cache *cache)
+{
+	if (nthreads == 0)
+		nthreads = 1;
+	Machine_Pool **pools = malloc(nthreads * sizeof(Machine_Pool *));
+	if (pools == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <batch.c:batch_run>\n");
+		exit(1);
+	}
+	for (unsigned t = 0; t < nthreads; t++)
+		pools[t] = pool_create();
+
+	Batch_Run run = { files, results, engine, pools, cache };
+	batch_dispatch(nfiles, nthreads, processes, run_file, &run);
+
+	for (unsigned t = 0; t < nthreads; t++)
+		pool_destroy(pools[t]);
+	free(pools);
+}
+
+//! Contexte de batch_sweep()
+typedef struct
+{
+	Program *_program;	//!< Programme exécuté
+	unsigned _count;	//!< Nombre d'images
+	const Word *_images;	//!< Images de données
+	unsigned _imagesize;	//!< Taille de chaque image
+	Batch_Result *_results;	//!< Enregistrements
+	Engine _engine;		//!< Moteur d'exécution
+	unsigned _group;	//!< Images exécutées ensemble par un travail
+	Machine_Pool *_pool;	//!< Réserve commune
+	Machine **_machines;	//!< Machines de chaque thread, créées à son premier travail
+	Result_Cache *_cache;	//!< Cache des résultats, ou NULL
+} Batch_Sweep;
+
+//! Exécution du programme sur un groupe d'images de données.
+static void run_images(void *ctx, unsigned worker, unsigned index)
+{
+	Batch_Sweep *sweep = ctx;
+	Machine **machines = sweep->_machines + (size_t) worker * sweep->_group;
+	unsigned first = index * sweep->_group;
+	unsigned n = sweep->_count - first < sweep->_group ? sweep->_count - first : sweep->_group;
+
+	//Les images dont le résultat est dans le cache ne sont pas exécutées :
+	Fault faults[LOCKSTEP_LANES];
+	Cache_Key keys[LOCKSTEP_LANES];
+	Machine *missed[LOCKSTEP_LANES];
+	unsigned slots[LOCKSTEP_LANES], nmissed = 0;
+	for (unsigned i = 0; i < n; i++) {
+		if (machines[i] == NULL) {
+			machines[i] = machine_create(sweep->_pool, sweep->_program);
+			machines[i]->_engine = sweep->_engine;
+			machines[i]->_trace = TRACE_OFF;
+		}
+		machine_reset_data(machines[i], sweep->_imagesize,
+				   sweep->_images + (size_t) (first + i) * sweep->_imagesize);
+		if (sweep->_cache != NULL) {
+			keys[i] = cache_key(machines[i], sweep->_imagesize);
+			if (cache_lookup(sweep->_cache, &keys[i], machines[i], &faults[i]))
+				continue;
+		}
+		missed[nmissed] = machines[i];
+		slots[nmissed++] = i;
+	}
+
+	Fault run[LOCKSTEP_LANES];
+	if (sweep->_engine == ENGINE_LOCKSTEP && nmissed > 0)
+		simul_lockstep(nmissed, missed, run);
+	else if (nmissed > 0)
+		run[0] = simul_run(missed[0], false);
+	for (unsigned k = 0; k < nmissed; k++) {
+		unsigned i = slots[k];
+		faults[i] = run[k];
+		if (sweep->_cache != NULL)
+			cache_store(sweep->_cache, &keys[i], machines[i], faults[i], sweep->_imagesize,
+				    sweep->_images + (size_t) (first + i) * sweep->_imagesize);
+	}
+	for (unsigned i = 0; i < n; i++)
+		batch_record(&sweep->_results[first + i], machines[i], faults[i]);
+}
+
+//! Exécution d'un programme sur une suite d'images de données
+/*!
+ * Avec \c ENGINE_LOCKSTEP, chaque travail exécute \c LOCKSTEP_LANES images
+ * consécutives ensemble (voir simul_lockstep()).
+ *
+ * \param prog le programme
+ * \param count nombre d'images
+ * \param imagesize taille de chaque image
+ * \param images les images
+ * \param results les enregistrements
+ * \param engine moteur d'exécution
+ * \param nthreads nombre de threads ou de processus
+ * \param processes vrai pour des processus
+ * \param cache le cache des résultats, ou NULL
+ */
+void batch_sweep(Program *prog, unsigned count, unsigned imagesize, const Word *images,
+		 Batch_Result results[count], Engine engine, unsigned nthreads, bool processes,
+		 Result_Cache *cache)
+{
+	if (nthreads == 0)
+		nthreads = 1;
+	unsigned group = engine == ENGINE_LOCKSTEP ? LOCKSTEP_LANES : 1;
+	Machine **machines = calloc((size_t) nthreads * group, sizeof(Machine *));
+	if (machines == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <batch.c:batch_sweep>\n");
+		exit(1);
+	}
+
+	Batch_Sweep sweep = { prog, count, images, imagesize, results, engine, group, pool_create(), machines, cache };
+	batch_dispatch((count + group - 1) / group, nthreads, processes, run_images, &sweep);
+
+	for (unsigned i = 0; i < nthreads * group; i++)
+		if (machines[i] != NULL)
+			machine_destroy(machines[i]);
+	pool_destroy(sweep._pool);
+	free(machines);
+}
+
+//! Taille de la projection d'un fichier de \c count images de \c imagesize mots.
+static size_t sweep_maplen(unsigned count, unsigned imagesize)
+{
+	return sizeof(Sweep_Header) + (size_t) count * imagesize * sizeof(Word);
+}
+
+//! Ouverture d'un fichier d'images de données, projeté en mémoire
+/*!
+ * \param sweepfile le nom du fichier
+ * \param count nombre d'images, en retour
+ * \param imagesize taille de chaque image, en retour
+ * \return les images
+ */
+const Word *sweep_open(const char *sweepfile, unsigned *count, unsigned *imagesize)
+{
+	Sweep_Header header;
+	struct stat st;
+	int handle = open(sweepfile, O_RDONLY);
+	if (handle < 0 || fstat(handle, &st) != 0
+	    || pread(handle, &header, sizeof(header), 0) != sizeof(header)) {
+		fprintf(stderr, "Erreur de lecture du fichier d'images '%s' dans <batch.c:sweep_open>\n", sweepfile);
+		exit(1);
+	}
+	if (header._magic != SWEEP_MAGIC || header._version != SWEEP_VERSION
+	    || (size_t) st.st_size < sweep_maplen(header._count, header._imagesize)) {
+		fprintf(stderr, "Fichier d'images '%s' invalide dans <batch.c:sweep_open>\n", sweepfile);
+		exit(1);
+	}
+	//Images en lecture seule, partagées par tous les threads :
+	void *map = mmap(NULL, sweep_maplen(header._count, header._imagesize), PROT_READ, MAP_SHARED, handle, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Erreur de projection du fichier d'images dans <batch.c:sweep_open>\n");
+		exit(1);
+	}
+	close(handle);
+
+	*count = header._count;
+	*imagesize = header._imagesize;
+	return (const Word *) ((const char *) map + sizeof(Sweep_Header));
+}
+
+//! Fermeture d'un fichier d'images de données
+/*!
+ * \param images les images
+ * \param count leur nombre
+ * \param imagesize taille de chaque image
+ */
+void sweep_close(const Word *images, unsigned count, unsigned imagesize)
+{
+	munmap((char *) images - sizeof(Sweep_Header), sweep_maplen(count, imagesize));
+}
+
+//! Taille de la projection d'un fichier de \c count résultats.
+static size_t batch_maplen(unsigned count)
+{
+	return sizeof(Batch_Header) + (size_t) count * sizeof(Batch_Result);
+}
+
+//! Création d'un fichier de résultats projeté en mémoire
+/*!
+ * \param resultfile le nom du fichier
+ * \param count nombre d'enregistrements
+ * \return les enregistrements
+ */
+Batch_Result *batch_create(const char *resultfile, unsigned count)
+{
+	size_t maplen = batch_maplen(count);
+	int handle = open(resultfile, O_RDWR | O_CREAT | O_TRUNC, 0666);
+	if (handle < 0 || ftruncate(handle, maplen) != 0) {
+		fprintf(stderr, "Erreur de création du fichier de résultats '%s' dans <batch.c:batch_create>\n", resultfile);
+		exit(1);
+	}
+	void *map = mmap(NULL, maplen, PROT_READ | PROT_WRITE, MAP_SHARED, handle, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Erreur de projection du fichier de résultats dans <batch.c:batch_create>\n");
+		exit(1);
+	}
+	close(handle);
+
+	*(Batch_Header *) map = (Batch_Header) { BATCH_MAGIC, BATCH_VERSION, count, sizeof(Batch_Result) };
+	return (Batch_Result *) ((char *) map + sizeof(Batch_Header));
+}
+
+//! Ouverture d'un fichier de résultats existant, en lecture
+/*!
+ * \param resultfile le nom du fichier
+ * \param count nombre d'enregistrements, en retour
+ * \return les enregistrements
+ */
+const Batch_Result *batch_open(const char *resultfile, unsigned *count)
+{
+	Batch_Header header;
+	struct stat st;
+	int handle = open(resultfile, O_RDONLY);
+	if (handle < 0 || fstat(handle, &st) != 0
+	    || pread(handle, &header, sizeof(header), 0) != sizeof(header)) {
+		fprintf(stderr, "Erreur de lecture du fichier de résultats '%s' dans <batch.c:batch_open>\n", resultfile);
+		exit(1);
+	}
+	if (header._magic != BATCH_MAGIC || header._version != BATCH_VERSION
+	    || header._record_size != sizeof(Batch_Result)
+	    || (size_t) st.st_size < batch_maplen(header._count)) {
+		fprintf(stderr, "Fichier de résultats '%s' invalide dans <batch.c:batch_open>\n", resultfile);
+		exit(1);
+	}
+	void *map = mmap(NULL, batch_maplen(header._count), PROT_READ, MAP_SHARED, handle, 0);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Erreur de projection du fichier de résultats dans <batch.c:batch_open>\n");
+		exit(1);
+	}
+	close(handle);
+
+	*count = header._count;
+	return (const Batch_Result *) ((const char *) map + sizeof(Batch_Header));
+}
+
+//! Fermeture d'un fichier de résultats
+/*!
+ * \param results les enregistrements
+ * \param count leur nombre
+ */
+void batch_close(const Batch_Result *results, unsigned count)
+{
+	munmap((char *) results - sizeof(Batch_Header), batch_maplen(count));
+}
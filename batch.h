@@ -0,0 +1,253 @@
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+/*!
+ * \file batch.h
+ * \brief Exécution d'un grand nombre de programmes indépendants.
+ *
+ * Les travaux sont répartis entre des threads par vol de travail : chaque
+ * thread reçoit au départ une tranche contiguë des travaux et les exécute
+ * dans l'ordre ; un thread qui a terminé sa tranche prend la moitié de la fin
+ * de celle d'un autre. Les tranches sont des intervalles d'indices mis à jour
+ * par compare-and-swap : aucun verrou n'est pris entre deux travaux, et la
+ * charge reste équilibrée même lorsque les durées des travaux diffèrent de
+ * plusieurs ordres de grandeur.
+ *
+ * Le résultat de chaque programme est un enregistrement de taille fixe
+ * (\link Batch_Result \endlink), écrit directement dans le fichier de
+ * résultats projeté en mémoire, à la place correspondant au travail : les
+ * threads n'ont ni à se synchroniser ni à faire d'appel système pour le
+ * rendre.
+ *
+ * Un balayage (batch_sweep()) exécute un même programme sur de nombreuses
+ * images initiales du segment de données, lues dans un seul fichier
+ * (\link Sweep_Header \endlink). Le texte est chargé et prédécodé une seule
+ * fois et partagé par les machines de tous les threads ; chaque thread garde
+ * sa machine d'une exécution à la suivante, qu'il ne prépare qu'en recopiant
+ * l'image et en remettant les registres dans leur état initial.
+ *
+ * Les travaux peuvent aussi être répartis entre des processus
+ * (batch_fork()), pour qu'une erreur fatale (error(), erreur de lecture d'un
+ * programme) ou un plantage n'interrompe que le travail en cours. Les
+ * processus prennent les numéros de travaux à un compteur en mémoire
+ * partagée, sans verrou ni appel système, et écrivent leurs résultats dans le
+ * fichier de résultats projeté en mémoire partagée ; le coordinateur ne fait
+ * qu'attendre la fin des processus et remplacer ceux qui se sont terminés en
+ * cours de travail.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "machine.h"
+#include "pool.h"
+#include "cache.h"
+
+//! Identification d'un fichier de résultats
+#define BATCH_MAGIC 0x48435442	// "BTCH"
+
+//! Version du format de fichier de résultats
+#define BATCH_VERSION 1
+
+//! Nom du fichier de résultats écrit par défaut (batch_simul)
+#define BATCH_FILE "results.bin"
+
+//! En-tête d'un fichier de résultats
+/*!
+ * L'en-tête est suivi de \c _count enregistrements \link Batch_Result \endlink,
+ * dans l'ordre des travaux. Tous les entiers sont écrits dans l'ordre des
+ * octets de l'hôte.
+ */
+typedef struct
+{
+    uint32_t _magic;		//!< \c BATCH_MAGIC
+    uint32_t _version;		//!< \c BATCH_VERSION
+    uint32_t _count;		//!< Nombre d'enregistrements
+    uint32_t _record_size;	//!< sizeof(Batch_Result)
+} Batch_Header;
+
+//! Identification d'un fichier d'images de données
+#define SWEEP_MAGIC 0x50455753	// "SWEP"
+
+//! Version du format de fichier d'images de données
+#define SWEEP_VERSION 1
+
+//! En-tête d'un fichier d'images de données
+/*!
+ * L'en-tête est suivi de \c _count images de \c _imagesize mots chacune,
+ * dans l'ordre des exécutions. Tous les entiers sont écrits dans l'ordre des
+ * octets de l'hôte.
+ */
+typedef struct
+{
+    uint32_t _magic;		//!< \c SWEEP_MAGIC
+    uint32_t _version;		//!< \c SWEEP_VERSION
+    uint32_t _count;		//!< Nombre d'images
+    uint32_t _imagesize;	//!< Taille de chaque image, en mots
+} Sweep_Header;
+
+//! Résultat de l'exécution d'un programme
+/*!
+ * L'état est celui de la machine à la fin de l'exécution : après le HALT, ou
+ * au moment de l'erreur (voir simul_run()). Un enregistrement dont \c _done
+ * est nul correspond à un travail qui n'a pas été exécuté.
+ */
+typedef struct
+{
+    uint64_t _instrs;		//!< Instructions exécutées
+    Word _registers[NREGISTERS];//!< Registres généraux (SP compris)
+    uint32_t _pc;		//!< Compteur ordinal
+    uint32_t _addr;		//!< Adresse de l'erreur, ou du HALT
+    uint8_t _cc;		//!< Code condition (\link Condition_Code \endlink)
+    uint8_t _error;		//!< Erreur (\link Error \endlink), \c ERR_NOERROR sur HALT
+    uint8_t _done;		//!< Non nul si le travail a été exécuté
+    uint8_t _pad[5];		//!< Alignement sur 8 octets
+} Batch_Result;
+
+//! Travail d'un lot
+/*!
+ * \param ctx le contexte passé à batch_for()
+ * \param worker numéro du thread qui exécute le travail, inférieur au nombre
+ * de threads : il permet de garder des ressources propres à chaque thread
+ * \param index numéro du travail
+ */
+typedef void (*Batch_Job)(void *ctx, unsigned worker, unsigned index);
+
+//! Nombre de threads par défaut : le nombre de cœurs de l'hôte
+unsigned batch_threads(void);
+
+//! Exécution d'un lot de travaux par vol de travail
+/*!
+ * Exécute <tt>job(ctx, worker, index)</tt> une fois pour chaque \c index de
+ * 0 à <tt>njobs - 1</tt>, sur \c nthreads threads dont le thread appelant
+ * (numéro 0). Retourne quand tous les travaux sont terminés.
+ *
+ * \param njobs nombre de travaux
+ * \param nthreads nombre de threads, au moins 1
+ * \param job le travail
+ * \param ctx contexte passé à \c job
+ */
+void batch_for(unsigned njobs, unsigned nthreads, Batch_Job job, void *ctx);
+
+//! Exécution d'un lot de travaux par des processus
+/*!
+ * Comme batch_for(), mais <tt>job(ctx, worker, index)</tt> est exécuté par
+ * \c nprocs processus créés par fork(), dont le processus appelant ne fait
+ * pas partie : \c job ne rend ses résultats qu'à travers de la mémoire
+ * partagée, comme les enregistrements de batch_create(). Les travaux sont
+ * pris un par un, dans l'ordre, par un fetch-and-add sur un compteur
+ * partagé.
+ *
+ * Un processus qui se termine en cours de travail (exit(), signal) ne fait
+ * perdre que ce travail, signalé sur la sortie d'erreur : il est remplacé par
+ * un nouveau processus de même numéro \c worker, qui continue avec les
+ * travaux suivants.
+ *
+ * \param njobs nombre de travaux
+ * \param nprocs nombre de processus, au moins 1
+ * \param job le travail
+ * \param ctx contexte passé à \c job
+ * \return nombre de travaux interrompus
+ */
+unsigned batch_fork(unsigned njobs, unsigned nprocs, Batch_Job job, void *ctx);
+
+//! Enregistrement du résultat d'une exécution
+/*!
+ * \param res l'enregistrement
+ * \param pmach la machine, après simul_run()
+ * \param fault le résultat de simul_run()
+ */
+void batch_record(Batch_Result *res, const Machine *pmach, Fault fault);
+
+//! Exécution d'une liste de programmes binaires
+/*!
+ * Chaque programme est chargé par program_load() (voir pool.h), exécuté
+ * jusqu'au HALT ou jusqu'à une erreur sur une machine de la réserve de son
+ * thread, sans trace, puis enregistré dans <tt>results[index]</tt>. Les
+ * erreurs d'exécution sont enregistrées ; une erreur de lecture d'un fichier
+ * reste fatale, comme dans read_program(), sauf avec \c processes où elle
+ * laisse seulement l'enregistrement du programme nul (voir batch_fork()).
+ *
+ * \param nfiles nombre de programmes
+ * \param files noms des fichiers binaires
+ * \param results les enregistrements, un par programme ; en mémoire partagée
+ * (batch_create()) avec \c processes
+ * \param engine moteur d'exécution
+ * \param nthreads nombre de threads, ou de processus, au moins 1
+ * \param processes vrai pour répartir les programmes entre des processus
+ * \param cache le cache des résultats (voir cache.h), consulté avant chaque
+ * exécution et complété après, ou NULL
+ */
+void batch_run(unsigned nfiles, char *const files[nfiles], Batch_Result results[nfiles],
+               Engine engine, unsigned nthreads, bool processes, Result_Cache *cache);
+
+//! Exécution d'un programme sur une suite d'images de données
+/*!
+ * L'exécution numéro \c index commence avec l'image
+ * <tt>images + index * imagesize</tt> au début du segment de données (voir
+ * machine_reset_data()), et les registres de l'état initial du programme.
+ * Elle est faite sans trace et enregistrée dans <tt>results[index]</tt>.
+ * Avec \c ENGINE_LOCKSTEP, les images sont exécutées par groupes de
+ * \c LOCKSTEP_LANES (voir simul_lockstep()).
+ *
+ * \param prog le programme (voir pool.h)
+ * \param count nombre d'images
+ * \param imagesize taille de chaque image, au plus la taille du segment de
+ * données du programme
+ * \param images les images, à la suite les unes des autres
+ * \param results les enregistrements, un par image ; en mémoire partagée
+ * (batch_create()) avec \c processes
+ * \param engine moteur d'exécution
+ * \param nthreads nombre de threads, ou de processus, au moins 1
+ * \param processes vrai pour répartir les images entre des processus
+ * \param cache le cache des résultats, ou NULL ; avec \c ENGINE_LOCKSTEP,
+ * seules les images absentes du cache sont exécutées ensemble
+ */
+void batch_sweep(Program *prog, unsigned count, unsigned imagesize, const Word *images,
+                 Batch_Result results[count], Engine engine, unsigned nthreads, bool processes,
+                 Result_Cache *cache);
+
+//! Ouverture d'un fichier d'images de données, projeté en mémoire
+/*!
+ * \param sweepfile le nom du fichier
+ * \param count nombre d'images, en retour
+ * \param imagesize taille de chaque image, en retour
+ * \return les images, à libérer par sweep_close()
+ */
+const Word *sweep_open(const char *sweepfile, unsigned *count, unsigned *imagesize);
+
+//! Fermeture d'un fichier d'images de données
+/*!
+ * \param images les images rendues par sweep_open()
+ * \param count leur nombre
+ * \param imagesize taille de chaque image
+ */
+void sweep_close(const Word *images, unsigned count, unsigned imagesize);
+
+//! Création d'un fichier de résultats projeté en mémoire
+/*!
+ * Le fichier est créé (ou tronqué) avec son en-tête et \c count
+ * enregistrements nuls.
+ *
+ * \param resultfile le nom du fichier
+ * \param count nombre d'enregistrements
+ * \return les enregistrements, à libérer par batch_close()
+ */
+Batch_Result *batch_create(const char *resultfile, unsigned count);
+
+//! Ouverture d'un fichier de résultats existant, en lecture
+/*!
+ * \param resultfile le nom du fichier
+ * \param count nombre d'enregistrements, en retour
+ * \return les enregistrements, à libérer par batch_close()
+ */
+const Batch_Result *batch_open(const char *resultfile, unsigned *count);
+
+//! Fermeture d'un fichier de résultats
+/*!
+ * \param results les enregistrements rendus par batch_create() ou batch_open()
+ * \param count leur nombre
+ */
+void batch_close(const Batch_Result *results, unsigned count);
+
+#endif
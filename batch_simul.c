@@ -0,0 +1,320 @@
+/*!
+ * \file batch_simul.c
+ * \brief Exécution en lot de programmes binaires (voir batch.h).
+ *
+ * Les programmes sont donnés par des répertoires, dont tous les fichiers
+ * sont exécutés dans l'ordre de leurs noms, ou par des fichiers de liste
+ * contenant un nom de programme par ligne. Le résultat de chaque programme
+ * est écrit dans le fichier de résultats, dans l'ordre de la liste.
+ *
+ * Avec \c -s, un seul programme est exécuté, une fois pour chaque image de
+ * données du fichier donné en argument (voir batch_sweep()).
+ *
+ * Avec \c -p, les exécutions sont réparties entre des processus plutôt
+ * qu'entre des threads (voir batch_fork()) : un programme illisible ou un
+ * plantage du simulateur ne fait perdre que le résultat d'un programme.
+ *
+ * Avec \c -c, les résultats sont d'abord cherchés dans un cache (voir
+ * cache.h) : seuls les programmes et les images qui n'y sont pas encore sont
+ * exécutés.
+ *
+ * Avec \c -P, les compteurs matériels de l'hôte (voir hostperf.h) couvrent
+ * tout le lot, chargement des programmes compris, et sont rapportés au total
+ * des instructions simulées.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "machine.h"
+#include "batch.h"
+#include "hostperf.h"
+
+//! Liste des programmes à exécuter
+typedef struct
+{
+    char **_files;		//!< Noms des fichiers binaires
+    unsigned _count;		//!< Nombre de fichiers
+    unsigned _max;		//!< Capacité de \c _files
+} File_List;
+
+//! Ajout d'un nom de fichier à la liste.
+static void add_file(File_List *list, const char *name)
+{
+    if (list->_count == list->_max) {
+        list->_max = list->_max ? 2 * list->_max : 256;
+        list->_files = realloc(list->_files, list->_max * sizeof(char *));
+    }
+    if (list->_files == NULL || (list->_files[list->_count] = strdup(name)) == NULL) {
+        fprintf(stderr, "Erreur d'allocation dans <batch_simul.c:add_file>\n");
+        exit(1);
+    }
+    list->_count++;
+}
+
+//! Comparaison de noms de fichiers, pour qsort().
+static int compare_names(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+//! Ajout des fichiers d'un répertoire, dans l'ordre de leurs noms.
+static void add_directory(File_List *list, const char *dirname)
+{
+    DIR *dir = opendir(dirname);
+    if (dir == NULL) {
+        fprintf(stderr, "Erreur d'ouverture du répertoire '%s' dans <batch_simul.c:add_directory>\n", dirname);
+        exit(1);
+    }
+
+    unsigned first = list->_count;
+    size_t len = strlen(dirname);
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        char path[len + strlen(entry->d_name) + 2];
+        sprintf(path, "%s/%s", dirname, entry->d_name);
+        if (entry->d_name[0] != '.' && stat(path, &st) == 0 && S_ISREG(st.st_mode))
+            add_file(list, path);
+    }
+    closedir(dir);
+    qsort(list->_files + first, list->_count - first, sizeof(char *), compare_names);
+}
+
+//! Ajout des fichiers d'une liste, un par ligne ; les lignes vides sont ignorées.
+static void add_list(File_List *list, const char *listname)
+{
+    FILE *f = fopen(listname, "r");
+    if (f == NULL) {
+        fprintf(stderr, "Erreur d'ouverture de la liste '%s' dans <batch_simul.c:add_list>\n", listname);
+        exit(1);
+    }
+
+    char *line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, f)) >= 0)
+    {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+        if (len > 0)
+            add_file(list, line);
+    }
+    free(line);
+    fclose(f);
+}
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: batch_simul [options] dir|listfile...\n"
+           "       batch_simul [options] -s binfile imagefile\n");
+    printf("where options are:\n"
+           "\t-e\tExecution engine: 'call' (default), 'threaded', 'verify', 'jit'\n"
+           "\t\tor 'lockstep' (with -s: 8 images at a time, vectorized)\n"
+           "\t-j N\tRun N threads (default: one per host core)\n"
+           "\t-p N\tRun N worker processes instead of threads\n"
+           "\t-o\tWrite the results into the file given as next argument\n"
+           "\t\t(default " BATCH_FILE ")\n"
+           "\t-c\tLook up and store results in the cache directory given as\n"
+           "\t\tnext argument\n"
+           "\t-m N\tLimit the cache directory to N MiB (default %u)\n"
+           "\t-s\tSweep mode: run the binary program given as next argument\n"
+           "\t\tonce per initial data image of the image file\n"
+           "\t-P\tCount host cycles, instructions, branch misses and L1d misses\n"
+           "\t\tover the whole batch, workers included, per guest instruction\n"
+           "\t-v\tAlso print one line per program\n"
+           "\t-h\tprint this help message\n"
+           "Each argument is either a directory, all of whose files are run,\n"
+           "or a file listing one binary program per line.\n", CACHE_LIMIT >> 20);
+}
+
+//! Exécution en lot
+/*!
+ * \param argc nombre d'arguments
+ * \param argv options, puis répertoires et fichiers de liste
+ */
+int main(int argc, char *argv[])
+{
+    Engine engine = ENGINE_CALL;
+    unsigned nthreads = batch_threads();
+    bool processes = false;
+    const char *resultfile = BATCH_FILE;
+    bool verbose = false;
+    File_List list = { NULL, 0, 0 };
+    const char *sweepprog = NULL;
+    const char *sweepfile = NULL;
+    const char *cachedir = NULL;
+    uint64_t cachelimit = CACHE_LIMIT;
+    bool hostperf = false;
+
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        if (strcmp(argv[iarg], "-e") == 0 && iarg + 1 < argc) {
+            ++iarg;
+            if (strcmp(argv[iarg], "call") == 0)
+                engine = ENGINE_CALL;
+            else if (strcmp(argv[iarg], "threaded") == 0)
+                engine = ENGINE_THREADED;
+            else if (strcmp(argv[iarg], "verify") == 0)
+                engine = ENGINE_VERIFY;
+            else if (strcmp(argv[iarg], "jit") == 0)
+                engine = ENGINE_JIT;
+            else if (strcmp(argv[iarg], "lockstep") == 0)
+                engine = ENGINE_LOCKSTEP;
+            else {
+                fprintf(stderr, "Unknown engine for option -e\n");
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[iarg], "-j") == 0 && iarg + 1 < argc)
+            nthreads = strtoul(argv[++iarg], NULL, 0);
+        else if (strcmp(argv[iarg], "-p") == 0 && iarg + 1 < argc) {
+            nthreads = strtoul(argv[++iarg], NULL, 0);
+            processes = true;
+        }
+        else if (strcmp(argv[iarg], "-o") == 0 && iarg + 1 < argc)
+            resultfile = argv[++iarg];
+        else if (strcmp(argv[iarg], "-c") == 0 && iarg + 1 < argc)
+            cachedir = argv[++iarg];
+        else if (strcmp(argv[iarg], "-m") == 0 && iarg + 1 < argc)
+            cachelimit = (uint64_t) strtoul(argv[++iarg], NULL, 0) << 20;
+        else if (strcmp(argv[iarg], "-s") == 0 && iarg + 1 < argc)
+            sweepprog = argv[++iarg];
+        else if (strcmp(argv[iarg], "-P") == 0)
+            hostperf = true;
+        else if (strcmp(argv[iarg], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[iarg], "-h") == 0) {
+            usage();
+            exit(EXIT_SUCCESS);
+        }
+        else if (argv[iarg][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        else if (sweepprog != NULL)
+            sweepfile = argv[iarg];
+        else {
+            struct stat st;
+            if (stat(argv[iarg], &st) == 0 && S_ISDIR(st.st_mode))
+                add_directory(&list, argv[iarg]);
+            else
+                add_list(&list, argv[iarg]);
+        }
+    }
+    if (nthreads == 0)
+        nthreads = 1;
+    if (sweepprog != NULL && sweepfile == NULL) {
+        fprintf(stderr, "Missing image file for option -s\n");
+        usage();
+        exit(EXIT_FAILURE);
+    }
+
+    //Un HALT par programme : on n'affiche que le bilan.
+    warnings_enable(false);
+
+    //Balayage : le programme est chargé une seule fois.
+    Program *prog = NULL;
+    const Word *images = NULL;
+    unsigned count = list._count, imagesize = 0;
+    if (sweepprog != NULL) {
+        prog = program_load(sweepprog);
+        images = sweep_open(sweepfile, &count, &imagesize);
+    }
+
+    Result_Cache *cache = cachedir != NULL ? cache_open(cachedir, cachelimit) : NULL;
+    Batch_Result *results = batch_create(resultfile, count);
+    //Compteurs hérités par les threads et processus des exécutions :
+    Host_Counters hc;
+    if (hostperf) {
+        hostperf_open(&hc, true);
+        hostperf_start(&hc);
+    }
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (prog != NULL)
+        batch_sweep(prog, count, imagesize, images, results, engine, nthreads, processes, cache);
+    else
+        batch_run(count, list._files, results, engine, nthreads, processes, cache);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (hostperf)
+        hostperf_stop(&hc);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    unsigned long long instrs = 0;
+    unsigned faults = 0, lost = 0;
+    for (unsigned i = 0; i < count; i++)
+    {
+        const Batch_Result *res = &results[i];
+        if (!res->_done) {
+            lost++;
+            if (verbose && prog != NULL)
+                printf("image %u: not run\n", i);
+            else if (verbose)
+                printf("%s: not run\n", list._files[i]);
+            continue;
+        }
+        instrs += res->_instrs;
+        if (res->_error != ERR_NOERROR)
+            faults++;
+        if (verbose) {
+            if (prog != NULL)
+                printf("image %u", i);
+            else
+                printf("%s", list._files[i]);
+            printf(": PC 0x%08x CC %c %llu instructions", res->_pc,
+                   "UZPN"[res->_cc <= LAST_CC ? res->_cc : CC_U],
+                   (unsigned long long) res->_instrs);
+            if (res->_error != ERR_NOERROR) {
+                printf(", ");
+                print_error(res->_error, res->_addr);
+            }
+            else
+                printf(", HALT at 0x%08x\n", res->_addr);
+        }
+    }
+
+    //Un balayage exécute des images d'un même programme :
+    const char *unit = prog != NULL ? "images" : "programs";
+    printf("*** %u %s, %u faults, ", count, unit, faults);
+    if (lost > 0)
+        printf("%u not run, ", lost);
+    printf("%llu instructions, %u %s, %.3f s (%.0f %s/s) ***\n",
+           instrs, nthreads, processes ? "processes" : "threads",
+           elapsed, elapsed > 0 ? count / elapsed : 0.0, unit);
+    if (hostperf) {
+        hostperf_report(&hc, instrs);
+        hostperf_close(&hc);
+    }
+
+    if (cache != NULL) {
+        Cache_Stats stats;
+        cache_stats(cache, &stats);
+        printf("*** Cache: %llu hits, %llu misses, %llu stored, %llu evicted, %.1f MiB ***\n",
+               (unsigned long long) stats._hits, (unsigned long long) stats._misses,
+               (unsigned long long) stats._stores, (unsigned long long) stats._evictions,
+               stats._size / 1048576.0);
+        cache_close(cache);
+    }
+
+    batch_close(results, count);
+    if (prog != NULL) {
+        sweep_close(images, count, imagesize);
+        program_release(prog);
+    }
+    for (unsigned i = 0; i < list._count; i++)
+        free(list._files[i]);
+    free(list._files);
+    return 0;
+}
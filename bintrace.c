@@ -0,0 +1,499 @@
+/*!
+ * \file bintrace.c
+ * \brief Trace binaire de l'exécution, écrite par un thread en arrière-plan.
+ *
+ * Le thread de simulation (producteur) et le thread d'écriture
+ * (consommateur) partagent un tampon circulaire sans verrou : le producteur
+ * seul avance \c _head, le consommateur seul avance \c _tail, et chacun
+ * publie son compteur avec une sémantique \e release pour que l'autre voie
+ * les enregistrements (ou les places libérées) avant le compteur.
+ *
+ * Le tampon contient des événements bruts ; leur mise au format du fichier,
+ * et en particulier la compression, est faite par le thread d'écriture.
+ */
+
+#define _POSIX_C_SOURCE 200112L	// nanosleep()
+
+#include "bintrace.h"
+#include "exec.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+//! Taille du tampon de sortie du format compressé
+#define OUTPUT_SIZE (1 << 20)
+
+//! Taille maximale d'un enregistrement compressé
+#define MAX_DELTA_SIZE (1 + 3 * 10)
+
+//! Pas de mot de données écrit (Trace_Event._data_addr)
+#define NO_DATA_ADDR UINT32_MAX
+
+//! Instruction exécutée, telle que publiée dans le tampon circulaire
+typedef struct
+{
+	uint32_t _pc;		//!< Adresse de l'instruction
+	uint32_t _raw;		//!< L'instruction (Instruction._raw)
+	Word _value;		//!< Valeur du registre destination
+	uint32_t _data_addr;	//!< Mot de données que l'instruction peut écrire
+	Word _data;			//!< Valeur de ce mot après l'instruction
+	uint8_t _cc;		//!< Code condition après l'instruction
+	uint8_t _pad[3];
+} Trace_Event;
+
+//! État du thread d'écriture pour le format compressé
+typedef struct
+{
+	uint8_t *_out;		//!< Tampon de sortie
+	size_t _outlen;		//!< Octets en attente dans le tampon de sortie
+	uint64_t _offset;		//!< Position du tampon de sortie dans le fichier
+	uint64_t _count;		//!< Enregistrements écrits
+	uint64_t _interval;		//!< Enregistrements entre deux images complètes
+
+	uint64_t *_keyframes;	//!< Positions des images complètes
+	uint64_t _nkeyframes;	//!< Nombre d'images complètes
+	uint64_t _maxkeyframes;	//!< Taille allouée de \c _keyframes
+
+	//! État après le dernier enregistrement écrit
+	unsigned _next_pc;
+	Word _registers[NREGISTERS];
+	Condition_Code _cc;
+	unsigned _datasize;
+	Word *_data;
+} Delta_State;
+
+//! Trace binaire ouverte
+struct Bin_Trace
+{
+	Trace_Event *_ring;		//!< Tampon circulaire de BINTRACE_RING_SIZE événements
+	uint64_t _head;		//!< Enregistrements publiés (écrit par le producteur)
+	uint64_t _tail;		//!< Enregistrements écrits (écrit par le consommateur)
+	int _done;			//!< Vrai quand le producteur a terminé
+
+	Machine *_pmach;		//!< Machine tracée
+	bool _pending;		//!< Un enregistrement est commencé
+	Trace_Event _current;	//!< Événement de l'instruction en cours
+	Condition_Code _cc;		//!< Code condition architectural
+
+	FILE *_file;		//!< Fichier de trace
+	pthread_t _writer;		//!< Thread d'écriture
+	Bintrace_Format _format;	//!< Format du fichier
+	Trace_Record *_records;	//!< Tampon de conversion du format brut
+	Delta_State _delta;		//!< État du format compressé
+};
+
+//! Trace ouverte, fermée à la sortie du programme
+static struct Bin_Trace *active = NULL;
+
+//! Écriture d'un bloc d'octets dans le fichier de trace.
+/*!
+ * \param bt la trace
+ * \param buf les octets
+ * \param size leur nombre
+ */
+static void write_bytes(struct Bin_Trace *bt, const void *buf, size_t size)
+{
+	if (fwrite(buf, 1, size, bt->_file) != size) {
+		fprintf(stderr, "Erreur d'écriture de la trace dans <bintrace.c:write_bytes>\n");
+		exit(1);
+	}
+}
+
+//! Vidage du tampon de sortie du format compressé.
+/*!
+ * \param bt la trace
+ */
+static void flush_output(struct Bin_Trace *bt)
+{
+	Delta_State *ds = &bt->_delta;
+	write_bytes(bt, ds->_out, ds->_outlen);
+	ds->_offset += ds->_outlen;
+	ds->_outlen = 0;
+}
+
+//! Image complète de l'état avant l'enregistrement suivant.
+/*!
+ * \param bt la trace
+ */
+static void put_keyframe(struct Bin_Trace *bt)
+{
+	Delta_State *ds = &bt->_delta;
+
+	if (ds->_nkeyframes == ds->_maxkeyframes) {
+		ds->_maxkeyframes = ds->_maxkeyframes ? 2 * ds->_maxkeyframes : 64;
+		ds->_keyframes = realloc(ds->_keyframes, ds->_maxkeyframes * sizeof(uint64_t));
+		if (ds->_keyframes == NULL) {
+			fprintf(stderr, "Erreur d'allocation dans <bintrace.c:put_keyframe>\n");
+			exit(1);
+		}
+	}
+	ds->_keyframes[ds->_nkeyframes++] = ds->_offset + ds->_outlen;
+
+	//Le tampon de sortie a la place d'une image complète (voir bintrace_open()).
+	uint8_t *p = ds->_out + ds->_outlen;
+	*p++ = DELTA_KEYFRAME;
+	p = put_varint(p, ds->_count);
+	p = put_varint(p, ds->_next_pc);
+	for (int i = 0; i < NREGISTERS; i++)
+		p = put_varint(p, ds->_registers[i]);
+	*p++ = ds->_cc;
+	for (unsigned i = 0; i < ds->_datasize; i++)
+		p = put_varint(p, ds->_data[i]);
+	ds->_outlen = p - ds->_out;
+}
+
+//! Compression d'un événement (format compressé).
+/*!
+ * \param bt la trace
+ * \param ev l'événement
+ */
+static void put_delta(struct Bin_Trace *bt, const Trace_Event *ev)
+{
+	Delta_State *ds = &bt->_delta;
+
+	if (ds->_count % ds->_interval == 0) {
+		flush_output(bt);
+		put_keyframe(bt);
+	} else if (ds->_outlen > OUTPUT_SIZE - MAX_DELTA_SIZE)
+		flush_output(bt);
+
+	uint8_t *tag = ds->_out + ds->_outlen;
+	uint8_t *p = tag + 1;
+	*tag = 0;
+
+	if (ev->_pc != ds->_next_pc) {
+		*tag |= DELTA_JUMP;
+		p = put_varint(p, zigzag(ev->_pc - ds->_next_pc));
+	}
+	ds->_next_pc = ev->_pc + 1;
+
+	Instruction instr = { ._raw = ev->_raw };
+	int reg = trace_dest_register(instr);
+	if (reg >= 0) {
+		Code_Op cop = instr.instr_generic._cop;
+		if (ev->_value != ds->_registers[reg] || cop == LOAD || cop == ADD || cop == SUB) {
+			*tag |= DELTA_REG;
+			p = put_varint(p, zigzag(ev->_value - ds->_registers[reg]));
+			ds->_registers[reg] = ev->_value;
+		}
+	}
+	ds->_cc = ev->_cc;
+
+	if (ev->_data_addr != NO_DATA_ADDR && ev->_data != ds->_data[ev->_data_addr]) {
+		*tag |= DELTA_DATA;
+		p = put_varint(p, ev->_data_addr);
+		p = put_varint(p, zigzag(ev->_data - ds->_data[ev->_data_addr]));
+		ds->_data[ev->_data_addr] = ev->_data;
+	}
+
+	ds->_outlen = p - ds->_out;
+	ds->_count++;
+}
+
+//! Écriture d'une suite d'événements dans le fichier.
+/*!
+ * \param bt la trace
+ * \param from premier événement (compteur, pas indice)
+ * \param to fin de la suite (exclue)
+ */
+static void write_records(struct Bin_Trace *bt, uint64_t from, uint64_t to)
+{
+	if (bt->_format == BINTRACE_DELTA) {
+		for (; from < to; from++)
+			put_delta(bt, &bt->_ring[from & (BINTRACE_RING_SIZE - 1)]);
+		return;
+	}
+
+	while (from < to) {
+		unsigned index = from & (BINTRACE_RING_SIZE - 1);
+		uint64_t count = to - from;
+		//Pas au-delà de la fin du tampon :
+		if (count > BINTRACE_RING_SIZE - index)
+			count = BINTRACE_RING_SIZE - index;
+		for (unsigned i = 0; i < count; i++) {
+			const Trace_Event *ev = &bt->_ring[index + i];
+			bt->_records[i] = (Trace_Record) {
+				._pc = ev->_pc,
+				._raw = ev->_raw,
+				._value = ev->_value,
+				._cc = ev->_cc,
+			};
+		}
+		write_bytes(bt, bt->_records, count * sizeof(Trace_Record));
+		from += count;
+	}
+}
+
+//! Fin du format compressé : index des images complètes.
+/*!
+ * \param bt la trace
+ */
+static void finish_delta(struct Bin_Trace *bt)
+{
+	Delta_State *ds = &bt->_delta;
+
+	flush_output(bt);
+	Delta_Trailer trailer = {
+		._index_offset = ds->_offset,
+		._magic = BINTRACE_MAGIC,
+	};
+	uint8_t *p = ds->_out;
+	*p++ = DELTA_END;
+	p = put_varint(p, ds->_nkeyframes);
+	write_bytes(bt, ds->_out, p - ds->_out);
+	write_bytes(bt, ds->_keyframes, ds->_nkeyframes * sizeof(uint64_t));
+	write_bytes(bt, &trailer, sizeof(trailer));
+}
+
+//! Thread d'écriture : vide le tampon jusqu'à la fin de la trace.
+/*!
+ * \param arg la trace
+ * \return NULL
+ */
+static void *writer(void *arg)
+{
+	struct Bin_Trace *bt = arg;
+	const struct timespec pause = { 0, 100000 };	// 100 µs
+
+	for (;;) {
+		//_done est lu avant _head : tout ce qui a été publié avant la fin
+		//est vu ci-dessous.
+		int done = __atomic_load_n(&bt->_done, __ATOMIC_ACQUIRE);
+		uint64_t head = __atomic_load_n(&bt->_head, __ATOMIC_ACQUIRE);
+		if (head != bt->_tail) {
+			write_records(bt, bt->_tail, head);
+			__atomic_store_n(&bt->_tail, head, __ATOMIC_RELEASE);
+		} else if (done)
+			return NULL;
+		else
+			nanosleep(&pause, NULL);
+	}
+}
+
+//! Publication d'un enregistrement dans le tampon circulaire.
+/*!
+ * \param bt la trace
+ * \param rec l'enregistrement
+ */
+static void publish(struct Bin_Trace *bt, const Trace_Event *rec)
+{
+	uint64_t head = bt->_head;
+	//Tampon plein : on attend le thread d'écriture.
+	while (head - __atomic_load_n(&bt->_tail, __ATOMIC_ACQUIRE) == BINTRACE_RING_SIZE)
+		sched_yield();
+	bt->_ring[head & (BINTRACE_RING_SIZE - 1)] = *rec;
+	__atomic_store_n(&bt->_head, head + 1, __ATOMIC_RELEASE);
+}
+
+//! Complète l'enregistrement en cours avec l'état courant et le publie.
+/*!
+ * \param bt la trace
+ */
+static void finish_current(struct Bin_Trace *bt)
+{
+	Machine *pmach = bt->_pmach;
+	Trace_Event *rec = &bt->_current;
+	Instruction instr = { ._raw = rec->_raw };
+
+	switch (instr.instr_generic._cop) {
+	case LOAD:
+	case ADD:
+	case SUB:
+		rec->_value = pmach->_registers[instr.instr_generic._regcond];
+		//Comme refresh_cc(), que le moteur l'ait appelée ou non :
+		bt->_cc = rec->_value ? CC_P : CC_Z;
+		break;
+	case PUSH:
+	case POP:
+	case CALL:
+	case RET:
+		rec->_value = pmach->_sp;
+		break;
+	default:
+		rec->_value = 0;
+		break;
+	}
+	rec->_cc = bt->_cc;
+	if (rec->_data_addr != NO_DATA_ADDR)
+		rec->_data = pmach->_data[rec->_data_addr];
+	publish(bt, rec);
+	bt->_pending = false;
+}
+
+//! Fermeture d'une trace : vide le tampon et arrête le thread d'écriture.
+/*!
+ * \param bt la trace
+ */
+static void close_trace(struct Bin_Trace *bt)
+{
+	if (bt->_pending)
+		finish_current(bt);
+	__atomic_store_n(&bt->_done, 1, __ATOMIC_RELEASE);
+	pthread_join(bt->_writer, NULL);
+
+	if (bt->_format == BINTRACE_DELTA)
+		finish_delta(bt);
+	if (fclose(bt->_file) != 0) {
+		fprintf(stderr, "Erreur d'écriture de la trace dans <bintrace.c:close_trace>\n");
+		exit(1);
+	}
+	free(bt->_ring);
+	free(bt->_records);
+	free(bt->_delta._out);
+	free(bt->_delta._keyframes);
+	free(bt->_delta._data);
+	free(bt);
+}
+
+//! Fermeture de la trace ouverte, à la sortie du programme (après une erreur).
+static void close_active(void)
+{
+	struct Bin_Trace *bt = active;
+	active = NULL;
+	if (bt)
+		close_trace(bt);
+}
+
+//! Ouverture d'une trace binaire
+/*!
+ * \param pmach la machine à tracer
+ * \param filename le nom du fichier de trace
+ * \param format le format du fichier
+ */
+void bintrace_open(Machine *pmach, const char *filename, Bintrace_Format format)
+{
+	static bool registered = false;
+
+	if (active) {
+		fprintf(stderr, "Erreur : une trace binaire est déjà ouverte <bintrace.c:bintrace_open>\n");
+		exit(1);
+	}
+
+	struct Bin_Trace *bt = calloc(1, sizeof(*bt));
+	if (bt == NULL || (bt->_ring = malloc(BINTRACE_RING_SIZE * sizeof(Trace_Event))) == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <bintrace.c:bintrace_open>\n");
+		exit(1);
+	}
+	if ((bt->_file = fopen(filename, "wb")) == NULL) {
+		fprintf(stderr, "Erreur d'ouverture du fichier de trace dans <bintrace.c:bintrace_open>\n");
+		exit(1);
+	}
+	bt->_format = format;
+
+	Trace_Header header = {
+		._magic = BINTRACE_MAGIC,
+		._version = format,
+		._record_size = format == BINTRACE_RAW ? sizeof(Trace_Record) : 0,
+		._textsize = pmach->_textsize,
+	};
+	write_bytes(bt, &header, sizeof(header));
+
+	if (format == BINTRACE_RAW) {
+		bt->_records = malloc(BINTRACE_RING_SIZE * sizeof(Trace_Record));
+		if (bt->_records == NULL) {
+			fprintf(stderr, "Erreur d'allocation dans <bintrace.c:bintrace_open>\n");
+			exit(1);
+		}
+	} else {
+		Delta_State *ds = &bt->_delta;
+		Delta_Header delta = {
+			._datasize = pmach->_datasize,
+			._dataend = pmach->_dataend,
+			._keyframe_interval = pmach->_datasize > BINTRACE_KEYFRAME ? pmach->_datasize : BINTRACE_KEYFRAME,
+		};
+		write_bytes(bt, &delta, sizeof(delta));
+		write_bytes(bt, pmach->_text, pmach->_textsize * sizeof(Instruction));
+		ds->_offset = sizeof(header) + sizeof(delta) + pmach->_textsize * sizeof(Instruction);
+		ds->_interval = delta._keyframe_interval;
+
+		//Une image complète tient toujours dans le tampon de sortie :
+		size_t keyframe_size = 1 + (3 + NREGISTERS + pmach->_datasize) * 10;
+		ds->_out = malloc(OUTPUT_SIZE + keyframe_size);
+		ds->_data = malloc((pmach->_datasize ? pmach->_datasize : 1) * sizeof(Word));
+		if (ds->_out == NULL || ds->_data == NULL) {
+			fprintf(stderr, "Erreur d'allocation dans <bintrace.c:bintrace_open>\n");
+			exit(1);
+		}
+		ds->_next_pc = pmach->_pc;
+		memcpy(ds->_registers, pmach->_registers, sizeof(ds->_registers));
+		ds->_cc = pmach->_cc;
+		ds->_datasize = pmach->_datasize;
+		memcpy(ds->_data, pmach->_data, pmach->_datasize * sizeof(Word));
+	}
+
+	bt->_pmach = pmach;
+	bt->_cc = pmach->_cc;
+	if (pthread_create(&bt->_writer, NULL, writer, bt) != 0) {
+		fprintf(stderr, "Erreur de création du thread d'écriture dans <bintrace.c:bintrace_open>\n");
+		exit(1);
+	}
+
+	if (!registered) {
+		atexit(close_active);
+		registered = true;
+	}
+	active = bt;
+	pmach->_bintrace = bt;
+	pmach->_trace = TRACE_BINARY;
+	//Le code natif n'appelle pas bintrace_record() :
+	if (pmach->_engine == ENGINE_JIT)
+		pmach->_engine = ENGINE_THREADED;
+}
+
+//! Enregistrement d'une instruction dans la trace binaire
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param addr adresse de l'instruction à exécuter
+ */
+void bintrace_record(Machine *pmach, unsigned addr)
+{
+	struct Bin_Trace *bt = pmach->_bintrace;
+	Instruction instr = pmach->_text[addr];
+
+	if (bt->_pending)
+		finish_current(bt);
+	bt->_current._pc = addr;
+	bt->_current._raw = instr._raw;
+
+	//Mot de données que l'instruction peut écrire, calculé avant qu'elle ne
+	//modifie les registres :
+	unsigned data_addr;
+	switch (instr.instr_generic._cop) {
+	case STORE:
+	case POP:
+		data_addr = get_address(pmach, instr);
+		break;
+	case PUSH:
+	case CALL:
+		data_addr = pmach->_sp;
+		break;
+	default:
+		data_addr = NO_DATA_ADDR;
+		break;
+	}
+	if (data_addr >= pmach->_datasize)
+		data_addr = NO_DATA_ADDR;
+	bt->_current._data_addr = data_addr;
+	bt->_pending = true;
+}
+
+//! Fermeture de la trace binaire
+/*!
+ * \param pmach la machine tracée
+ */
+void bintrace_close(Machine *pmach)
+{
+	struct Bin_Trace *bt = pmach->_bintrace;
+	if (bt == NULL)
+		return;
+
+	if (active == bt)
+		active = NULL;
+	close_trace(bt);
+	pmach->_bintrace = NULL;
+	pmach->_trace = TRACE_OFF;
+}
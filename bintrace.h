@@ -0,0 +1,71 @@
+#ifndef _BINTRACE_H_
+#define _BINTRACE_H_
+
+/*!
+ * \file bintrace.h
+ * \brief Trace binaire de l'exécution, écrite par un thread en arrière-plan.
+ *
+ * Les formats de fichier sont décrits dans tracefile.h.
+ */
+
+#include "machine.h"
+#include "tracefile.h"
+
+//! Nom du fichier de trace binaire écrit par test_simul
+#define BINTRACE_FILE "trace.bin"
+
+//! Nombre d'enregistrements du tampon circulaire (puissance de 2)
+#define BINTRACE_RING_SIZE (1 << 16)
+
+//! Nombre d'enregistrements entre deux images complètes (format compressé)
+/*!
+ * Une image complète contient tout le segment de données : l'intervalle est
+ * au moins \c datasize enregistrements pour qu'elles ne dominent pas la trace.
+ */
+#define BINTRACE_KEYFRAME (1 << 16)
+
+struct Bin_Trace;
+
+//! Ouverture d'une trace binaire
+/*!
+ * Crée le fichier, démarre le thread d'écriture et passe la machine au
+ * niveau de trace \c TRACE_BINARY ; une machine confiée au moteur
+ * \c ENGINE_JIT, dont le code natif ne trace pas, passe au moteur
+ * \c ENGINE_THREADED. Une seule trace binaire peut être ouverte
+ * à la fois ; elle est fermée à la sortie du programme si bintrace_close()
+ * n'a pas été appelée, y compris après une erreur fatale.
+ *
+ * Le format compressé est produit par le thread d'écriture : le thread de
+ * simulation n'en paie pas le coût.
+ *
+ * \param pmach la machine à tracer
+ * \param filename le nom du fichier de trace
+ * \param format le format du fichier (voir tracefile.h)
+ */
+void bintrace_open(Machine *pmach, const char *filename, Bintrace_Format format);
+
+//! Enregistrement d'une instruction dans la trace binaire
+/*!
+ * Appelée, comme trace(), juste avant l'exécution de l'instruction : elle
+ * complète l'enregistrement de l'instruction précédente avec l'état courant
+ * et le publie dans le tampon circulaire, puis commence celui de
+ * l'instruction \c addr. Seul le thread de simulation l'appelle ; elle ne
+ * prend aucun verrou et n'attend que si le tampon est plein.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param addr adresse de l'instruction à exécuter
+ */
+void bintrace_record(Machine *pmach, unsigned addr);
+
+//! Fermeture de la trace binaire
+/*!
+ * Complète le dernier enregistrement, attend que le thread d'écriture ait
+ * vidé le tampon et ferme le fichier ; la machine n'est plus tracée. Doit être
+ * appelée tant que la machine existe encore. Sans effet si aucune trace n'est
+ * ouverte.
+ *
+ * \param pmach la machine tracée
+ */
+void bintrace_close(Machine *pmach);
+
+#endif
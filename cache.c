@@ -0,0 +1,561 @@
+/*!
+ * \file cache.c
+ * \brief Cache des résultats d'exécution, indexé par le contenu du programme.
+ *
+ * Un fichier de résultat commence par un \link Cache_Entry \endlink, suivi
+ * de \c _nruns intervalles <tt>{adresse, longueur}</tt> du segment de
+ * données, puis des \c _nwords mots finals de ces intervalles, à la suite.
+ *
+ * L'empreinte n'est pas cryptographique : deux lignes de multiplication et
+ * rotation sur des mots de 64 bits, mélangées à la fin. Elle suffit contre
+ * les collisions accidentelles, pas contre un programme construit pour en
+ * produire une.
+ *
+ * Les statistiques et la taille estimée du répertoire sont dans une
+ * projection anonyme partagée, pour être communes aux processus de
+ * batch_fork().
+ */
+
+#define _GNU_SOURCE	// MAP_ANONYMOUS
+
+#include "cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <time.h>
+
+//! Préfixe des fichiers temporaires, renommés une fois écrits
+#define TMP_PREFIX ".tmp."
+
+//! Âge, en secondes, au-delà duquel un fichier temporaire est abandonné
+/*!
+ * Un fichier temporaire est écrit d'un seul write() puis aussitôt renommé :
+ * s'il existe encore après ce délai, son auteur s'est arrêté avant le
+ * renommage.
+ */
+#define TMP_MAX_AGE 60
+
+//! En-tête d'un fichier de résultat
+typedef struct
+{
+	uint32_t _magic;		//!< \c CACHE_MAGIC
+	uint32_t _version;		//!< \c CACHE_VERSION
+	Cache_Key _key;		//!< Empreinte de l'état initial
+	uint64_t _instrs;		//!< Instructions exécutées
+	uint64_t _fused_ops;	//!< Superinstructions exécutées
+	uint64_t _fused_instrs;	//!< Instructions exécutées par ces superinstructions
+	Word _registers[NREGISTERS];//!< Registres généraux (SP compris)
+	uint32_t _textsize;		//!< Taille du segment de texte
+	uint32_t _datasize;		//!< Taille du segment de données
+	uint32_t _pc;		//!< Compteur ordinal
+	uint32_t _cc;		//!< Code condition
+	uint32_t _error;		//!< Erreur, \c ERR_NOERROR sur HALT
+	uint32_t _addr;		//!< Adresse de l'erreur, ou du HALT
+	uint32_t _nruns;		//!< Nombre d'intervalles modifiés
+	uint32_t _nwords;		//!< Nombre total de mots modifiés
+} Cache_Entry;
+
+//! Intervalle du segment de données modifié par l'exécution
+typedef struct
+{
+	uint32_t _addr;		//!< Première adresse
+	uint32_t _len;		//!< Nombre de mots
+} Cache_Run;
+
+//! État partagé entre les processus
+typedef struct
+{
+	Cache_Stats _stats;		//!< Statistiques
+	uint32_t _evicting;		//!< Non nul pendant une suppression
+} Cache_Shared;
+
+//! Cache de résultats
+struct Result_Cache
+{
+	char *_dirname;		//!< Répertoire du cache
+	uint64_t _limit;		//!< Taille maximale, en octets
+	Cache_Shared *_shared;	//!< Statistiques, projection partagée
+};
+
+//! Fichier du répertoire, pour la suppression des plus anciens
+typedef struct
+{
+	char _name[2 * sizeof(Cache_Key) + 1];	//!< Nom : l'empreinte
+	struct timespec _mtime;	//!< Date de dernière utilisation
+	uint64_t _size;		//!< Taille en octets
+} Cache_File;
+
+//! Allocation sans échec.
+static void *xmalloc(size_t size, const char *where)
+{
+	void *p = malloc(size);
+	if (p == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <cache.c:%s>\n", where);
+		exit(1);
+	}
+	return p;
+}
+
+//! Nom du fichier d'une empreinte : 32 chiffres hexadécimaux.
+static void key_name(const Cache_Key *key, char name[2 * sizeof(Cache_Key) + 1])
+{
+	sprintf(name, "%016llx%016llx", (unsigned long long) key->_hi, (unsigned long long) key->_lo);
+}
+
+//! Vrai si \c name est un nom de fichier de résultat.
+static bool is_key_name(const char *name)
+{
+	size_t len = strspn(name, "0123456789abcdef");
+	return len == 2 * sizeof(Cache_Key) && name[len] == '\0';
+}
+
+//! Chemin du fichier \c name du cache, à libérer par free().
+static char *cache_path(const Result_Cache *cache, const char *name)
+{
+	char *path = xmalloc(strlen(cache->_dirname) + strlen(name) + 2, "cache_path");
+	sprintf(path, "%s/%s", cache->_dirname, name);
+	return path;
+}
+
+//! Liste des fichiers de résultat du répertoire.
+/*!
+ * Les fichiers temporaires abandonnés (voir \c TMP_MAX_AGE) sont supprimés
+ * au passage.
+ *
+ * \param cache le cache
+ * \param count reçoit leur nombre
+ * \param total reçoit leur taille totale
+ * \return les fichiers, à libérer par free()
+ */
+static Cache_File *scan(const Result_Cache *cache, size_t *count, uint64_t *total)
+{
+	DIR *dir = opendir(cache->_dirname);
+	if (dir == NULL) {
+		fprintf(stderr, "Erreur d'ouverture du cache '%s' dans <cache.c:scan>\n", cache->_dirname);
+		exit(1);
+	}
+
+	size_t n = 0, max = 64;
+	Cache_File *files = xmalloc(max * sizeof(Cache_File), "scan");
+	struct dirent *entry;
+	struct stat st;
+	time_t now = time(NULL);
+	*total = 0;
+	while ((entry = readdir(dir)) != NULL) {
+		if (strncmp(entry->d_name, TMP_PREFIX, strlen(TMP_PREFIX)) == 0
+		    && fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISREG(st.st_mode)
+		    && now - st.st_mtime > TMP_MAX_AGE) {
+			unlinkat(dirfd(dir), entry->d_name, 0);
+			continue;
+		}
+		if (!is_key_name(entry->d_name)
+		    || fstatat(dirfd(dir), entry->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+			continue;
+		if (n == max) {
+			max *= 2;
+			files = realloc(files, max * sizeof(Cache_File));
+			if (files == NULL) {
+				fprintf(stderr, "Erreur d'allocation dans <cache.c:scan>\n");
+				exit(1);
+			}
+		}
+		strcpy(files[n]._name, entry->d_name);
+		files[n]._mtime = st.st_mtim;
+		files[n]._size = st.st_size;
+		*total += st.st_size;
+		n++;
+	}
+	closedir(dir);
+	*count = n;
+	return files;
+}
+
+//! Comparaison de dates d'utilisation, pour qsort() : les plus anciens d'abord.
+static int compare_mtimes(const void *a, const void *b)
+{
+	const struct timespec *ta = &((const Cache_File *) a)->_mtime;
+	const struct timespec *tb = &((const Cache_File *) b)->_mtime;
+	if (ta->tv_sec != tb->tv_sec)
+		return ta->tv_sec < tb->tv_sec ? -1 : 1;
+	return ta->tv_nsec < tb->tv_nsec ? -1 : ta->tv_nsec > tb->tv_nsec;
+}
+
+//! Suppression des résultats les moins récemment utilisés.
+/*!
+ * On descend aux trois quarts de la taille maximale, pour ne pas parcourir
+ * le répertoire à chaque enregistrement. Un seul thread ou processus
+ * supprime à la fois ; les autres continuent sans attendre.
+ */
+static void evict(Result_Cache *cache)
+{
+	Cache_Shared *shared = cache->_shared;
+	if (__atomic_exchange_n(&shared->_evicting, 1, __ATOMIC_ACQUIRE))
+		return;
+
+	size_t count;
+	uint64_t total;
+	Cache_File *files = scan(cache, &count, &total);
+	qsort(files, count, sizeof(Cache_File), compare_mtimes);
+	uint64_t target = cache->_limit / 4 * 3;
+	for (size_t i = 0; i < count && total > target; i++) {
+		char *path = cache_path(cache, files[i]._name);
+		if (unlink(path) == 0) {
+			total -= files[i]._size;
+			__atomic_fetch_add(&shared->_stats._evictions, 1, __ATOMIC_RELAXED);
+		}
+		free(path);
+	}
+	free(files);
+
+	__atomic_store_n(&shared->_stats._size, total, __ATOMIC_RELAXED);
+	__atomic_store_n(&shared->_evicting, 0, __ATOMIC_RELEASE);
+}
+
+//! Ouverture d'un cache
+/*!
+ * \param dirname le répertoire du cache
+ * \param limit taille maximale, en octets
+ * \return le cache
+ */
+Result_Cache *cache_open(const char *dirname, uint64_t limit)
+{
+	if (mkdir(dirname, 0777) != 0 && errno != EEXIST) {
+		fprintf(stderr, "Erreur de création du cache '%s' dans <cache.c:cache_open>\n", dirname);
+		exit(1);
+	}
+
+	Result_Cache *cache = xmalloc(sizeof(*cache), "cache_open");
+	cache->_dirname = strdup(dirname);
+	cache->_limit = limit;
+	cache->_shared = mmap(NULL, sizeof(Cache_Shared), PROT_READ | PROT_WRITE,
+			      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (cache->_dirname == NULL || cache->_shared == MAP_FAILED) {
+		fprintf(stderr, "Erreur d'allocation dans <cache.c:cache_open>\n");
+		exit(1);
+	}
+	memset(cache->_shared, 0, sizeof(Cache_Shared));
+
+	size_t count;
+	Cache_File *files = scan(cache, &count, &cache->_shared->_stats._size);
+	free(files);
+	if (cache->_shared->_stats._size > limit)
+		evict(cache);
+	return cache;
+}
+
+//! Fermeture d'un cache
+/*!
+ * \param cache le cache
+ */
+void cache_close(Result_Cache *cache)
+{
+	munmap(cache->_shared, sizeof(Cache_Shared));
+	free(cache->_dirname);
+	free(cache);
+}
+
+//! Empreinte en cours de calcul
+typedef struct
+{
+	uint64_t _a;		//!< Première ligne
+	uint64_t _b;		//!< Seconde ligne
+} Hasher;
+
+static const uint64_t K1 = 0x9e3779b97f4a7c15ull;	//!< Constantes de mélange
+static const uint64_t K2 = 0xc2b2ae3d27d4eb4full;
+static const uint64_t K3 = 0x165667b19e3779f9ull;
+
+//! Rotation à gauche.
+static inline uint64_t rotl(uint64_t x, int r)
+{
+	return x << r | x >> (64 - r);
+}
+
+//! Ajout d'un mot de 64 bits à l'empreinte.
+static inline void hash_mix(Hasher *h, uint64_t v)
+{
+	h->_a = rotl(h->_a ^ v * K1, 31) * K2;
+	h->_b = rotl(h->_b + (v ^ K3), 29) * K1 + h->_a;
+}
+
+//! Ajout d'une suite de mots de 32 bits, précédée de leur nombre.
+static void hash_words(Hasher *h, const uint32_t *words, size_t count)
+{
+	hash_mix(h, count);
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		uint64_t v;
+		memcpy(&v, words + i, sizeof(v));
+		hash_mix(h, v);
+	}
+	if (i < count)
+		hash_mix(h, words[i]);
+}
+
+//! Mélange final d'un mot (celui de MurmurHash3).
+static inline uint64_t fmix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	return x ^ x >> 33;
+}
+
+//! Empreinte de l'état initial d'une machine
+/*!
+ * \param pmach la machine
+ * \param count taille de l'image du segment de données
+ * \return l'empreinte
+ */
+Cache_Key cache_key(const Machine *pmach, unsigned count)
+{
+	while (count > 0 && pmach->_data[count - 1] == 0)
+		count--;
+
+	uint32_t state[] = { CACHE_VERSION, pmach->_textsize, pmach->_datasize, pmach->_dataend,
+			     pmach->_pc, pmach->_cc };
+	Hasher h = { K1, K2 };
+	hash_words(&h, state, sizeof(state) / sizeof(state[0]));
+	hash_words(&h, pmach->_registers, NREGISTERS);
+	hash_words(&h, (const uint32_t *) pmach->_text, pmach->_textsize);
+	hash_words(&h, pmach->_data, count);
+
+	uint64_t a = fmix(h._a), b = fmix(h._b);
+	return (Cache_Key) { a ^ b * K3, b ^ rotl(a, 32) };
+}
+
+//! Recherche d'un résultat
+/*!
+ * Un fichier incohérent avec la machine (tailles, intervalles hors du
+ * segment) ou tronqué est ignoré, comme un résultat absent.
+ *
+ * \param cache le cache
+ * \param key l'empreinte
+ * \param pmach la machine
+ * \param fault reçoit le résultat
+ * \return vrai si le résultat était dans le cache
+ */
+bool cache_lookup(Result_Cache *cache, const Cache_Key *key, Machine *pmach, Fault *fault)
+{
+	char name[2 * sizeof(Cache_Key) + 1];
+	key_name(key, name);
+	char *path = cache_path(cache, name);
+	int handle = open(path, O_RDONLY);
+	free(path);
+
+	struct stat st;
+	Cache_Entry *entry = NULL;
+	bool hit = false;
+	if (handle >= 0 && fstat(handle, &st) == 0 && (size_t) st.st_size >= sizeof(Cache_Entry)) {
+		entry = xmalloc(st.st_size, "cache_lookup");
+		if (pread(handle, entry, st.st_size, 0) == st.st_size
+		    && entry->_magic == CACHE_MAGIC && entry->_version == CACHE_VERSION
+		    && entry->_key._lo == key->_lo && entry->_key._hi == key->_hi
+		    && entry->_textsize == pmach->_textsize && entry->_datasize == pmach->_datasize
+		    && (size_t) st.st_size == sizeof(Cache_Entry) + (size_t) entry->_nruns * sizeof(Cache_Run)
+					     + (size_t) entry->_nwords * sizeof(Word))
+			hit = true;
+	}
+
+	//Intervalles dans le segment (mot datasize compris, voir
+	//check_data_addr()) et de longueur totale _nwords :
+	const Cache_Run *runs = NULL;
+	const Word *words = NULL;
+	if (hit) {
+		runs = (const Cache_Run *) (entry + 1);
+		words = (const Word *) (runs + entry->_nruns);
+		uint64_t nwords = 0;
+		for (uint32_t r = 0; r < entry->_nruns; r++) {
+			nwords += runs[r]._len;
+			if ((uint64_t) runs[r]._addr + runs[r]._len > (uint64_t) pmach->_datasize + 1)
+				hit = false;
+		}
+		if (nwords != entry->_nwords)
+			hit = false;
+	}
+
+	if (hit) {
+		for (uint32_t r = 0; r < entry->_nruns; r++) {
+			memcpy(pmach->_data + runs[r]._addr, words, runs[r]._len * sizeof(Word));
+			words += runs[r]._len;
+		}
+		memcpy(pmach->_registers, entry->_registers, sizeof(pmach->_registers));
+		pmach->_pc = entry->_pc;
+		pmach->_cc = entry->_cc;
+		pmach->_instrs = entry->_instrs;
+		pmach->_fused_ops = entry->_fused_ops;
+		pmach->_fused_instrs = entry->_fused_instrs;
+		*fault = (Fault) { entry->_error, entry->_addr };
+		//Date d'utilisation, pour la suppression des plus anciens :
+		futimens(handle, NULL);
+	}
+	free(entry);
+	if (handle >= 0)
+		close(handle);
+
+	__atomic_fetch_add(hit ? &cache->_shared->_stats._hits : &cache->_shared->_stats._misses,
+			   1, __ATOMIC_RELAXED);
+	return hit;
+}
+
+//! Pages jamais touchées d'une zone de mémoire anonyme.
+/*!
+ * Une page anonyme jamais touchée n'est ni présente en mémoire ni dans
+ * l'espace d'échange (bits 63 et 62 de son entrée de /proc/self/pagemap) :
+ * elle vaut encore 0.
+ *
+ * \param lo début de la zone, sur une frontière de page
+ * \param npages nombre de pages
+ * \param pagesize taille d'une page
+ * \return un octet non nul par page jamais touchée, à libérer par free() ;
+ * NULL si /proc/self/pagemap n'est pas lisible
+ */
+static uint8_t *untouched_pages(uintptr_t lo, size_t npages, size_t pagesize)
+{
+	int handle = open("/proc/self/pagemap", O_RDONLY);
+	if (handle < 0)
+		return NULL;
+
+	uint8_t *untouched = xmalloc(npages ? npages : 1, "untouched_pages");
+	uint64_t entries[512];
+	for (size_t p = 0; p < npages; ) {
+		size_t n = npages - p < 512 ? npages - p : 512;
+		off_t offset = (off_t) (lo / pagesize + p) * sizeof(uint64_t);
+		if (pread(handle, entries, n * sizeof(uint64_t), offset) != (ssize_t) (n * sizeof(uint64_t))) {
+			free(untouched);
+			close(handle);
+			return NULL;
+		}
+		for (size_t i = 0; i < n; i++)
+			untouched[p + i] = (entries[i] >> 62) == 0;
+		p += n;
+	}
+	close(handle);
+	return untouched;
+}
+
+//! Enregistrement d'un résultat
+/*!
+ * Le segment de données est comparé mot à mot à l'image initiale. Au-delà de
+ * l'image, dans la réservation anonyme de read_program() ou d'une machine de
+ * la réserve (voir machine_create()), les pages jamais touchées par
+ * l'exécution ne sont pas lues : le coût suit la mémoire utilisée, et non la
+ * taille du segment.
+ *
+ * \param cache le cache
+ * \param key l'empreinte
+ * \param pmach la machine
+ * \param fault le résultat de simul_run()
+ * \param count taille de l'image initiale
+ * \param image l'image initiale
+ */
+void cache_store(Result_Cache *cache, const Cache_Key *key, const Machine *pmach, Fault fault,
+		 unsigned count, const Word image[count])
+{
+	//Intervalles de mots modifiés, puis leurs valeurs finales :
+	size_t nruns = 0, maxruns = 16, nwords = 0;
+	Cache_Run *runs = xmalloc(maxruns * sizeof(Cache_Run), "cache_store");
+	size_t end = (size_t) pmach->_datasize + 1;
+
+	//Pages entières après l'image, de la première (mot skip) à la fin :
+	size_t pagesize = sysconf(_SC_PAGESIZE);
+	size_t pagewords = pagesize / sizeof(Word);
+	uintptr_t lo = ((uintptr_t) (pmach->_data + count) + pagesize - 1) & ~(uintptr_t) (pagesize - 1);
+	uintptr_t hi = (uintptr_t) (pmach->_data + end);
+	size_t skip = (lo - (uintptr_t) pmach->_data) / sizeof(Word);
+	uint8_t *untouched = NULL;
+	if (pmach->_data_map != NULL && lo < hi)
+		untouched = untouched_pages(lo, (hi - lo + pagesize - 1) / pagesize, pagesize);
+	size_t next = untouched ? skip : end;	// prochaine page à examiner
+
+	for (size_t a = 0; a < end; ) {
+		if (a >= next) {
+			size_t page = (a - skip) / pagewords;
+			next = skip + (page + 1) * pagewords;
+			if (untouched[page] && a == skip + page * pagewords) {
+				a = next < end ? next : end;
+				continue;
+			}
+		}
+		if (pmach->_data[a] == (a < count ? image[a] : 0)) {
+			a++;
+			continue;
+		}
+		size_t first = a;
+		while (a < end && pmach->_data[a] != (a < count ? image[a] : 0))
+			a++;
+		if (nruns == maxruns) {
+			maxruns *= 2;
+			runs = realloc(runs, maxruns * sizeof(Cache_Run));
+			if (runs == NULL) {
+				fprintf(stderr, "Erreur d'allocation dans <cache.c:cache_store>\n");
+				exit(1);
+			}
+		}
+		runs[nruns++] = (Cache_Run) { first, a - first };
+		nwords += a - first;
+	}
+	free(untouched);
+
+	size_t size = sizeof(Cache_Entry) + nruns * sizeof(Cache_Run) + nwords * sizeof(Word);
+	Cache_Entry *entry = xmalloc(size, "cache_store");
+	*entry = (Cache_Entry) {
+		._magic = CACHE_MAGIC, ._version = CACHE_VERSION, ._key = *key,
+		._instrs = pmach->_instrs,
+		._fused_ops = pmach->_fused_ops, ._fused_instrs = pmach->_fused_instrs,
+		._textsize = pmach->_textsize, ._datasize = pmach->_datasize,
+		._pc = pmach->_pc, ._cc = pmach->_cc, ._error = fault._error, ._addr = fault._addr,
+		._nruns = nruns, ._nwords = nwords,
+	};
+	memcpy(entry->_registers, pmach->_registers, sizeof(entry->_registers));
+	memcpy(entry + 1, runs, nruns * sizeof(Cache_Run));
+	Word *words = (Word *) ((Cache_Run *) (entry + 1) + nruns);
+	for (size_t r = 0; r < nruns; r++) {
+		memcpy(words, pmach->_data + runs[r]._addr, runs[r]._len * sizeof(Word));
+		words += runs[r]._len;
+	}
+	free(runs);
+
+	//Écriture sous un nom temporaire (ignoré par scan()), puis renommage :
+	//un lecteur ne voit jamais de fichier incomplet.
+	char name[2 * sizeof(Cache_Key) + 1];
+	key_name(key, name);
+	char *tmp = cache_path(cache, TMP_PREFIX "XXXXXX");
+	char *path = cache_path(cache, name);
+	int handle = mkstemp(tmp);
+	bool stored = handle >= 0 && fchmod(handle, 0644) == 0
+		      && write(handle, entry, size) == (ssize_t) size;
+	if (handle >= 0)
+		close(handle);
+	stored = stored && rename(tmp, path) == 0;
+	if (!stored && handle >= 0)
+		unlink(tmp);
+	free(tmp);
+	free(path);
+	free(entry);
+
+	//Un cache inaccessible en écriture ne fait que perdre le résultat.
+	if (!stored)
+		return;
+	Cache_Stats *stats = &cache->_shared->_stats;
+	__atomic_fetch_add(&stats->_stores, 1, __ATOMIC_RELAXED);
+	if (__atomic_add_fetch(&stats->_size, size, __ATOMIC_RELAXED) > cache->_limit)
+		evict(cache);
+}
+
+//! Statistiques d'un cache
+/*!
+ * \param cache le cache
+ * \param stats reçoit les statistiques
+ */
+void cache_stats(const Result_Cache *cache, Cache_Stats *stats)
+{
+	*stats = cache->_shared->_stats;
+}
@@ -0,0 +1,129 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+/*!
+ * \file cache.h
+ * \brief Cache des résultats d'exécution, indexé par le contenu du programme.
+ *
+ * La machine est déterministe : l'état final d'une exécution ne dépend que de
+ * l'état initial, c'est-à-dire du segment de texte, de l'image du segment de
+ * données, des tailles de segments, des registres, de \c _pc et de \c _cc. Ce
+ * cache associe à l'empreinte de cet état initial (\link Cache_Key \endlink)
+ * le résultat de l'exécution : registres, \c _pc, \c _cc, nombre
+ * d'instructions, erreur, et les seuls mots du segment de données qui
+ * diffèrent de l'image initiale. Le moteur d'exécution n'entre pas dans
+ * l'empreinte, tous les moteurs produisant le même état final.
+ *
+ * Le cache est un répertoire contenant un fichier par résultat, nommé par
+ * l'empreinte en hexadécimal. Un fichier est écrit sous un nom temporaire
+ * puis renommé : plusieurs threads ou processus, et plusieurs exécutions du
+ * simulateur, peuvent partager le même répertoire. La taille totale des
+ * fichiers est bornée : au-delà, les résultats les moins récemment utilisés
+ * sont supprimés. Les fichiers temporaires laissés par un simulateur arrêté
+ * avant le renommage sont supprimés à l'ouverture du cache.
+ *
+ * Un résultat pris dans le cache n'est ni tracé ni accompagné des
+ * avertissements de l'exécution.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "machine.h"
+
+//! Taille maximale par défaut du répertoire de cache, en octets
+#define CACHE_LIMIT (64u << 20)
+
+//! Identification d'un fichier de résultat (premier mot du fichier)
+#define CACHE_MAGIC 0x48434143	// "CACH"
+
+//! Version du format des fichiers de résultat, et de l'empreinte
+#define CACHE_VERSION 2
+
+//! Empreinte de 128 bits de l'état initial d'une machine
+typedef struct
+{
+    uint64_t _lo;		//!< Poids faibles
+    uint64_t _hi;		//!< Poids forts
+} Cache_Key;
+
+//! Statistiques d'un cache
+/*!
+ * Les compteurs sont communs à tous les threads et à tous les processus
+ * créés par fork() après cache_open().
+ */
+typedef struct
+{
+    uint64_t _hits;		//!< Recherches fructueuses
+    uint64_t _misses;		//!< Recherches infructueuses
+    uint64_t _stores;		//!< Résultats enregistrés
+    uint64_t _evictions;	//!< Résultats supprimés pour borner la taille
+    uint64_t _size;		//!< Taille estimée du répertoire, en octets
+} Cache_Stats;
+
+//! Cache de résultats
+typedef struct Result_Cache Result_Cache;
+
+//! Ouverture d'un cache
+/*!
+ * Le répertoire est créé s'il n'existe pas.
+ *
+ * \param dirname le répertoire du cache
+ * \param limit taille maximale des fichiers du cache, en octets
+ * \return le cache, à fermer par cache_close()
+ */
+Result_Cache *cache_open(const char *dirname, uint64_t limit);
+
+//! Fermeture d'un cache
+/*!
+ * \param cache le cache
+ */
+void cache_close(Result_Cache *cache);
+
+//! Empreinte de l'état initial d'une machine
+/*!
+ * La machine doit être dans son état initial : le segment de données
+ * commence par une image de \c count mots et vaut 0 au-delà. Les zéros de
+ * fin de l'image n'entrent pas dans l'empreinte.
+ *
+ * \param pmach la machine, avant l'exécution
+ * \param count taille de l'image du segment de données
+ * \return l'empreinte
+ */
+Cache_Key cache_key(const Machine *pmach, unsigned count);
+
+//! Recherche d'un résultat
+/*!
+ * En cas de succès, la machine est mise dans l'état final enregistré,
+ * comme si elle avait été exécutée par simul_run() : la machine doit donc
+ * être encore dans l'état initial dont \c key est l'empreinte.
+ *
+ * \param cache le cache
+ * \param key l'empreinte de l'état initial de la machine
+ * \param pmach la machine
+ * \param fault reçoit le résultat qu'aurait rendu simul_run()
+ * \return vrai si le résultat était dans le cache
+ */
+bool cache_lookup(Result_Cache *cache, const Cache_Key *key, Machine *pmach, Fault *fault);
+
+//! Enregistrement d'un résultat
+/*!
+ * \param cache le cache
+ * \param key l'empreinte de l'état initial de la machine
+ * \param pmach la machine, après simul_run()
+ * \param fault le résultat de simul_run()
+ * \param count taille de l'image initiale du segment de données
+ * \param image l'image initiale, le reste du segment valant 0 : l'état final
+ * n'est enregistré que par différence avec elle
+ */
+void cache_store(Result_Cache *cache, const Cache_Key *key, const Machine *pmach, Fault fault,
+                 unsigned count, const Word image[count]);
+
+//! Statistiques d'un cache
+/*!
+ * \param cache le cache
+ * \param stats reçoit les statistiques
+ */
+void cache_stats(const Result_Cache *cache, Cache_Stats *stats);
+
+#endif
@@ -0,0 +1,317 @@
+/*!
+ * \file callgraph.c
+ * \brief Graphe d'appels : instructions par sous-programme, dans chaque
+ * contexte d'appel.
+ *
+ * Les contextes d'appel forment un arbre (\e calling \e context \e tree)
+ * dont les nœuds sont rangés dans un tableau : un nœud est toujours créé
+ * après son parent, si bien qu'un parcours du tableau à l'envers voit les
+ * enfants avant leurs parents.
+ */
+
+#include "callgraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Pas de nœud
+#define CALL_NONE UINT32_MAX
+
+//! Contexte d'appel
+typedef struct
+{
+	uint32_t _addr;		//!< Adresse du sous-programme
+	uint32_t _parent;		//!< Contexte appelant, \c CALL_NONE pour la racine
+	uint32_t _child;		//!< Premier contexte appelé, ou \c CALL_NONE
+	uint32_t _sibling;		//!< Contexte suivant du même appelant, ou \c CALL_NONE
+	uint64_t _calls;		//!< Nombre d'appels
+	uint64_t _self;		//!< Instructions exclusives
+} Call_Node;
+
+//! Appel en cours, dans la pile fantôme
+typedef struct
+{
+	uint32_t _node;		//!< Contexte appelé
+	uint32_t _slot;		//!< Adresse du mot contenant l'adresse de retour
+} Call_Frame;
+
+//! Graphe d'appels
+struct Call_Graph
+{
+	Call_Node *_nodes;		//!< Contextes ; la racine est le premier
+	unsigned _nnodes;		//!< Nombre de contextes
+	unsigned _maxnodes;		//!< Capacité de \c _nodes
+	Call_Frame *_stack;		//!< Pile fantôme
+	unsigned _depth;		//!< Nombre d'appels en cours
+	unsigned _maxdepth;		//!< Capacité de \c _stack
+	uint32_t _current;		//!< Contexte en cours
+	uint64_t _last;		//!< \c _instrs lors du dernier événement
+};
+
+//! Ligne du rapport : un sous-programme
+typedef struct
+{
+	uint32_t _addr;		//!< Adresse du sous-programme
+	uint64_t _calls;		//!< Nombre d'appels
+	uint64_t _incl;		//!< Instructions inclusives
+	uint64_t _self;		//!< Instructions exclusives
+} Call_Line;
+
+//! Agrandissement d'un tableau, sans échec.
+static void *grow(void *array, unsigned *max, size_t size)
+{
+	*max = *max ? 2 * *max : 64;
+	array = realloc(array, *max * size);
+	if (array == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <callgraph.c:grow>\n");
+		exit(1);
+	}
+	return array;
+}
+
+//! Nouveau contexte, appelé depuis \c parent.
+static uint32_t new_node(Call_Graph *cg, uint32_t parent, uint32_t addr)
+{
+	if (cg->_nnodes == cg->_maxnodes)
+		cg->_nodes = grow(cg->_nodes, &cg->_maxnodes, sizeof(Call_Node));
+	uint32_t n = cg->_nnodes++;
+	cg->_nodes[n] = (Call_Node) { addr, parent, CALL_NONE, CALL_NONE, 0, 0 };
+	if (parent != CALL_NONE) {
+		cg->_nodes[n]._sibling = cg->_nodes[parent]._child;
+		cg->_nodes[parent]._child = n;
+	}
+	return n;
+}
+
+//! Début du suivi des appels d'une machine
+/*!
+ * \param pmach la machine
+ */
+void callgraph_start(Machine *pmach)
+{
+	callgraph_stop(pmach);
+	Call_Graph *cg = calloc(1, sizeof(Call_Graph));
+	if (cg == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <callgraph.c:callgraph_start>\n");
+		exit(1);
+	}
+	cg->_current = new_node(cg, CALL_NONE, pmach->_pc);
+	cg->_last = pmach->_instrs;
+	pmach->_calls = cg;
+}
+
+//! Fin du suivi des appels d'une machine
+/*!
+ * \param pmach la machine
+ */
+void callgraph_stop(Machine *pmach)
+{
+	Call_Graph *cg = pmach->_calls;
+	if (cg == NULL)
+		return;
+	free(cg->_nodes);
+	free(cg->_stack);
+	free(cg);
+	pmach->_calls = NULL;
+}
+
+//! Attribution des instructions exécutées depuis le dernier événement.
+static inline void settle(Call_Graph *cg, uint64_t instrs)
+{
+	cg->_nodes[cg->_current]._self += instrs - cg->_last;
+	cg->_last = instrs;
+}
+
+//! Événement CALL
+/*!
+ * Le CALL lui-même est compté dans l'appelant, le RET dans l'appelé.
+ *
+ * \param pmach la machine
+ */
+void callgraph_call(Machine *pmach)
+{
+	Call_Graph *cg = pmach->_calls;
+	settle(cg, pmach->_instrs);
+
+	//Contexte déjà rencontré ? Il passe en tête de la liste de son appelant,
+	//où le prochain appel le trouvera aussitôt.
+	uint32_t parent = cg->_current, prev = CALL_NONE, n = cg->_nodes[parent]._child;
+	while (n != CALL_NONE && cg->_nodes[n]._addr != pmach->_pc) {
+		prev = n;
+		n = cg->_nodes[n]._sibling;
+	}
+	if (n == CALL_NONE)
+		n = new_node(cg, parent, pmach->_pc);
+	else if (prev != CALL_NONE) {
+		cg->_nodes[prev]._sibling = cg->_nodes[n]._sibling;
+		cg->_nodes[n]._sibling = cg->_nodes[parent]._child;
+		cg->_nodes[parent]._child = n;
+	}
+	cg->_nodes[n]._calls++;
+
+	if (cg->_depth == cg->_maxdepth)
+		cg->_stack = grow(cg->_stack, &cg->_maxdepth, sizeof(Call_Frame));
+	cg->_stack[cg->_depth++] = (Call_Frame) { n, pmach->_sp + 1 };
+	cg->_current = n;
+}
+
+//! Événement RET
+/*!
+ * La pile grandit vers les adresses basses : les appels abandonnés ont une
+ * adresse de retour plus basse que celle que lit le RET.
+ *
+ * \param pmach la machine
+ */
+void callgraph_ret(Machine *pmach)
+{
+	Call_Graph *cg = pmach->_calls;
+	settle(cg, pmach->_instrs);
+
+	unsigned slot = pmach->_sp;
+	unsigned depth = cg->_depth;
+	while (depth > 0 && cg->_stack[depth - 1]._slot < slot)
+		depth--;
+	if (depth == 0 || cg->_stack[depth - 1]._slot != slot)
+		return;
+	cg->_depth = depth - 1;
+	cg->_current = cg->_depth > 0 ? cg->_stack[cg->_depth - 1]._node : 0;
+}
+
+//! Nombre d'appels en cours
+/*!
+ * \param pmach la machine
+ * \return la profondeur de la pile fantôme
+ */
+unsigned callgraph_depth(const Machine *pmach)
+{
+	const Call_Graph *cg = __atomic_load_n(&pmach->_calls, __ATOMIC_RELAXED);
+	return cg != NULL ? __atomic_load_n(&cg->_depth, __ATOMIC_RELAXED) : 0;
+}
+
+//! Instructions exclusives d'un contexte, celles du contexte en cours comprises.
+static uint64_t self_count(const Call_Graph *cg, const Machine *pmach, uint32_t n)
+{
+	uint64_t self = cg->_nodes[n]._self;
+	if (n == cg->_current)
+		self += pmach->_instrs - cg->_last;
+	return self;
+}
+
+//! Comparaison de lignes par adresse, pour qsort().
+static int compare_addrs(const void *a, const void *b)
+{
+	const Call_Line *la = a, *lb = b;
+	return la->_addr < lb->_addr ? -1 : la->_addr > lb->_addr;
+}
+
+//! Comparaison de lignes, pour qsort() : les plus coûteuses d'abord.
+static int compare_incls(const void *a, const void *b)
+{
+	const Call_Line *la = a, *lb = b;
+	if (la->_incl != lb->_incl)
+		return la->_incl > lb->_incl ? -1 : 1;
+	return compare_addrs(a, b);
+}
+
+//! Affichage des sous-programmes les plus coûteux
+/*!
+ * \param pmach la machine
+ * \param top nombre maximal de lignes
+ */
+void callgraph_report(const Machine *pmach, unsigned top)
+{
+	const Call_Graph *cg = pmach->_calls;
+	if (cg == NULL)
+		return;
+
+	//Instructions inclusives de chaque contexte, les enfants avant leurs
+	//parents :
+	uint64_t *incl = malloc(cg->_nnodes * sizeof(uint64_t));
+	Call_Line *lines = malloc(cg->_nnodes * sizeof(Call_Line));
+	if (incl == NULL || lines == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <callgraph.c:callgraph_report>\n");
+		exit(1);
+	}
+	uint64_t total = 0;
+	for (unsigned n = 0; n < cg->_nnodes; n++)
+		total += incl[n] = self_count(cg, pmach, n);
+	for (unsigned n = cg->_nnodes; n-- > 1; )
+		incl[cg->_nodes[n]._parent] += incl[n];
+
+	//Un contexte récursif est déjà compris dans l'inclusif de son ancêtre de
+	//même adresse :
+	for (unsigned n = 0; n < cg->_nnodes; n++) {
+		const Call_Node *node = &cg->_nodes[n];
+		uint32_t a = node->_parent;
+		while (a != CALL_NONE && cg->_nodes[a]._addr != node->_addr)
+			a = cg->_nodes[a]._parent;
+		lines[n] = (Call_Line) { node->_addr, node->_calls, a == CALL_NONE ? incl[n] : 0,
+					 self_count(cg, pmach, n) };
+	}
+
+	//Regroupement par adresse :
+	qsort(lines, cg->_nnodes, sizeof(Call_Line), compare_addrs);
+	unsigned nlines = 0;
+	for (unsigned n = 0; n < cg->_nnodes; n++) {
+		if (nlines > 0 && lines[nlines - 1]._addr == lines[n]._addr) {
+			lines[nlines - 1]._calls += lines[n]._calls;
+			lines[nlines - 1]._incl += lines[n]._incl;
+			lines[nlines - 1]._self += lines[n]._self;
+		}
+		else
+			lines[nlines++] = lines[n];
+	}
+	qsort(lines, nlines, sizeof(Call_Line), compare_incls);
+
+	double scale = total ? 100.0 / total : 0.0;
+	printf("\n*** Call graph: %llu instructions, %u contexts ***\n\n",
+	       (unsigned long long) total, cg->_nnodes);
+	printf("%12s %12s %7s %12s %7s  subroutine\n", "calls", "inclusive", "%", "exclusive", "%");
+	for (unsigned i = 0; i < nlines && i < top; i++)
+		printf("%12llu %12llu %6.2f%% %12llu %6.2f%%  0x%04x\n",
+		       (unsigned long long) lines[i]._calls, (unsigned long long) lines[i]._incl,
+		       lines[i]._incl * scale, (unsigned long long) lines[i]._self,
+		       lines[i]._self * scale, lines[i]._addr);
+	if (nlines > top)
+		printf("%12s (%u more subroutines)\n", "...", nlines - top);
+
+	free(incl);
+	free(lines);
+}
+
+//! Écriture des piles repliées
+/*!
+ * \param pmach la machine
+ * \param filename le nom du fichier
+ */
+void callgraph_write(const Machine *pmach, const char *filename)
+{
+	const Call_Graph *cg = pmach->_calls;
+	if (cg == NULL)
+		return;
+
+	FILE *f = fopen(filename, "w");
+	uint32_t *path = malloc(cg->_nnodes * sizeof(uint32_t));
+	if (f == NULL || path == NULL) {
+		fprintf(stderr, "Erreur d'ouverture du fichier '%s' dans <callgraph.c:callgraph_write>\n", filename);
+		exit(1);
+	}
+
+	for (unsigned n = 0; n < cg->_nnodes; n++) {
+		uint64_t self = self_count(cg, pmach, n);
+		if (self == 0)
+			continue;
+		unsigned depth = 0;
+		for (uint32_t a = n; a != CALL_NONE; a = cg->_nodes[a]._parent)
+			path[depth++] = cg->_nodes[a]._addr;
+		while (depth-- > 0)
+			fprintf(f, "0x%04x%c", path[depth], depth > 0 ? ';' : ' ');
+		fprintf(f, "%llu\n", (unsigned long long) self);
+	}
+
+	free(path);
+	if (fclose(f) != 0) {
+		fprintf(stderr, "Erreur d'écriture du fichier '%s' dans <callgraph.c:callgraph_write>\n", filename);
+		exit(1);
+	}
+}
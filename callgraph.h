@@ -0,0 +1,101 @@
+#ifndef _CALLGRAPH_H_
+#define _CALLGRAPH_H_
+
+/*!
+ * \file callgraph.h
+ * \brief Graphe d'appels : instructions par sous-programme, dans chaque
+ * contexte d'appel.
+ *
+ * Une pile d'appels fantôme suit les CALL et les RET de la machine : chaque
+ * CALL effectué y empile le sous-programme appelé, chaque RET dépile le
+ * sous-programme dont il reprend l'adresse de retour. Les instructions
+ * exécutées entre deux de ces événements sont attribuées au sous-programme
+ * au sommet de la pile, dans son contexte d'appel (la suite des appelants
+ * depuis le point d'entrée) : on en déduit les nombres d'instructions
+ * exclusifs et inclusifs de chaque sous-programme, et les piles « repliées »
+ * lues par les outils de \e flamegraph.
+ *
+ * Le suivi ne coûte qu'un test par CALL et par RET quand il est inactif, et
+ * un appel de fonction par CALL et par RET quand il est actif : les autres
+ * instructions ne sont pas concernées, et les moteurs gardent leur boucle.
+ * Le JIT rend alors les CALL et les RET à l'interpréteur.
+ */
+
+#include "machine.h"
+
+//! Graphe d'appels d'une machine
+typedef struct Call_Graph Call_Graph;
+
+//! Début du suivi des appels d'une machine
+/*!
+ * Le graphe est vide ; sa racine est le point d'entrée, l'adresse \c _pc
+ * courante.
+ *
+ * \param pmach la machine
+ */
+void callgraph_start(Machine *pmach);
+
+//! Fin du suivi des appels d'une machine
+/*!
+ * Libère le graphe. Appelée par free_program() et machine_destroy() ; sans
+ * effet si les appels de la machine ne sont pas suivis.
+ *
+ * \param pmach la machine
+ */
+void callgraph_stop(Machine *pmach);
+
+//! Événement CALL
+/*!
+ * Appelée par les moteurs après un CALL effectué : \c _pc est l'adresse du
+ * sous-programme, l'adresse de retour est au mot <tt>_sp + 1</tt>.
+ *
+ * \param pmach la machine
+ */
+void callgraph_call(Machine *pmach);
+
+//! Événement RET
+/*!
+ * Appelée par les moteurs après un RET : l'adresse de retour a été lue au
+ * mot \c _sp. Les sous-programmes empilés plus haut que ce mot, abandonnés
+ * sans RET, sont dépilés avec lui ; un RET sans CALL correspondant est
+ * ignoré.
+ *
+ * \param pmach la machine
+ */
+void callgraph_ret(Machine *pmach);
+
+//! Nombre d'appels en cours
+/*!
+ * Ne fait que lire la pile fantôme : utilisable depuis un gestionnaire de
+ * signal (voir sample.h).
+ *
+ * \param pmach la machine
+ * \return la profondeur de la pile fantôme, 0 si les appels ne sont pas
+ * suivis
+ */
+unsigned callgraph_depth(const Machine *pmach);
+
+//! Affichage des sous-programmes les plus coûteux
+/*!
+ * Pour chaque adresse de sous-programme : nombre d'appels, instructions
+ * inclusives (sous-programmes appelés compris, une seule fois en cas de
+ * récursion) et exclusives, par ordre décroissant des premières.
+ *
+ * \param pmach la machine
+ * \param top nombre maximal de lignes
+ */
+void callgraph_report(const Machine *pmach, unsigned top);
+
+//! Écriture des piles repliées
+/*!
+ * Une ligne par contexte d'appel ayant exécuté des instructions : les
+ * adresses des sous-programmes depuis le point d'entrée, séparées par des
+ * points-virgules, puis le nombre d'instructions exclusives, comme
+ * <tt>0x0000;0x000a;0x0011 42</tt>.
+ *
+ * \param pmach la machine
+ * \param filename le nom du fichier
+ */
+void callgraph_write(const Machine *pmach, const char *filename);
+
+#endif
@@ -5,6 +5,7 @@
 
 
 #include "debug.h"
+#include "snapshot.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
@@ -46,6 +47,7 @@ bool debug_ask(Machine *pmach){
 					printf("\tp\tprint text memory\n");
 					printf("\tt\tprint text memory\n");
 					printf("\tm\tprint registres and data memory\n");
+					printf("\tw\twrite a snapshot to " SNAPSHOT_FILE "\n");
 					break;
 				case 'c':
 					return false;
@@ -69,6 +71,9 @@ bool debug_ask(Machine *pmach){
 					print_data(pmach);
 					print_cpu(pmach);
 					break;
+				case 'w':
+					snapshot_write(pmach, SNAPSHOT_FILE);
+					break;
 			}
 		} else if (count == 0)
 			return true; 
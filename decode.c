@@ -0,0 +1,370 @@
+/*!
+ * \file decode.c
+ * \brief Prédécodage du segment de texte en micro-opérations.
+ */
+
+#define _POSIX_C_SOURCE 200112L	// posix_memalign()
+
+#include "decode.h"
+#include "exec.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+//! Sorte de micro-opération pour chaque code opération et mode d'adressage.
+/*!
+ * Les combinaisons absentes valent \c UOP_FAULT : ce sont les valeurs
+ * immédiates interdites (et l'instruction illégale \c ILLOP).
+ */
+static const uint8_t cop_kinds[][MODE_INDEXED + 1] = {
+	[ILLOP]  = { [MODE_NONE] = UOP_FAULT },
+	[NOP]    = { [MODE_NONE] = UOP_NOP },
+	[HALT]   = { [MODE_NONE] = UOP_HALT },
+	[RET]    = { [MODE_NONE] = UOP_RET },
+	[LOAD]   = { [MODE_IMMEDIATE] = UOP_LOAD_IMM, [MODE_ABSOLUTE] = UOP_LOAD_ABS, [MODE_INDEXED] = UOP_LOAD_IDX },
+	[STORE]  = { [MODE_ABSOLUTE] = UOP_STORE_ABS, [MODE_INDEXED] = UOP_STORE_IDX },
+	[ADD]    = { [MODE_IMMEDIATE] = UOP_ADD_IMM, [MODE_ABSOLUTE] = UOP_ADD_ABS, [MODE_INDEXED] = UOP_ADD_IDX },
+	[SUB]    = { [MODE_IMMEDIATE] = UOP_SUB_IMM, [MODE_ABSOLUTE] = UOP_SUB_ABS, [MODE_INDEXED] = UOP_SUB_IDX },
+	[BRANCH] = { [MODE_ABSOLUTE] = UOP_BRANCH_ABS, [MODE_INDEXED] = UOP_BRANCH_IDX },
+	[CALL]   = { [MODE_ABSOLUTE] = UOP_CALL_ABS, [MODE_INDEXED] = UOP_CALL_IDX },
+	[PUSH]   = { [MODE_IMMEDIATE] = UOP_PUSH_IMM, [MODE_ABSOLUTE] = UOP_PUSH_ABS, [MODE_INDEXED] = UOP_PUSH_IDX },
+	[POP]    = { [MODE_ABSOLUTE] = UOP_POP_ABS, [MODE_INDEXED] = UOP_POP_IDX },
+};
+
+//! Sorte de la première instruction de chaque sorte de micro-opération
+const uint8_t uop_base_kinds[UOP_NKINDS] = {
+#define X(kind, name, op, mode, base) [kind] = base,
+	UOP_KINDS(X)
+#undef X
+};
+
+//! Effet de chaque sorte de micro-opération sur le code condition
+const uint8_t uop_cc_effects[UOP_NKINDS] = {
+	[UOP_LOAD_IMM] = UOP_CC_WRITE, [UOP_LOAD_ABS] = UOP_CC_WRITE, [UOP_LOAD_IDX] = UOP_CC_WRITE,
+	[UOP_ADD_IMM] = UOP_CC_WRITE, [UOP_ADD_ABS] = UOP_CC_WRITE, [UOP_ADD_IDX] = UOP_CC_WRITE,
+	[UOP_SUB_IMM] = UOP_CC_WRITE, [UOP_SUB_ABS] = UOP_CC_WRITE, [UOP_SUB_IDX] = UOP_CC_WRITE,
+	[UOP_LOAD_IMM_NOCC] = UOP_CC_DEAD, [UOP_LOAD_ABS_NOCC] = UOP_CC_DEAD, [UOP_LOAD_IDX_NOCC] = UOP_CC_DEAD,
+	[UOP_ADD_IMM_NOCC] = UOP_CC_DEAD, [UOP_ADD_ABS_NOCC] = UOP_CC_DEAD, [UOP_ADD_IDX_NOCC] = UOP_CC_DEAD,
+	[UOP_SUB_IMM_NOCC] = UOP_CC_DEAD, [UOP_SUB_ABS_NOCC] = UOP_CC_DEAD, [UOP_SUB_IDX_NOCC] = UOP_CC_DEAD,
+	[UOP_LOAD_ADD_STORE_IMM] = UOP_CC_WRITE, [UOP_LOAD_ADD_STORE_ABS] = UOP_CC_WRITE,
+	[UOP_LOAD_SUB_STORE_IMM] = UOP_CC_WRITE, [UOP_LOAD_SUB_STORE_ABS] = UOP_CC_WRITE,
+	[UOP_ADD_BRANCH_IMM] = UOP_CC_WRITE, [UOP_ADD_BRANCH_ABS] = UOP_CC_WRITE,
+	[UOP_SUB_BRANCH_IMM] = UOP_CC_WRITE, [UOP_SUB_BRANCH_ABS] = UOP_CC_WRITE,
+};
+
+//! Sorte \c _NOCC de chaque sorte qui met à jour le code condition.
+/*!
+ * Les autres sortes valent \c UOP_FAULT : elles n'ont pas de variante.
+ */
+static const uint8_t nocc_kinds[UOP_NKINDS] = {
+	[UOP_LOAD_IMM] = UOP_LOAD_IMM_NOCC, [UOP_LOAD_ABS] = UOP_LOAD_ABS_NOCC, [UOP_LOAD_IDX] = UOP_LOAD_IDX_NOCC,
+	[UOP_ADD_IMM] = UOP_ADD_IMM_NOCC, [UOP_ADD_ABS] = UOP_ADD_ABS_NOCC, [UOP_ADD_IDX] = UOP_ADD_IDX_NOCC,
+	[UOP_SUB_IMM] = UOP_SUB_IMM_NOCC, [UOP_SUB_ABS] = UOP_SUB_ABS_NOCC, [UOP_SUB_IDX] = UOP_SUB_IDX_NOCC,
+};
+
+//! L'instruction d'une micro-opération observe-t-elle le code condition ?
+/*!
+ * \param uop la micro-opération
+ * \return vrai si l'exécution dépend du code condition ou l'affiche
+ */
+bool uop_reads_cc(const Micro_Op *uop)
+{
+	switch (uop_base_kinds[uop->_kind]) {
+	case UOP_HALT:
+	//Erreurs, à coup sûr ou selon le pointeur de pile :
+	case UOP_FAULT:
+	case UOP_CALL_BADCOND:
+	case UOP_PUSH_BADADDR:
+	case UOP_RET:
+	case UOP_CALL_ABS:
+	case UOP_CALL_IDX:
+	case UOP_PUSH_IMM:
+	case UOP_PUSH_ABS:
+	case UOP_PUSH_IDX:
+	case UOP_POP_ABS:
+	case UOP_POP_IDX:
+		return true;
+	case UOP_BRANCH_ABS:
+	case UOP_BRANCH_IDX:
+		return uop->_reg != NC;
+	default:
+		//Erreur si l'adresse indexée sort du segment de données :
+		return uop->_mode == MODE_INDEXED;
+	}
+}
+
+//! Fixe la sorte (et donc la routine d'exécution) d'une micro-opération.
+/*!
+ * \param uop micro-opération à modifier
+ * \param kind sa sorte
+ */
+static void set_kind(Micro_Op *uop, Uop_Kind kind)
+{
+	uop->_kind = kind;
+	uop->_handler = uop_handlers[kind];
+}
+
+//! Transforme une micro-opération en signalement d'erreur.
+/*!
+ * \param uop micro-opération à modifier
+ * \param err erreur à signaler lors de l'exécution
+ */
+static void make_fault(Micro_Op *uop, Error err)
+{
+	set_kind(uop, UOP_FAULT);
+	uop->_mode = MODE_NONE;
+	uop->_operand = err;
+}
+
+//! Prédécodage d'une instruction.
+/*!
+ * Les erreurs sont détectées dans le même ordre que dans decode_execute() :
+ * code opération, puis valeur immédiate interdite, puis condition.
+ *
+ * \param uop micro-opération à remplir
+ * \param instr l'instruction à traduire
+ */
+static void decode_one(Micro_Op *uop, Instruction instr)
+{
+	Code_Op cop = instr.instr_generic._cop;
+
+	uop->_reg = instr.instr_generic._regcond;
+	uop->_rindex = 0;
+	uop->_operand = 0;
+
+	if (cop > LAST_COP) {
+		make_fault(uop, ERR_UNKNOWN);
+		return;
+	}
+
+	//Extraction de l'opérande :
+	if (cop == NOP || cop == RET || cop == HALT || cop == ILLOP) {
+		uop->_mode = MODE_NONE;
+	} else if (instr.instr_generic._immediate) {
+		uop->_mode = MODE_IMMEDIATE;
+		uop->_operand = instr.instr_immediate._value;
+	} else if (instr.instr_generic._indexed) {
+		uop->_mode = MODE_INDEXED;
+		uop->_rindex = instr.instr_indexed._rindex;
+		uop->_operand = instr.instr_indexed._offset;
+	} else {
+		uop->_mode = MODE_ABSOLUTE;
+		uop->_operand = instr.instr_absolute._address;
+	}
+
+	//Choix de la routine spécialisée :
+	Uop_Kind kind = cop_kinds[cop][uop->_mode];
+	if (kind == UOP_FAULT) {
+		make_fault(uop, cop == ILLOP ? ERR_ILLEGAL : ERR_IMMEDIATE);
+		return;
+	}
+	set_kind(uop, kind);
+
+	if ((cop == BRANCH || cop == CALL) && uop->_reg > LAST_CONDITION) {
+		if (cop == BRANCH)
+			make_fault(uop, ERR_CONDITION);
+		else
+			set_kind(uop, UOP_CALL_BADCOND);
+	}
+}
+
+//! Vérification au chargement des adresses absolues d'une micro-opération.
+/*!
+ * Une adresse de données acceptée ici passe toujours check_data_addr(). Une
+ * adresse refusée fait de la micro-opération une erreur \c ERR_SEGDATA,
+ * signalée dans le même ordre que par decode_execute() : après la vérification
+ * de la pile pour PUSH, avant pour POP.
+ *
+ * \param uop micro-opération à vérifier
+ * \param addr adresse de l'instruction
+ * \param textsize taille utile du segment de texte
+ * \param datasize taille utile du segment de données
+ */
+static void check_bounds(Micro_Op *uop, unsigned addr, unsigned textsize, unsigned datasize)
+{
+	if (uop->_mode != MODE_ABSOLUTE || uop->_kind == UOP_FAULT || uop->_kind == UOP_CALL_BADCOND)
+		return;
+
+	if (uop->_kind == UOP_BRANCH_ABS || uop->_kind == UOP_CALL_ABS) {
+		if ((unsigned) uop->_operand >= textsize)
+			warning(WARN_SEGTEXT, addr);
+		return;
+	}
+
+	if ((unsigned) uop->_operand <= datasize)
+		return;
+	warning(WARN_SEGDATA, addr);
+	if (uop->_kind == UOP_PUSH_ABS)
+		set_kind(uop, UOP_PUSH_BADADDR);
+	else
+		make_fault(uop, ERR_SEGDATA);
+}
+
+//! Superinstruction commençant par une micro-opération, s'il y en a une.
+/*!
+ * Les séquences reconnues sont celles décrites dans \c UOP_KINDS. Seules les
+ * branches et appels à une adresse absolue sont fusionnés : la dernière
+ * instruction de la séquence est alors toujours une micro-opération valide.
+ *
+ * \param uop première micro-opération de la séquence
+ * \param left nombre de micro-opérations à partir de \c uop
+ * \return la sorte de la superinstruction, ou \c UOP_NKINDS si aucune
+ */
+static Uop_Kind fused_kind(const Micro_Op *uop, unsigned left)
+{
+	if (left >= 3 && uop[0]._kind == UOP_LOAD_ABS && uop[2]._kind == UOP_STORE_ABS
+	    && uop[1]._reg == uop[0]._reg && uop[2]._reg == uop[0]._reg
+	    && uop[2]._operand == uop[0]._operand) {
+		switch (uop[1]._kind) {
+		case UOP_ADD_IMM: return UOP_LOAD_ADD_STORE_IMM;
+		case UOP_ADD_ABS: return UOP_LOAD_ADD_STORE_ABS;
+		case UOP_SUB_IMM: return UOP_LOAD_SUB_STORE_IMM;
+		case UOP_SUB_ABS: return UOP_LOAD_SUB_STORE_ABS;
+		default: break;
+		}
+	}
+
+	if (left >= 2 && uop[1]._kind == UOP_BRANCH_ABS) {
+		switch (uop[0]._kind) {
+		case UOP_ADD_IMM: return UOP_ADD_BRANCH_IMM;
+		case UOP_ADD_ABS: return UOP_ADD_BRANCH_ABS;
+		case UOP_SUB_IMM: return UOP_SUB_BRANCH_IMM;
+		case UOP_SUB_ABS: return UOP_SUB_BRANCH_ABS;
+		default: break;
+		}
+	}
+
+	if (left >= 2 && uop[1]._kind == UOP_CALL_ABS) {
+		switch (uop[0]._kind) {
+		case UOP_PUSH_IMM: return UOP_PUSH_CALL_IMM;
+		case UOP_PUSH_ABS: return UOP_PUSH_CALL_ABS;
+		case UOP_PUSH_IDX: return UOP_PUSH_CALL_IDX;
+		default: break;
+		}
+	}
+
+	return UOP_NKINDS;
+}
+
+//! Analyse de vivacité du code condition
+/*!
+ * Le code condition est vivant avant une instruction s'il peut être observé
+ * (voir uop_reads_cc()) avant d'être écrasé. L'analyse remonte le flot de
+ * contrôle jusqu'à un point fixe ; les successeurs inconnus (RET, branchements
+ * et appels indexés) sont supposés observer le code condition, de même que
+ * les sorties du segment de texte, qui sont des erreurs.
+ *
+ * \param textsize taille utile du segment de texte
+ * \param uops les micro-opérations, avant fusion
+ * \param live_out vivacité du code condition après chaque instruction
+ */
+static void cc_liveness(unsigned textsize, const Micro_Op uops[textsize], bool live_out[textsize])
+{
+	bool *live_in = calloc(textsize ? textsize : 1, sizeof(bool));
+	if (live_in == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <decode.c:cc_liveness>\n");
+		exit(1);
+	}
+
+	//Vivacité à l'entrée d'une instruction, vraie hors du segment :
+#	define LIVE_IN(addr) ((unsigned) (addr) >= textsize || live_in[addr])
+
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (unsigned i = textsize; i-- > 0; ) {
+			const Micro_Op *uop = &uops[i];
+			bool out;
+
+			switch (uop->_kind) {
+			case UOP_HALT:
+			case UOP_FAULT:
+			case UOP_CALL_BADCOND:
+			case UOP_PUSH_BADADDR:
+				out = false;
+				break;
+			case UOP_RET:
+			case UOP_BRANCH_IDX:
+			case UOP_CALL_IDX:
+				out = true;
+				break;
+			case UOP_BRANCH_ABS:
+			case UOP_CALL_ABS:
+				out = LIVE_IN(uop->_operand) || (uop->_reg != NC && LIVE_IN(i + 1));
+				break;
+			default:
+				out = LIVE_IN(i + 1);
+				break;
+			}
+
+			bool in = uop_reads_cc(uop) || (out && uop_cc_effects[uop->_kind] != UOP_CC_WRITE);
+			live_out[i] = out;
+			if (in != live_in[i]) {
+				live_in[i] = in;
+				changed = true;
+			}
+		}
+	}
+
+#	undef LIVE_IN
+	free(live_in);
+}
+
+//! Prédécodage et vérification du segment de texte
+/*!
+ * \param textsize taille utile du segment de texte
+ * \param text le contenu du segment de texte
+ * \param datasize taille utile du segment de données
+ * \return le tableau des micro-opérations (aligné sur \c UOP_ALIGNMENT)
+ */
+Micro_Op *predecode(unsigned textsize, const Instruction text[textsize], unsigned datasize)
+{
+	Micro_Op *uops;
+	//Au moins une micro-opération, pour ne pas dépendre de malloc(0) :
+	size_t size = (textsize ? textsize : 1) * sizeof(Micro_Op);
+
+	if (posix_memalign((void **) &uops, UOP_ALIGNMENT, size) != 0) {
+		fprintf(stderr, "Erreur d'allocation des micro-opérations dans <decode.c:predecode>\n");
+		exit(1);
+	}
+
+	for (unsigned i = 0; i < textsize; i++) {
+		decode_one(&uops[i], text[i]);
+		check_bounds(&uops[i], i, textsize, datasize);
+	}
+
+	//Vivacité du code condition, calculée sur les instructions d'origine :
+	bool *live_out = malloc((textsize ? textsize : 1) * sizeof(bool));
+	if (live_out == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <decode.c:predecode>\n");
+		exit(1);
+	}
+	cc_liveness(textsize, uops, live_out);
+
+	//Fusion des séquences fréquentes. Les micro-opérations suivantes restent
+	//intactes : on peut encore brancher au milieu d'une séquence.
+	for (unsigned i = 0; i < textsize; i++) {
+		Uop_Kind kind = fused_kind(&uops[i], textsize - i);
+		if (kind != UOP_NKINDS)
+			set_kind(&uops[i], kind);
+	}
+
+	//Les instructions non fusionnées dont le code condition est mort ne le
+	//calculent pas :
+	for (unsigned i = 0; i < textsize; i++)
+		if (uop_cc_effects[uops[i]._kind] == UOP_CC_WRITE && !live_out[i]
+		    && nocc_kinds[uops[i]._kind] != UOP_FAULT)
+			set_kind(&uops[i], nocc_kinds[uops[i]._kind]);
+	free(live_out);
+
+	return uops;
+}
+
+//! Libération d'un tableau de micro-opérations
+/*!
+ * \param uops le tableau retourné par predecode()
+ */
+void free_predecoded(Micro_Op *uops)
+{
+	free(uops);
+}
@@ -0,0 +1,210 @@
+#ifndef _DECODE_H_
+#define _DECODE_H_
+
+/*!
+ * \file decode.h
+ * \brief Prédécodage du segment de texte en micro-opérations.
+ */
+
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Mode d'adressage d'une micro-opération
+typedef enum
+{
+    MODE_NONE = 0,	//!< Pas d'opérande (NOP, RET, HALT...)
+    MODE_IMMEDIATE,	//!< Valeur immédiate
+    MODE_ABSOLUTE,	//!< Adresse absolue
+    MODE_INDEXED,	//!< Adressage indexé : registre + déplacement
+} Addressing_Mode;
+
+//! Liste des sortes de micro-opérations
+/*!
+ * Il y a une sorte par combinaison légale (code opération, mode d'adressage),
+ * plus les sortes qui signalent une erreur et les superinstructions. Chaque
+ * entrée donne <tt>X(sorte, nom, opération, mode, base)</tt> : la routine
+ * d'exécution correspondante s'appelle \c uop_<nom> et applique
+ * \c exec_<opération> (voir exec_inline.h) avec le mode d'adressage fixé ;
+ * \c base est la sorte de la première instruction seule (la sorte elle-même,
+ * sauf pour les superinstructions).
+ *
+ * Une superinstruction remplace la première micro-opération d'une séquence
+ * d'instructions fréquente et exécute toute la séquence en un seul dispatch.
+ * Son \c mode est celui de l'opérande \c x :
+ *
+ *   - <tt>LOAD r, \@a ; ADD|SUB r, x ; STORE r, \@a</tt> ;
+ *   - <tt>ADD|SUB r, x ; BRANCH cond, \@t</tt> ;
+ *   - <tt>PUSH x ; CALL cond, \@t</tt>.
+ *
+ * Les sortes \c _NOCC sont les LOAD, ADD et SUB dont le code condition n'est
+ * jamais observé (voir \c UOP_CC_DEAD) : elles ne le mettent pas à jour.
+ *
+ * Seules la routine et la sorte de la première micro-opération changent :
+ * ses champs, comme les micro-opérations suivantes, restent ceux des
+ * instructions d'origine, si bien qu'un branchement au milieu de la séquence
+ * exécute les instructions une à une.
+ *
+ * Cette liste est la seule à maintenir : les énumérations, tables de routines
+ * et tables de dispatch en sont toutes déduites, elles sont donc complètes
+ * par construction.
+ */
+#define UOP_KINDS(X)								\
+    X(UOP_FAULT,	fault,		fault,		MODE_NONE,	UOP_FAULT)	\
+    X(UOP_NOP,		nop,		nop,		MODE_NONE,	UOP_NOP)	\
+    X(UOP_HALT,		halt,		halt,		MODE_NONE,	UOP_HALT)	\
+    X(UOP_RET,		ret,		ret,		MODE_NONE,	UOP_RET)	\
+    X(UOP_LOAD_IMM,	load_imm,	load,		MODE_IMMEDIATE,	UOP_LOAD_IMM)	\
+    X(UOP_LOAD_ABS,	load_abs,	load,		MODE_ABSOLUTE,	UOP_LOAD_ABS)	\
+    X(UOP_LOAD_IDX,	load_idx,	load,		MODE_INDEXED,	UOP_LOAD_IDX)	\
+    X(UOP_STORE_ABS,	store_abs,	store,		MODE_ABSOLUTE,	UOP_STORE_ABS)	\
+    X(UOP_STORE_IDX,	store_idx,	store,		MODE_INDEXED,	UOP_STORE_IDX)	\
+    X(UOP_ADD_IMM,	add_imm,	add,		MODE_IMMEDIATE,	UOP_ADD_IMM)	\
+    X(UOP_ADD_ABS,	add_abs,	add,		MODE_ABSOLUTE,	UOP_ADD_ABS)	\
+    X(UOP_ADD_IDX,	add_idx,	add,		MODE_INDEXED,	UOP_ADD_IDX)	\
+    X(UOP_SUB_IMM,	sub_imm,	sub,		MODE_IMMEDIATE,	UOP_SUB_IMM)	\
+    X(UOP_SUB_ABS,	sub_abs,	sub,		MODE_ABSOLUTE,	UOP_SUB_ABS)	\
+    X(UOP_SUB_IDX,	sub_idx,	sub,		MODE_INDEXED,	UOP_SUB_IDX)	\
+    X(UOP_BRANCH_ABS,	branch_abs,	branch,		MODE_ABSOLUTE,	UOP_BRANCH_ABS)	\
+    X(UOP_BRANCH_IDX,	branch_idx,	branch,		MODE_INDEXED,	UOP_BRANCH_IDX)	\
+    X(UOP_CALL_ABS,	call_abs,	call,		MODE_ABSOLUTE,	UOP_CALL_ABS)	\
+    X(UOP_CALL_IDX,	call_idx,	call,		MODE_INDEXED,	UOP_CALL_IDX)	\
+    X(UOP_CALL_BADCOND,	call_badcond,	call_badcond,	MODE_NONE,	UOP_CALL_BADCOND) \
+    X(UOP_PUSH_BADADDR,	push_badaddr,	push_badaddr,	MODE_NONE,	UOP_PUSH_BADADDR) \
+    X(UOP_PUSH_IMM,	push_imm,	push,		MODE_IMMEDIATE,	UOP_PUSH_IMM)	\
+    X(UOP_PUSH_ABS,	push_abs,	push,		MODE_ABSOLUTE,	UOP_PUSH_ABS)	\
+    X(UOP_PUSH_IDX,	push_idx,	push,		MODE_INDEXED,	UOP_PUSH_IDX)	\
+    X(UOP_POP_ABS,	pop_abs,	pop,		MODE_ABSOLUTE,	UOP_POP_ABS)	\
+    X(UOP_POP_IDX,	pop_idx,	pop,		MODE_INDEXED,	UOP_POP_IDX)	\
+    X(UOP_LOAD_IMM_NOCC, load_imm_nocc,	load_nocc,	MODE_IMMEDIATE,	UOP_LOAD_IMM_NOCC) \
+    X(UOP_LOAD_ABS_NOCC, load_abs_nocc,	load_nocc,	MODE_ABSOLUTE,	UOP_LOAD_ABS_NOCC) \
+    X(UOP_LOAD_IDX_NOCC, load_idx_nocc,	load_nocc,	MODE_INDEXED,	UOP_LOAD_IDX_NOCC) \
+    X(UOP_ADD_IMM_NOCC, add_imm_nocc,	add_nocc,	MODE_IMMEDIATE,	UOP_ADD_IMM_NOCC) \
+    X(UOP_ADD_ABS_NOCC, add_abs_nocc,	add_nocc,	MODE_ABSOLUTE,	UOP_ADD_ABS_NOCC) \
+    X(UOP_ADD_IDX_NOCC, add_idx_nocc,	add_nocc,	MODE_INDEXED,	UOP_ADD_IDX_NOCC) \
+    X(UOP_SUB_IMM_NOCC, sub_imm_nocc,	sub_nocc,	MODE_IMMEDIATE,	UOP_SUB_IMM_NOCC) \
+    X(UOP_SUB_ABS_NOCC, sub_abs_nocc,	sub_nocc,	MODE_ABSOLUTE,	UOP_SUB_ABS_NOCC) \
+    X(UOP_SUB_IDX_NOCC, sub_idx_nocc,	sub_nocc,	MODE_INDEXED,	UOP_SUB_IDX_NOCC) \
+    X(UOP_LOAD_ADD_STORE_IMM, load_add_store_imm, load_add_store, MODE_IMMEDIATE, UOP_LOAD_ABS) \
+    X(UOP_LOAD_ADD_STORE_ABS, load_add_store_abs, load_add_store, MODE_ABSOLUTE, UOP_LOAD_ABS) \
+    X(UOP_LOAD_SUB_STORE_IMM, load_sub_store_imm, load_sub_store, MODE_IMMEDIATE, UOP_LOAD_ABS) \
+    X(UOP_LOAD_SUB_STORE_ABS, load_sub_store_abs, load_sub_store, MODE_ABSOLUTE, UOP_LOAD_ABS) \
+    X(UOP_ADD_BRANCH_IMM, add_branch_imm,	add_branch,	MODE_IMMEDIATE,	UOP_ADD_IMM)	\
+    X(UOP_ADD_BRANCH_ABS, add_branch_abs,	add_branch,	MODE_ABSOLUTE,	UOP_ADD_ABS)	\
+    X(UOP_SUB_BRANCH_IMM, sub_branch_imm,	sub_branch,	MODE_IMMEDIATE,	UOP_SUB_IMM)	\
+    X(UOP_SUB_BRANCH_ABS, sub_branch_abs,	sub_branch,	MODE_ABSOLUTE,	UOP_SUB_ABS)	\
+    X(UOP_PUSH_CALL_IMM, push_call_imm,	push_call,	MODE_IMMEDIATE,	UOP_PUSH_IMM)	\
+    X(UOP_PUSH_CALL_ABS, push_call_abs,	push_call,	MODE_ABSOLUTE,	UOP_PUSH_ABS)	\
+    X(UOP_PUSH_CALL_IDX, push_call_idx,	push_call,	MODE_INDEXED,	UOP_PUSH_IDX)
+
+//! Sorte d'une micro-opération (voir \c UOP_KINDS)
+typedef enum
+{
+#   define X(kind, name, op, mode, base) kind,
+    UOP_KINDS(X)
+#   undef X
+    UOP_NKINDS		//!< Nombre de sortes de micro-opérations
+} Uop_Kind;
+
+struct Micro_Op;
+
+//! Routine d'exécution d'une micro-opération
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param uop la micro-opération à exécuter
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+typedef bool (*Handler)(Machine *pmach, const struct Micro_Op *uop);
+
+//! Micro-opération
+/*!
+ * Forme prédécodée d'une instruction : tous les champs de bits de
+ * \link Instruction \endlink sont extraits une fois pour toutes au chargement
+ * du programme, la valeur immédiate et le déplacement sont étendus en signe et
+ * la routine d'exécution, spécialisée pour le code opération et le mode
+ * d'adressage, est résolue. La boucle de simulation n'a plus qu'à appeler
+ * \c _handler, qui ne teste plus le mode d'adressage.
+ *
+ * Une micro-opération occupe 16 octets et le tableau est aligné sur une ligne
+ * de cache : une ligne contient exactement 4 micro-opérations.
+ */
+typedef struct Micro_Op
+{
+    Handler _handler;		//!< Routine d'exécution pré-résolue
+    int32_t _operand;		//!< Valeur immédiate, adresse absolue, déplacement ou code d'erreur
+    uint8_t _reg;		//!< Numéro de registre ou condition
+    uint8_t _rindex;		//!< Numéro du registre d'index
+    uint8_t _mode;		//!< Mode d'adressage (\link Addressing_Mode \endlink)
+    uint8_t _kind;		//!< Sorte de micro-opération (\link Uop_Kind \endlink)
+} Micro_Op;
+
+//! Sorte de la première instruction de chaque sorte de micro-opération
+/*!
+ * C'est la colonne \c base de \c UOP_KINDS : elle permet de traiter une
+ * superinstruction comme sa seule première instruction.
+ */
+extern const uint8_t uop_base_kinds[UOP_NKINDS];
+
+//! Effet d'une micro-opération sur le code condition
+typedef enum
+{
+    UOP_CC_KEEP = 0,	//!< Le code condition n'est pas modifié
+    UOP_CC_WRITE,	//!< Le code condition est mis à jour
+    UOP_CC_DEAD,	//!< Le code condition devrait être mis à jour, mais ne sera
+			//!< lu par aucune instruction avant d'être écrasé : il ne
+			//!< l'est pas (sortes \c _NOCC)
+} Uop_Cc_Effect;
+
+//! Effet de chaque sorte de micro-opération sur le code condition
+extern const uint8_t uop_cc_effects[UOP_NKINDS];
+
+//! L'instruction d'une micro-opération observe-t-elle le code condition ?
+/*!
+ * Le code condition est observé par les BRANCH et CALL conditionnels, et par
+ * \c HALT, après lequel l'état final de la machine est affiché. Il l'est aussi
+ * par toute instruction qui peut s'arrêter sur une erreur : l'erreur rend la
+ * machine dans son état courant (voir simul_run()). Ce sont les instructions
+ * invalides, celles qui utilisent la pile et les accès indexés.
+ *
+ * \param uop la micro-opération (une superinstruction est considérée comme sa
+ * première instruction)
+ * \return vrai si l'exécution dépend du code condition ou l'affiche
+ */
+bool uop_reads_cc(const Micro_Op *uop);
+
+//! Alignement du tableau de micro-opérations (taille d'une ligne de cache)
+#define UOP_ALIGNMENT 64
+
+//! Prédécodage et vérification du segment de texte
+/*!
+ * Chaque instruction est traduite en une micro-opération. Les instructions
+ * mal formées (code opération inconnu, valeur immédiate interdite, condition
+ * illégale) ne provoquent pas d'erreur au chargement : elles sont traduites en
+ * une micro-opération qui signale l'erreur lorsqu'elle est exécutée, comme le
+ * fait \c decode_execute().
+ *
+ * Les adresses absolues sont vérifiées au chargement : une adresse de données
+ * hors de \c datasize, ou une cible de BRANCH ou CALL hors de \c textsize, est
+ * signalée aussitôt par un avertissement. Un accès hors segment est traduit en
+ * une micro-opération d'erreur ; les micro-opérations en adressage absolu ne
+ * vérifient donc plus leur adresse à l'exécution, seuls les accès indexés et
+ * la pile le font encore.
+ *
+ * Les séquences fréquentes sont ensuite fusionnées en superinstructions, et
+ * une analyse de vivacité du code condition remplace les autres LOAD, ADD et
+ * SUB dont le code condition n'est jamais observé par leur sorte \c _NOCC.
+ *
+ * \param textsize taille utile du segment de texte
+ * \param text le contenu du segment de texte
+ * \param datasize taille utile du segment de données
+ * \return le tableau des micro-opérations (aligné sur \c UOP_ALIGNMENT)
+ */
+Micro_Op *predecode(unsigned textsize, const Instruction text[textsize], unsigned datasize);
+
+//! Libération d'un tableau de micro-opérations
+/*!
+ * \param uops le tableau retourné par predecode()
+ */
+void free_predecoded(Micro_Op *uops);
+
+#endif
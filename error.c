@@ -8,54 +8,103 @@
 #include <stdlib.h>
 #include <math.h>
 
-//! Affichage d'une erreur et fin du simulateur
+//! Point de reprise courant du thread
+static __thread Fault_Handler *handlers = NULL;
+
+//! Affichage des avertissements
+static bool warnings = true;
+
+//! Mise en place d'un point de reprise
+/*!
+ * \param handler le point de reprise
+ */
+void fault_push(Fault_Handler *handler)
+{
+	handler->_prev = handlers;
+	handlers = handler;
+}
+
+//! Retrait du point de reprise le plus récent, sans erreur
+/*!
+ * \param handler le point de reprise
+ */
+void fault_pop(Fault_Handler *handler)
+{
+	handlers = handler->_prev;
+}
+
+//! Transmission d'une erreur au point de reprise courant
+/*!
+ * \param fault l'erreur
+ */
+void fault_raise(Fault fault)
+{
+	error(fault._error, fault._addr);
+	exit(1);	// ERR_NOERROR
+}
+
+//! Affichage d'une erreur
 /*!
- * \note Toutes les erreurs étant fatales on ne revient jamais de cette
- * fonction. L'attribut \a noreturn est une extension (non standard) de GNU C
- * qui indique ce fait.
- * 
  * \param err code de l'erreur
  * \param addr adresse de l'erreur
  */
-void error(Error err, unsigned addr){
+void print_error(Error err, unsigned addr){
 		printf("ERROR: ");
 		switch (err) {
 		case ERR_NOERROR:
 			printf("No error");
-			printf("\tat 0x%08x\n",addr);
 			break;
 		case ERR_UNKNOWN:
 			printf("Unknown instruction");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		case ERR_ILLEGAL:
 			printf("Illegal instruction");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		case ERR_CONDITION:
 			printf("Illegal condition");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		case ERR_IMMEDIATE:
 			printf("Immediate value forbidden");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		case ERR_SEGTEXT:
 			printf("Text index out of bounds");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		case ERR_SEGDATA:
 			printf("Data index out of bounds");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		case ERR_SEGSTACK:
 			printf("Stack index out of bounds");
-			printf("\tat 0x%08x\n",addr);
-			exit(1);
+			break;
 		default:
-			exit(0);
+			return;
+		}
+		printf("\tat 0x%08x\n",addr);
+}
+
+//! Erreur d'exécution : retour au point de reprise ou fin du simulateur
+/*!
+ * \note Toutes les erreurs étant fatales on ne revient jamais de cette
+ * fonction. L'attribut \a noreturn est une extension (non standard) de GNU C
+ * qui indique ce fait.
+ * 
+ * \param err code de l'erreur
+ * \param addr adresse de l'erreur
+ */
+void error(Error err, unsigned addr){
+		Fault_Handler *handler = handlers;
+
+		if (err == ERR_NOERROR)
+			//Pas une erreur : on continue.
+			print_error(err, addr);
+		else if (handler != NULL) {
+			handlers = handler->_prev;
+			handler->_fault._error = err;
+			handler->_fault._addr = addr;
+			longjmp(handler->_env, 1);
+		} else {
+			print_error(err, addr);
+			exit(err <= LAST_ERROR ? 1 : 0);
 		}
-		
 }
 
 //! Affichage d'un avertissement
@@ -64,6 +113,27 @@ void error(Error err, unsigned addr){
  * \param addr adresse de l'erreur
  */
 void warning(Warning warn, unsigned addr){
-	printf("WARNING: Program correctly ended by HALT\tat 0x%08x\n",addr);
+	if (!warnings)
+		return;
+	switch (warn) {
+	case WARN_HALT:
+		printf("WARNING: Program correctly ended by HALT\tat 0x%08x\n",addr);
+		break;
+	case WARN_SEGTEXT:
+		printf("WARNING: Branch target out of text segment\tat 0x%08x\n",addr);
+		break;
+	case WARN_SEGDATA:
+		printf("WARNING: Data address out of data segment\tat 0x%08x\n",addr);
+		break;
+	}
 }
 
+
+//! Affichage ou non des avertissements
+/*!
+ * \param enable vrai pour afficher les avertissements
+ */
+void warnings_enable(bool enable)
+{
+	warnings = enable;
+}
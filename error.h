@@ -2,6 +2,8 @@
 #define _ERROR_H_
 
 #include <stdlib.h>
+#include <stdbool.h>
+#include <setjmp.h>
 
 /*!
  * \file error.h
@@ -11,9 +13,9 @@
 //! Erreur d'exécution
 /*!
  * Ce sont les différentes sortes d'erreur rencontrées lors du décodage ou de
- * l'exécution des instructions. Elles sont toutes fatales et provoquent la
- * terminaison du programme (du programme simulé comme du simulateur lui-même
- * !).
+ * l'exécution des instructions. Elles arrêtent le programme simulé ; elles ne
+ * terminent le simulateur lui-même que si elles ne sont pas interceptées
+ * (voir \link Fault_Handler \endlink).
  */
 typedef enum 
 {
@@ -38,13 +40,86 @@ static const unsigned LAST_ERROR = ERR_SEGSTACK;
 typedef enum 
 {
     WARN_HALT,		//!< Fin normale du programme (sur HALT)
+    WARN_SEGTEXT,	//!< Branchement hors du segment de texte, détecté au chargement
+    WARN_SEGDATA,	//!< Accès hors du segment de données, détecté au chargement
 } Warning;
 
 //! Dernière valeur possible du code d'avertissement
-static const unsigned LAST_WARNING = WARN_HALT;
+static const unsigned LAST_WARNING = WARN_SEGDATA;
 
-//! Affichage d'une erreur et fin du simulateur
+//! Erreur interceptée
+typedef struct
+{
+    Error _error;		//!< Code de l'erreur (\c ERR_NOERROR : fin sur HALT)
+    unsigned _addr;		//!< Adresse de l'instruction fautive (ou de HALT)
+} Fault;
+
+//! Point de reprise des erreurs d'exécution
+/*!
+ * Les points de reprise forment une pile, propre à chaque thread. Tant qu'un
+ * point de reprise est en place, error() ne termine pas le simulateur : elle
+ * retire le point de reprise, y enregistre l'erreur et y revient par
+ * longjmp(). L'utilisation est la suivante :
+ *
+ * \code
+ * Fault_Handler handler;
+ * fault_push(&handler);
+ * if (setjmp(handler._env)) {
+ *     // Erreur handler._fault ; le point de reprise est déjà retiré.
+ * } else {
+ *     // Exécution...
+ *     fault_pop(&handler);
+ * }
+ * \endcode
+ *
+ * Une fonction qui doit libérer des ressources en cas d'erreur pose son propre
+ * point de reprise, libère ses ressources puis transmet l'erreur au point de
+ * reprise englobant par fault_raise().
+ */
+typedef struct Fault_Handler
+{
+    jmp_buf _env;		//!< Contexte de reprise, pour setjmp()
+    Fault _fault;		//!< Erreur interceptée
+    struct Fault_Handler *_prev;//!< Point de reprise englobant
+} Fault_Handler;
+
+//! Mise en place d'un point de reprise
+/*!
+ * \param handler le point de reprise
+ */
+void fault_push(Fault_Handler *handler);
+
+//! Retrait du point de reprise le plus récent, sans erreur
+/*!
+ * \param handler le point de reprise, qui doit être le plus récent
+ */
+void fault_pop(Fault_Handler *handler);
+
+//! Transmission d'une erreur au point de reprise courant
+/*!
+ * Équivalent à error(fault._error, fault._addr).
+ *
+ * \param fault l'erreur
+ */
+#ifdef __GNUC__
+void fault_raise(Fault fault) __attribute__((noreturn));
+#else
+void fault_raise(Fault fault);
+#endif
+
+//! Affichage d'une erreur
 /*!
+ * \param err code de l'erreur
+ * \param addr adresse de l'erreur
+ */
+void print_error(Error err, unsigned addr);
+
+//! Erreur d'exécution : retour au point de reprise ou fin du simulateur
+/*!
+ * S'il y a un point de reprise (voir \link Fault_Handler \endlink), on y
+ * revient avec l'erreur. Sinon l'erreur est affichée et le simulateur se
+ * termine.
+ *
  * \note Toutes les erreurs étant fatales on ne revient jamais de cette
  * fonction. L'attribut \a noreturn est une extension (non standard) de GNU C
  * qui indique ce fait.
@@ -66,4 +141,14 @@ void error(Error err, unsigned addr);
  */
 void warning(Warning warn, unsigned addr);
 
+//! Affichage ou non des avertissements
+/*!
+ * Les avertissements sont affichés par défaut. Le réglage vaut pour tous les
+ * threads : un programme qui exécute de nombreux programmes simulés (voir
+ * batch.h) les désactive une fois pour toutes.
+ *
+ * \param enable vrai pour afficher les avertissements
+ */
+void warnings_enable(bool enable);
+
 #endif
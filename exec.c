@@ -4,37 +4,11 @@
  */
 
 #include "exec.h"
+#include "exec_inline.h"
 #include "error.h"
 #include <stdio.h>
+#include <string.h>
  
-//! Met à jour cc (code condition) selon la valeur de reg.
-/*!
- * \param pmach machine en cours d'exécution
- * \param reg numéro de registre
- */
-void refresh_cc(Machine *pmach, unsigned int reg) 
-{
-	if (reg < 0)
-	        pmach->_cc = CC_N;
-    	else if (reg > 0)
-        	pmach->_cc = CC_P;
-    	else
-        	pmach->_cc = CC_Z;
-}
-
-//! Vérifie que le Stack Pointer (SP) ne dépasse pas la zone dédiée à la pile.
-//! Il ne faut pas par exemple qu'avec des branchements successifs, on efface les données existantes.
-/*!
- * \param pmach machine en cours d'exécution
- * \param addr adresse de l'instruction
- */
-void check_stack(Machine *pmach, unsigned addr) 
-{
-	if (pmach->_sp < pmach->_dataend || pmach->_sp >= pmach->_datasize)
-		error(ERR_SEGSTACK,addr);
-}
-
-
 //! Vérifie que l'instruction n'est pas immédiate.
 /*!
  * \param instr instruction en cours
@@ -86,18 +60,6 @@ unsigned int get_address(Machine *pmach, Instruction instr)
 	return instr.instr_absolute._address;
 }
 
-//! Vérifie qu'il n'y a pas d'erreur de segmentation sur le tableau des données.
-/*!
- * \param pmach machine en cours d'exécution
- * \param data_addr adresse réelle
- * \param addr adresse de l'instruction en cours
- */
-void check_data_addr(Machine *pmach, unsigned int data_addr, unsigned addr) 
-{
-	if (data_addr > pmach->_datasize)
-		error(ERR_SEGDATA, addr);
-}
-
 //! Décode et exécute l'instruction LOAD.
 //! LOAD accepte l'adressage immédiat, absolu et indexé pour la source.
 //! Il faut indiquer un registre de destination.
@@ -212,6 +174,8 @@ bool call(Machine *pmach, Instruction instr, unsigned addr)
 		pmach->_data[pmach->_sp--] = pmach->_pc;
 		unsigned int address = get_address(pmach, instr);
 		pmach->_pc = address;
+		if (pmach->_calls != NULL)
+			callgraph_call(pmach);
 	}
 	return true;
 }
@@ -224,9 +188,12 @@ bool call(Machine *pmach, Instruction instr, unsigned addr)
  * \param addr adresse de l'instruction en cours
  */
 bool ret(Machine *pmach, Instruction instr, unsigned addr) {
+	(void) instr;
 	++pmach->_sp;
 	check_stack(pmach, addr);
 	pmach->_pc = pmach->_data[pmach->_sp];
+	if (pmach->_calls != NULL)
+		callgraph_ret(pmach);
 	return true;
 }
 
@@ -269,6 +236,26 @@ bool pop(Machine *pmach, Instruction instr, unsigned addr)
 	return true;
 }
 
+//! Routines d'exécution spécialisées, une par sorte de micro-opération.
+/*!
+ * Chaque routine intègre la sémantique de son opération (exec_inline.h) avec
+ * un mode d'adressage constant.
+ */
+#define X(kind, name, op, mode, base)					\
+bool uop_##name(Machine *pmach, const Micro_Op *uop)		\
+{								\
+	return exec_##op(pmach, uop, mode);			\
+}
+UOP_KINDS(X)
+#undef X
+
+//! Routine d'exécution de chaque sorte de micro-opération
+const Handler uop_handlers[UOP_NKINDS] = {
+#define X(kind, name, op, mode, base) [kind] = uop_##name,
+	UOP_KINDS(X)
+#undef X
+};
+
 //! Décode et exécute une instruction.
 /*!
  * \param pmach machine en cours d'exécution
@@ -317,7 +304,32 @@ bool decode_execute(Machine *pmach, Instruction instr)
  */
 void trace(const char *msg, Machine *pmach, Instruction instr, unsigned addr) 
 {
-	printf("TRACE: %s: 0x%04x: ",msg, addr);
-	print_instruction(instr, addr);
-	printf("\n");
+	(void) pmach;
+	//Une seule écriture par ligne, sans passer par printf(). Outre le
+	//message et l'instruction : "TRACE: ", ": 0x", 8 chiffres, ": " et "\n".
+	size_t len = strlen(msg);
+	char line[len + 32 + INSTR_TEXT_SIZE];
+	memcpy(line, "TRACE: ", 7);
+	memcpy(line + 7, msg, len);
+	len += 7;
+	memcpy(line + len, ": 0x", 4);
+	len += 4;
+	//Adresse sur au moins 4 chiffres hexadécimaux, comme "%04x" :
+	int digits = 4;
+	while (digits < 8 && (addr >> (4 * digits)) != 0)
+		digits++;
+	for (int i = digits - 1; i >= 0; i--)
+		line[len++] = "0123456789abcdef"[(addr >> (4 * i)) & 0xf];
+	line[len++] = ':';
+	line[len++] = ' ';
+	len += sprint_instruction(line + len, instr, addr);
+	line[len++] = '\n';
+	fwrite(line, 1, len, stdout);
+}
+
+//! Sortie de la trace dans un grand tampon
+void trace_sink(void)
+{
+	static char buffer[TRACE_BUFSIZE];
+	setvbuf(stdout, buffer, _IOFBF, sizeof(buffer));
 }
@@ -7,6 +7,8 @@
  */
 
 #include "machine.h"
+#include "decode.h"
+#include "bintrace.h"
 
 //! Décodage et exécution d'une instruction
 /*!
@@ -16,6 +18,28 @@
  */
 bool decode_execute(Machine *pmach, Instruction instr);
 
+//! Adresse réelle d'une instruction, en adressage indexé ou absolu
+/*!
+ * \param pmach la machine/programme en cours d'exécution
+ * \param instr l'instruction
+ * \return l'adresse désignée par l'opérande de \c instr
+ */
+unsigned int get_address(Machine *pmach, Instruction instr);
+
+//! Routines d'exécution des micro-opérations
+/*!
+ * Une routine \c uop_<nom> par sorte de micro-opération (voir \c UOP_KINDS),
+ * c'est-à-dire par combinaison (code opération, mode d'adressage) : aucune ne
+ * teste le mode d'adressage à l'exécution. Toutes ont la signature
+ * \link Handler \endlink : elles retournent faux après \c HALT et vrai sinon.
+ */
+#define X(kind, name, op, mode, base) bool uop_##name(Machine *pmach, const Micro_Op *uop);
+UOP_KINDS(X)
+#undef X
+
+//! Routine d'exécution de chaque sorte de micro-opération
+extern const Handler uop_handlers[UOP_NKINDS];
+
 //! Trace de l'exécution
 /*!
  * On écrit l'adresse et l'instruction sous forme lisible.
@@ -27,4 +51,53 @@ bool decode_execute(Machine *pmach, Instruction instr);
  */
 void trace(const char *msg, Machine *pmach, Instruction instr, unsigned addr);
 
+//! L'instruction doit-elle être tracée ?
+/*!
+ * \param level niveau de trace
+ * \param instr l'instruction à exécuter
+ * \return vrai si \c instr est tracée au niveau \c level
+ */
+static inline bool trace_wanted(Trace_Level level, Instruction instr)
+{
+	switch (level) {
+	case TRACE_OFF:
+		return false;
+	case TRACE_BRANCHES:
+		return instr.instr_generic._cop == BRANCH;
+	case TRACE_CALLS:
+		return instr.instr_generic._cop == CALL || instr.instr_generic._cop == RET;
+	default:
+		return true;
+	}
+}
+
+//! Trace d'une instruction avant son exécution par un moteur
+/*!
+ * Au niveau \c TRACE_BINARY, l'instruction est enregistrée dans la trace
+ * binaire ; sinon elle est tracée en texte par trace().
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param addr adresse de l'instruction
+ */
+static inline void trace_exec(Machine *pmach, unsigned addr)
+{
+	if (pmach->_trace == TRACE_BINARY)
+		bintrace_record(pmach, addr);
+	else
+		trace("Executing", pmach, pmach->_text[addr], addr);
+}
+
+//! Taille du tampon de la sortie standard installé par trace_sink()
+#define TRACE_BUFSIZE (1 << 20)
+
+//! Sortie de la trace dans un grand tampon
+/*!
+ * La sortie standard, où sont écrites la trace et toutes les autres sorties
+ * du simulateur, est vidée par blocs de \c TRACE_BUFSIZE octets au lieu de
+ * ligne par ligne : l'ordre des messages est conservé. Doit être appelée avant
+ * toute écriture sur la sortie standard ; inutile en mode de mise au point,
+ * qui dialogue avec l'utilisateur.
+ */
+void trace_sink(void);
+
 #endif
@@ -0,0 +1,565 @@
+#ifndef _EXEC_INLINE_H_
+#define _EXEC_INLINE_H_
+
+/*!
+ * \file exec_inline.h
+ * \brief Sémantique des micro-opérations, partagée par les moteurs d'exécution.
+ *
+ * Ces fonctions sont définies en ligne pour que chaque moteur (appel de
+ * routine, dispatch par \e computed \e goto...) puisse les intégrer
+ * directement dans sa boucle. Elles sont aussi utilisées par le décodeur de
+ * référence de exec.c.
+ */
+
+#include "machine.h"
+#include "decode.h"
+#include "exec.h"
+#include "error.h"
+#include "callgraph.h"
+
+//! Fonction toujours intégrée à l'appelant.
+/*!
+ * Les routines spécialisées de chaque mode d'adressage sont obtenues en
+ * intégrant ces fonctions avec un mode constant : le compilateur élimine
+ * alors les tests sur le mode.
+ */
+#ifdef __GNUC__
+#   define EXEC_INLINE static inline __attribute__((always_inline))
+#else
+#   define EXEC_INLINE static inline
+#endif
+
+//! Met à jour cc (code condition) selon la valeur de reg.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param reg numéro de registre
+ */
+static inline void refresh_cc(Machine *pmach, unsigned int reg)
+{
+	if (reg < 0)
+	        pmach->_cc = CC_N;
+    	else if (reg > 0)
+        	pmach->_cc = CC_P;
+    	else
+        	pmach->_cc = CC_Z;
+}
+
+//! Vérifie que le Stack Pointer (SP) ne dépasse pas la zone dédiée à la pile.
+//! Il ne faut pas par exemple qu'avec des branchements successifs, on efface les données existantes.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param addr adresse de l'instruction
+ */
+static inline void check_stack(Machine *pmach, unsigned addr)
+{
+	if (pmach->_sp < pmach->_dataend || pmach->_sp >= pmach->_datasize)
+		error(ERR_SEGSTACK,addr);
+}
+
+//! Vérifie qu'il n'y a pas d'erreur de segmentation sur le tableau des données.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param data_addr adresse réelle
+ * \param addr adresse de l'instruction en cours
+ */
+static inline void check_data_addr(Machine *pmach, unsigned int data_addr, unsigned addr)
+{
+	if (data_addr > pmach->_datasize)
+		error(ERR_SEGDATA, addr);
+}
+
+//! Conditions satisfaites pour chaque valeur du code condition.
+/*!
+ * Le bit \c cc du masque associé à une condition est à 1 si la condition est
+ * vraie lorsque le code condition vaut \c cc. C'est la table de vérité de
+ * allowed_condition().
+ */
+static const uint8_t condition_masks[] = {
+	[NC] = 1 << CC_U | 1 << CC_Z | 1 << CC_P | 1 << CC_N,
+	[EQ] = 1 << CC_Z,
+	[NE] = 1 << CC_U | 1 << CC_P | 1 << CC_N,
+	[GT] = 1 << CC_P,
+	[GE] = 1 << CC_P | 1 << CC_Z,
+	[LT] = 1 << CC_N,
+	[LE] = 1 << CC_N | 1 << CC_Z,
+};
+
+//! Évalue la condition (déjà validée au prédécodage) d'une micro-opération.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \return vrai si la condition est satisfaite
+ */
+EXEC_INLINE bool uop_condition(Machine *pmach, const Micro_Op *uop)
+{
+	return (condition_masks[uop->_reg] >> pmach->_cc) & 1;
+}
+
+//! Évalue la condition d'une instruction BRANCH ou CALL, sans la valider.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param instr l'instruction
+ * \return faux si la condition est fausse ou illégale
+ */
+EXEC_INLINE bool instr_condition(Machine *pmach, Instruction instr)
+{
+	return instr.instr_generic._regcond <= LAST_CONDITION
+	       && (condition_masks[instr.instr_generic._regcond] >> pmach->_cc & 1);
+}
+
+//! Pas d'accès aux données (voir Data_Access)
+#define ACCESS_NONE UINT32_MAX
+
+//! Accès aux données d'une instruction
+typedef struct
+{
+	uint32_t _read;		//!< Adresse lue, ou \c ACCESS_NONE
+	uint32_t _write;	//!< Adresse écrite, ou \c ACCESS_NONE
+} Data_Access;
+
+//! Accès aux données que fera une instruction, calculés avant son exécution.
+/*!
+ * Les adresses ne sont pas vérifiées : elles ne sont sûres que si
+ * l'instruction se termine ensuite normalement.
+ *
+ * \param pmach machine en cours d'exécution, avant l'exécution de \c instr
+ * \param instr l'instruction
+ */
+EXEC_INLINE Data_Access instr_accesses(Machine *pmach, Instruction instr)
+{
+	Data_Access acc = { ACCESS_NONE, ACCESS_NONE };
+	bool memory = !instr.instr_generic._immediate;
+
+	switch (instr.instr_generic._cop) {
+	case LOAD:
+	case ADD:
+	case SUB:
+		if (memory)
+			acc._read = get_address(pmach, instr);
+		break;
+	case STORE:
+		acc._write = get_address(pmach, instr);
+		break;
+	case PUSH:
+		if (memory)
+			acc._read = get_address(pmach, instr);
+		acc._write = pmach->_sp;
+		break;
+	case POP:
+		acc._read = pmach->_sp + 1;
+		acc._write = get_address(pmach, instr);
+		break;
+	case CALL:
+		//Seul un appel effectué empile l'adresse de retour :
+		if (instr_condition(pmach, instr))
+			acc._write = pmach->_sp;
+		break;
+	case RET:
+		acc._read = pmach->_sp + 1;
+		break;
+	default:
+		break;
+	}
+	return acc;
+}
+
+//! Adresse réelle d'une micro-opération, en adressage indexé ou absolu.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ */
+EXEC_INLINE unsigned int uop_address(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	if (mode == MODE_INDEXED)
+		return pmach->_registers[uop->_rindex] + uop->_operand;
+	return uop->_operand;
+}
+
+//! Valeur de l'opérande source d'une micro-opération (immédiat ou mémoire).
+/*!
+ * Une adresse absolue a été vérifiée au prédécodage (voir predecode()) : seule
+ * l'adresse indexée l'est ici.
+ *
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \param addr adresse de l'instruction en cours
+ */
+EXEC_INLINE Word uop_source(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode, unsigned addr)
+{
+	if (mode == MODE_IMMEDIATE)
+		return uop->_operand;
+	unsigned int address = uop_address(pmach, uop, mode);
+	if (mode == MODE_INDEXED)
+		check_data_addr(pmach, address, addr);
+	return pmach->_data[address];
+}
+
+//! Exécute une micro-opération LOAD.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_load(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	pmach->_registers[uop->_reg] = uop_source(pmach, uop, mode, pmach->_pc - 1);
+	refresh_cc(pmach, pmach->_registers[uop->_reg]);
+	return true;
+}
+
+//! Exécute une micro-opération STORE.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_store(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	unsigned int address = uop_address(pmach, uop, mode);
+	if (mode == MODE_INDEXED)
+		check_data_addr(pmach, address, pmach->_pc - 1);
+	pmach->_data[address] = pmach->_registers[uop->_reg];
+	return true;
+}
+
+//! Exécute une micro-opération ADD.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_add(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	pmach->_registers[uop->_reg] += uop_source(pmach, uop, mode, pmach->_pc - 1);
+	refresh_cc(pmach, pmach->_registers[uop->_reg]);
+	return true;
+}
+
+//! Exécute une micro-opération SUB.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_sub(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	pmach->_registers[uop->_reg] -= uop_source(pmach, uop, mode, pmach->_pc - 1);
+	refresh_cc(pmach, pmach->_registers[uop->_reg]);
+	return true;
+}
+
+//! Exécute une micro-opération LOAD sans mettre à jour le code condition.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_load_nocc(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	pmach->_registers[uop->_reg] = uop_source(pmach, uop, mode, pmach->_pc - 1);
+	return true;
+}
+
+//! Exécute une micro-opération ADD sans mettre à jour le code condition.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_add_nocc(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	pmach->_registers[uop->_reg] += uop_source(pmach, uop, mode, pmach->_pc - 1);
+	return true;
+}
+
+//! Exécute une micro-opération SUB sans mettre à jour le code condition.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_sub_nocc(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	pmach->_registers[uop->_reg] -= uop_source(pmach, uop, mode, pmach->_pc - 1);
+	return true;
+}
+
+//! Exécute une micro-opération BRANCH.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_branch(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	if (uop_condition(pmach, uop))
+		pmach->_pc = uop_address(pmach, uop, mode);
+	return true;
+}
+
+//! Exécute une micro-opération CALL.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_call(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	check_stack(pmach, pmach->_pc - 1);
+	if (uop_condition(pmach, uop)) {
+		pmach->_data[pmach->_sp--] = pmach->_pc;
+		pmach->_pc = uop_address(pmach, uop, mode);
+		if (pmach->_calls != NULL)
+			callgraph_call(pmach);
+	}
+	return true;
+}
+
+//! Exécute une micro-opération CALL dont la condition est illégale.
+//! La pile est vérifiée avant la condition, comme dans call().
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return ne retourne pas (voir error())
+ */
+EXEC_INLINE bool exec_call_badcond(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	(void) uop;
+	(void) mode;
+	check_stack(pmach, pmach->_pc - 1);
+	error(ERR_CONDITION, pmach->_pc - 1);
+}
+
+//! Exécute une micro-opération PUSH dont l'adresse absolue est hors segment.
+//! La pile est vérifiée avant l'adresse, comme dans push().
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return ne retourne pas (voir error())
+ */
+EXEC_INLINE bool exec_push_badaddr(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	(void) uop;
+	(void) mode;
+	check_stack(pmach, pmach->_pc - 1);
+	error(ERR_SEGDATA, pmach->_pc - 1);
+}
+
+//! Exécute une micro-opération RET.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_ret(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	(void) uop;
+	(void) mode;
+	++pmach->_sp;
+	check_stack(pmach, pmach->_pc - 1);
+	pmach->_pc = pmach->_data[pmach->_sp];
+	if (pmach->_calls != NULL)
+		callgraph_ret(pmach);
+	return true;
+}
+
+//! Exécute une micro-opération PUSH.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_push(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	check_stack(pmach, pmach->_pc - 1);
+	Word value = uop_source(pmach, uop, mode, pmach->_pc - 1);
+	pmach->_data[pmach->_sp--] = value;
+	return true;
+}
+
+//! Exécute une micro-opération POP.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_pop(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	unsigned int address = uop_address(pmach, uop, mode);
+	if (mode == MODE_INDEXED)
+		check_data_addr(pmach, address, pmach->_pc - 1);
+	++pmach->_sp;
+	check_stack(pmach, pmach->_pc - 1);
+	pmach->_data[address] = pmach->_data[pmach->_sp];
+	return true;
+}
+
+//! Exécute une micro-opération NOP.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_nop(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	(void) pmach;
+	(void) uop;
+	(void) mode;
+	return true;
+}
+
+//! Exécute une micro-opération HALT.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return toujours faux
+ */
+EXEC_INLINE bool exec_halt(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	(void) uop;
+	(void) mode;
+	warning(WARN_HALT, pmach->_pc - 1);
+	return false;
+}
+
+//! Exécute une micro-opération issue d'une instruction mal formée.
+//! Le code d'erreur a été déterminé au prédécodage et rangé dans \c _operand.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop micro-opération en cours
+ * \param mode mode d'adressage (constant dans chaque routine spécialisée)
+ * \return ne retourne pas (voir error())
+ */
+EXEC_INLINE bool exec_fault(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	(void) mode;
+	error(uop->_operand, pmach->_pc - 1);
+}
+
+//! Passe à l'instruction suivante d'une superinstruction.
+/*!
+ * L'instruction est tracée, selon le niveau de trace, comme si elle avait été
+ * atteinte par le dispatch : la trace, les adresses d'erreur et le nombre
+ * d'instructions exécutées restent ceux de la séquence d'origine.
+ * Elle est dans le segment de texte puisque la séquence y a été reconnue.
+ *
+ * \param pmach machine en cours d'exécution
+ */
+EXEC_INLINE void next_component(Machine *pmach)
+{
+	if (trace_wanted(pmach->_trace, pmach->_text[pmach->_pc]))
+		trace_exec(pmach, pmach->_pc);
+	pmach->_pc++;
+	pmach->_instrs++;
+}
+
+//! Exécute la superinstruction LOAD r, @a ; ADD r, x ; STORE r, @a.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop première micro-opération de la séquence
+ * \param mode mode d'adressage de l'opérande x (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_load_add_store(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	//Le code condition du LOAD est aussitôt écrasé par celui du ADD :
+	exec_load_nocc(pmach, uop, MODE_ABSOLUTE);
+	next_component(pmach);
+	exec_add(pmach, uop + 1, mode);
+	next_component(pmach);
+	exec_store(pmach, uop + 2, MODE_ABSOLUTE);
+	pmach->_fused_ops++;
+	pmach->_fused_instrs += 3;
+	return true;
+}
+
+//! Exécute la superinstruction LOAD r, @a ; SUB r, x ; STORE r, @a.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop première micro-opération de la séquence
+ * \param mode mode d'adressage de l'opérande x (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_load_sub_store(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	//Le code condition du LOAD est aussitôt écrasé par celui du SUB :
+	exec_load_nocc(pmach, uop, MODE_ABSOLUTE);
+	next_component(pmach);
+	exec_sub(pmach, uop + 1, mode);
+	next_component(pmach);
+	exec_store(pmach, uop + 2, MODE_ABSOLUTE);
+	pmach->_fused_ops++;
+	pmach->_fused_instrs += 3;
+	return true;
+}
+
+//! Exécute la superinstruction ADD r, x ; BRANCH cond, @t.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop première micro-opération de la séquence
+ * \param mode mode d'adressage de l'opérande x (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_add_branch(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	exec_add(pmach, uop, mode);
+	next_component(pmach);
+	exec_branch(pmach, uop + 1, MODE_ABSOLUTE);
+	pmach->_fused_ops++;
+	pmach->_fused_instrs += 2;
+	return true;
+}
+
+//! Exécute la superinstruction SUB r, x ; BRANCH cond, @t.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop première micro-opération de la séquence
+ * \param mode mode d'adressage de l'opérande x (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_sub_branch(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	exec_sub(pmach, uop, mode);
+	next_component(pmach);
+	exec_branch(pmach, uop + 1, MODE_ABSOLUTE);
+	pmach->_fused_ops++;
+	pmach->_fused_instrs += 2;
+	return true;
+}
+
+//! Exécute la superinstruction PUSH x ; CALL cond, @t.
+/*!
+ * \param pmach machine en cours d'exécution
+ * \param uop première micro-opération de la séquence
+ * \param mode mode d'adressage de l'opérande x (constant dans chaque routine spécialisée)
+ * \return toujours vrai
+ */
+EXEC_INLINE bool exec_push_call(Machine *pmach, const Micro_Op *uop, Addressing_Mode mode)
+{
+	exec_push(pmach, uop, mode);
+	next_component(pmach);
+	exec_call(pmach, uop + 1, MODE_ABSOLUTE);
+	pmach->_fused_ops++;
+	pmach->_fused_instrs += 2;
+	return true;
+}
+
+#endif
@@ -0,0 +1,269 @@
+/*!
+ * \file hook_bench.c
+ * \brief Mesure du coût des crochets d'instrumentation (voir hooks.h).
+ *
+ * Exécute plusieurs fois le même programme, lu dans un fichier binaire ou, à
+ * défaut, une boucle prédéfinie : avec le moteur choisi et sans
+ * crochet, avec un crochet d'erreur seulement (aucun crochet d'instruction :
+ * le moteur est utilisé tel quel), avec un seul crochet d'instruction, puis
+ * avec tous les crochets. Les crochets ne font que compter leurs appels.
+ * Chaque configuration garde le meilleur de plusieurs essais ; le
+ * ralentissement est mesuré par rapport à l'exécution sans crochet.
+ *
+ * À compiler avec les sources du simulateur, comme test_simul.c.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "machine.h"
+#include "error.h"
+#include "hooks.h"
+
+//! Nombre d'essais par défaut de chaque configuration
+#define DEFAULT_RUNS 5
+
+//! Nombre d'itérations par défaut de la boucle prédéfinie
+#define DEFAULT_ITERATIONS 2000000
+
+//! Instruction à adressage absolu
+#define ABS(op, rc, addr) { .instr_absolute = { ._cop = (op), ._regcond = (rc), ._address = (addr) } }
+
+//! Instruction à adressage immédiat
+#define IMM(op, rc, val) { .instr_immediate = { ._cop = (op), ._immediate = true, ._regcond = (rc), ._value = (val) } }
+
+//! Boucle prédéfinie : chaque itération appelle un sous-programme, lit et
+//! écrit des données, empile et dépile, et se termine par un branchement
+static Instruction loop_text[] = {
+    ABS(LOAD, 1, 0),		// R1 = nombre d'itérations
+    ABS(CALL, NC, 10),		// boucle :
+    ABS(LOAD, 2, 1),
+    IMM(ADD, 2, 1),
+    ABS(STORE, 2, 1),		// compteur en mémoire
+    ABS(PUSH, 0, 1),
+    ABS(POP, 0, 2),
+    IMM(SUB, 1, 1),
+    ABS(BRANCH, NE, 1),
+    ABS(HALT, 0, 0),
+    IMM(ADD, 3, 3),		// sous-programme
+    ABS(RET, 0, 0),
+};
+
+//! Taille du segment de données de la boucle prédéfinie (pile comprise)
+#define LOOP_DATASIZE 16
+
+//! Segment de données de la boucle prédéfinie, réinitialisé à chaque essai
+static Word loop_data[LOOP_DATASIZE + 1];
+
+//! Compteurs d'événements, contexte des crochets
+typedef struct
+{
+    unsigned long long _events;	//!< Appels de crochets
+} Bench_Counts;
+
+//! Crochet avant chaque instruction.
+static void count_before(void *ctx, Machine *pmach, unsigned pc, Instruction instr)
+{
+    (void) pmach;
+    (void) pc;
+    (void) instr;
+    ((Bench_Counts *) ctx)->_events++;
+}
+
+//! Crochet de lecture ou d'écriture.
+static void count_access(void *ctx, Machine *pmach, unsigned pc, unsigned addr, Word value)
+{
+    (void) pmach;
+    (void) pc;
+    (void) addr;
+    (void) value;
+    ((Bench_Counts *) ctx)->_events++;
+}
+
+//! Crochet de branchement.
+static void count_branch(void *ctx, Machine *pmach, unsigned pc, unsigned target, bool taken)
+{
+    (void) pmach;
+    (void) pc;
+    (void) target;
+    (void) taken;
+    ((Bench_Counts *) ctx)->_events++;
+}
+
+//! Crochet d'appel ou de retour.
+static void count_transfer(void *ctx, Machine *pmach, unsigned pc, unsigned target)
+{
+    (void) pmach;
+    (void) pc;
+    (void) target;
+    ((Bench_Counts *) ctx)->_events++;
+}
+
+//! Crochet d'erreur.
+static void count_fault(void *ctx, Machine *pmach, Fault fault)
+{
+    (void) pmach;
+    (void) fault;
+    ((Bench_Counts *) ctx)->_events++;
+}
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: hook_bench [options] [binfile]\n");
+    printf("where options are:\n"
+           "\t-e\tExecution engine: 'call', 'threaded' (default) or 'jit'\n"
+           "\t-n N\tKeep the best of N runs of each configuration (default %d)\n"
+           "\t-l N\tIterations of the built-in loop (default %d)\n"
+           "\t-h\tprint this help message\n"
+           "Without binfile, a built-in loop is measured: each iteration\n"
+           "runs 10 instructions, with a call, data reads and writes and\n"
+           "a branch.\n", DEFAULT_RUNS, DEFAULT_ITERATIONS);
+}
+
+//! Chargement du programme à mesurer.
+/*!
+ * \param pmach la machine
+ * \param programfile le programme binaire, ou NULL pour la boucle prédéfinie
+ * \param iterations nombre d'itérations de la boucle prédéfinie
+ */
+static void load(Machine *pmach, const char *programfile, unsigned iterations)
+{
+    if (programfile != NULL) {
+        read_program(pmach, programfile);
+        return;
+    }
+    memset(loop_data, 0, sizeof(loop_data));
+    loop_data[0] = iterations;
+    load_program(pmach, sizeof(loop_text) / sizeof(loop_text[0]), loop_text,
+                 LOOP_DATASIZE, loop_data, 3);
+}
+
+//! Meilleure durée d'exécution du programme avec des crochets.
+/*!
+ * \param programfile le programme, ou NULL pour la boucle prédéfinie
+ * \param iterations nombre d'itérations de la boucle prédéfinie
+ * \param engine le moteur d'exécution
+ * \param hooks les crochets, ou NULL
+ * \param runs nombre d'essais
+ * \param instrs reçoit le nombre d'instructions exécutées
+ * \return la durée en secondes
+ */
+static double bench(const char *programfile, unsigned iterations, Engine engine,
+                    const Hooks *hooks, unsigned runs, unsigned long long *instrs)
+{
+    double best = 0.0;
+    for (unsigned r = 0; r < runs; r++)
+    {
+        Machine mach;
+        load(&mach, programfile, iterations);
+        mach._engine = engine;
+        mach._trace = TRACE_OFF;
+        if (hooks != NULL)
+            hooks_attach(&mach, hooks);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        Fault fault = simul_run(&mach, false);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+        if (r == 0 || elapsed < best)
+            best = elapsed;
+        *instrs = mach._instrs;
+        if (fault._error != ERR_NOERROR)
+            fprintf(stderr, "Run ended by error %d at 0x%04x\n", fault._error, fault._addr);
+        free_program(&mach);
+    }
+    return best;
+}
+
+//! Banc d'essai des crochets
+/*!
+ * \param argc nombre d'arguments
+ * \param argv options, puis nom du programme binaire éventuel
+ */
+int main(int argc, char *argv[])
+{
+    Engine engine = ENGINE_THREADED;
+    unsigned runs = DEFAULT_RUNS;
+    unsigned iterations = DEFAULT_ITERATIONS;
+    const char *programfile = NULL;
+
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        if (strcmp(argv[iarg], "-e") == 0 && iarg + 1 < argc) {
+            const char *name = argv[++iarg];
+            if (strcmp(name, "call") == 0)
+                engine = ENGINE_CALL;
+            else if (strcmp(name, "threaded") == 0)
+                engine = ENGINE_THREADED;
+            else if (strcmp(name, "jit") == 0)
+                engine = ENGINE_JIT;
+            else {
+                fprintf(stderr, "Unknown engine for option -e\n");
+                usage();
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[iarg], "-n") == 0 && iarg + 1 < argc)
+            runs = strtoul(argv[++iarg], NULL, 0);
+        else if (strcmp(argv[iarg], "-l") == 0 && iarg + 1 < argc)
+            iterations = strtoul(argv[++iarg], NULL, 0);
+        else if (strcmp(argv[iarg], "-h") == 0) {
+            usage();
+            exit(EXIT_SUCCESS);
+        }
+        else if (argv[iarg][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        else
+            programfile = argv[iarg];
+    }
+    if (runs == 0 || iterations == 0) {
+        usage();
+        exit(EXIT_FAILURE);
+    }
+    warnings_enable(false);
+
+    Bench_Counts counts;
+    const Hooks none = { 0 };
+    const Hooks fault_only = { ._fault = count_fault, ._ctx = &counts };
+    const Hooks one = { ._before = count_before, ._ctx = &counts };
+    const Hooks all = {
+        count_before, count_access, count_access, count_branch,
+        count_transfer, count_transfer, count_fault, &counts
+    };
+    const struct
+    {
+        const char *_name;	//!< Nom de la configuration
+        const Hooks *_hooks;	//!< Crochets attachés
+    } configs[] = {
+        { "no hooks", NULL },
+        { "empty hooks", &none },
+        { "fault hook", &fault_only },
+        { "before hook", &one },
+        { "all hooks", &all },
+    };
+
+    printf("%-12s %14s %14s %10s %10s\n", "config", "instructions", "hook calls", "seconds", "slowdown");
+    double base = 0.0;
+    for (unsigned i = 0; i < sizeof(configs) / sizeof(configs[0]); i++)
+    {
+        unsigned long long instrs = 0;
+        counts._events = 0;
+        double elapsed = bench(programfile, iterations, engine, configs[i]._hooks, runs, &instrs);
+        if (i == 0)
+            base = elapsed;
+        printf("%-12s %14llu %14llu %10.3f %9.2fx\n", configs[i]._name, instrs,
+               counts._events / runs, elapsed, base > 0 ? elapsed / base : 0.0);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*!
+ * \file hooks.c
+ * \brief Crochets d'instrumentation : fonctions appelées par la machine à
+ * chaque événement de l'exécution.
+ *
+ * La boucle instrumentée est une fonction toujours intégrée dont le masque
+ * des crochets est un paramètre : simul_hooked() l'intègre une fois par
+ * valeur constante du masque, et le compilateur élimine dans chaque copie
+ * les tests et les calculs des crochets absents, comme il le fait pour les
+ * modes d'adressage des routines spécialisées (voir exec_inline.h).
+ */
+
+#include "hooks.h"
+#include "exec.h"
+#include "exec_inline.h"
+#include <stdio.h>
+
+//! Attachement des crochets d'une analyse à une machine
+/*!
+ * \param pmach la machine
+ * \param hooks les crochets
+ */
+void hooks_attach(Machine *pmach, const Hooks *hooks)
+{
+	pmach->_hooks = hooks;
+}
+
+//! Détachement des crochets d'une machine
+/*!
+ * \param pmach la machine
+ */
+void hooks_detach(Machine *pmach)
+{
+	pmach->_hooks = NULL;
+}
+
+//! Crochets d'instruction renseignés
+/*!
+ * \param hooks les crochets, ou NULL
+ * \return la combinaison de \link Hook_Kind \endlink
+ */
+unsigned hooks_mask(const Hooks *hooks)
+{
+	if (hooks == NULL)
+		return 0;
+	return (hooks->_before ? HOOK_BEFORE : 0) | (hooks->_read ? HOOK_READ : 0)
+	       | (hooks->_write ? HOOK_WRITE : 0) | (hooks->_branch ? HOOK_BRANCH : 0)
+	       | (hooks->_call ? HOOK_CALL : 0) | (hooks->_ret ? HOOK_RET : 0);
+}
+
+//! Boucle instrumentée, pour un masque constant.
+/*!
+ * Les événements sont calculés avant l'exécution de l'instruction, qui peut
+ * modifier ses propres opérandes, et signalés après, seulement si elle se
+ * termine normalement.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param hooks les crochets
+ * \param mask les crochets renseignés (constant dans chaque copie)
+ */
+EXEC_INLINE void hooked_loop(Machine *pmach, const Hooks *hooks, unsigned mask)
+{
+	bool stop = true;
+
+	while (stop)
+	{
+		unsigned pc = pmach->_pc;
+		if (pc >= pmach->_textsize)
+			error(ERR_SEGTEXT, pc - 1);
+		Instruction instr = pmach->_text[pc];
+		if (trace_wanted(pmach->_trace, instr))
+			trace_exec(pmach, pc);
+		if (mask & HOOK_BEFORE)
+			hooks->_before(hooks->_ctx, pmach, pc, instr);
+
+		Data_Access acc = { ACCESS_NONE, ACCESS_NONE };
+		Word value = 0;
+		if (mask & (HOOK_READ | HOOK_WRITE))
+			acc = instr_accesses(pmach, instr);
+		//La valeur lue n'est peut-être plus en place après l'instruction
+		//(POP R, @a ou PUSH @a sur le sommet de la pile). L'adresse datasize
+		//est valide (voir check_data_addr()) :
+		if ((mask & HOOK_READ) && acc._read <= pmach->_datasize)
+			value = pmach->_data[acc._read];
+
+		Code_Op cop = instr.instr_generic._cop;
+		bool taken = false;
+		unsigned target = 0;
+		if (((mask & HOOK_BRANCH) && cop == BRANCH) || ((mask & HOOK_CALL) && cop == CALL))
+			taken = instr_condition(pmach, instr);
+		if ((mask & HOOK_BRANCH) && cop == BRANCH && !instr.instr_generic._immediate)
+			target = get_address(pmach, instr);
+
+		const Micro_Op *uop = &pmach->_uops[pc];
+		pmach->_pc++;
+		pmach->_instrs++;
+		stop = uop_handlers[uop_base_kinds[uop->_kind]](pmach, uop);
+
+		if ((mask & HOOK_READ) && acc._read != ACCESS_NONE)
+			hooks->_read(hooks->_ctx, pmach, pc, acc._read, value);
+		if ((mask & HOOK_WRITE) && acc._write != ACCESS_NONE)
+			hooks->_write(hooks->_ctx, pmach, pc, acc._write, pmach->_data[acc._write]);
+		if ((mask & HOOK_BRANCH) && cop == BRANCH)
+			hooks->_branch(hooks->_ctx, pmach, pc, target, taken);
+		if ((mask & HOOK_CALL) && cop == CALL && taken)
+			hooks->_call(hooks->_ctx, pmach, pc, pmach->_pc);
+		if ((mask & HOOK_RET) && cop == RET)
+			hooks->_ret(hooks->_ctx, pmach, pc, pmach->_pc);
+	}
+}
+
+//! Boucle instrumentée du masque \c m
+#define HOOKED_CASE(m) case (m): hooked_loop(pmach, hooks, (m)); break;
+//! Boucles instrumentées des masques \c m à <tt>m + 7</tt>
+#define HOOKED_CASES8(m)						\
+	HOOKED_CASE(m) HOOKED_CASE(m + 1) HOOKED_CASE(m + 2) HOOKED_CASE(m + 3)	\
+	HOOKED_CASE(m + 4) HOOKED_CASE(m + 5) HOOKED_CASE(m + 6) HOOKED_CASE(m + 7)
+
+//! Exécution instrumentée jusqu'à \c HALT
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_hooked(Machine *pmach)
+{
+	const Hooks *hooks = pmach->_hooks;
+
+	switch (hooks_mask(hooks)) {
+	HOOKED_CASES8(0)
+	HOOKED_CASES8(8)
+	HOOKED_CASES8(16)
+	HOOKED_CASES8(24)
+	HOOKED_CASES8(32)
+	HOOKED_CASES8(40)
+	HOOKED_CASES8(48)
+	HOOKED_CASES8(56)
+	default:
+		fprintf(stderr, "Erreur : masque de crochets inconnu dans <hooks.c:simul_hooked>\n");
+		exit(1);
+	}
+}
@@ -0,0 +1,142 @@
+#ifndef _HOOKS_H_
+#define _HOOKS_H_
+
+/*!
+ * \file hooks.h
+ * \brief Crochets d'instrumentation : fonctions appelées par la machine à
+ * chaque événement de l'exécution.
+ *
+ * Une analyse (couverture, trace des accès mémoire, modèle de cache,
+ * propagation de teinte...) remplit une structure Hooks avec les seules
+ * fonctions dont elle a besoin et l'attache à la machine par hooks_attach().
+ *
+ * Une machine dont un crochet d'instruction est renseigné est exécutée par
+ * simul_hooked() au lieu de son moteur. Cette boucle est spécialisée à la
+ * compilation pour chaque combinaison de crochets d'instruction renseignés
+ * (voir \c HOOK_NMASKS) : les crochets absents ne coûtent aucun test.
+ * Sans crochet d'instruction, le moteur de la machine est utilisé tel quel.
+ * Le crochet d'erreur est appelé par simul_run(), hors de la boucle, quel que
+ * soit le moteur.
+ *
+ * Le mode pas à pas n'appelle pas les crochets.
+ */
+
+#include <stdbool.h>
+
+#include "machine.h"
+#include "error.h"
+
+//! Crochets d'instruction, un bit par champ de Hooks appelé dans la boucle
+typedef enum
+{
+    HOOK_BEFORE = 1 << 0,	//!< \c _before
+    HOOK_READ = 1 << 1,		//!< \c _read
+    HOOK_WRITE = 1 << 2,	//!< \c _write
+    HOOK_BRANCH = 1 << 3,	//!< \c _branch
+    HOOK_CALL = 1 << 4,		//!< \c _call
+    HOOK_RET = 1 << 5,		//!< \c _ret
+} Hook_Kind;
+
+//! Nombre de combinaisons de crochets d'instruction, chacune sa boucle
+#define HOOK_NMASKS 64
+
+//! Avant chaque instruction
+/*!
+ * \param ctx le contexte de l'analyse (\c _ctx)
+ * \param pmach la machine, \c _pc désignant encore l'instruction
+ * \param pc l'adresse de l'instruction
+ * \param instr l'instruction
+ */
+typedef void (*Hook_Before)(void *ctx, Machine *pmach, unsigned pc, Instruction instr);
+
+//! Lecture ou écriture d'un mot de données, après l'instruction
+/*!
+ * \param ctx le contexte de l'analyse
+ * \param pmach la machine
+ * \param pc l'adresse de l'instruction
+ * \param addr l'adresse du mot
+ * \param value la valeur lue ou écrite
+ */
+typedef void (*Hook_Access)(void *ctx, Machine *pmach, unsigned pc, unsigned addr, Word value);
+
+//! BRANCH, pris ou non, après l'instruction
+/*!
+ * \param ctx le contexte de l'analyse
+ * \param pmach la machine
+ * \param pc l'adresse de l'instruction
+ * \param target l'adresse de destination
+ * \param taken vrai si le branchement est pris
+ */
+typedef void (*Hook_Branch)(void *ctx, Machine *pmach, unsigned pc, unsigned target, bool taken);
+
+//! CALL effectué ou RET, après l'instruction
+/*!
+ * \param ctx le contexte de l'analyse
+ * \param pmach la machine
+ * \param pc l'adresse de l'instruction
+ * \param target l'adresse du sous-programme ou l'adresse de retour
+ */
+typedef void (*Hook_Transfer)(void *ctx, Machine *pmach, unsigned pc, unsigned target);
+
+//! Erreur d'exécution, avant que simul_run() ne la rende
+/*!
+ * \param ctx le contexte de l'analyse
+ * \param pmach la machine, dans son état au moment de l'erreur
+ * \param fault l'erreur
+ */
+typedef void (*Hook_Fault)(void *ctx, Machine *pmach, Fault fault);
+
+//! Crochets d'une analyse ; un champ NULL n'est pas appelé
+/*!
+ * Une instruction qui s'arrête sur une erreur n'appelle que \c _before, puis
+ * \c _fault.
+ */
+typedef struct Hooks
+{
+    Hook_Before _before;	//!< Avant chaque instruction
+    Hook_Access _read;		//!< Après chaque lecture de donnée, pile comprise
+    Hook_Access _write;		//!< Après chaque écriture de donnée, pile comprise
+    Hook_Branch _branch;	//!< Après chaque BRANCH
+    Hook_Transfer _call;	//!< Après chaque CALL effectué
+    Hook_Transfer _ret;		//!< Après chaque RET
+    Hook_Fault _fault;		//!< Après une erreur d'exécution
+    void *_ctx;			//!< Premier argument de chaque crochet
+} Hooks;
+
+//! Attachement des crochets d'une analyse à une machine
+/*!
+ * La structure n'est pas copiée : elle doit rester valide, et ses champs
+ * inchangés pendant chaque exécution, jusqu'à hooks_detach(). Les crochets
+ * précédents sont remplacés.
+ *
+ * \param pmach la machine
+ * \param hooks les crochets
+ */
+void hooks_attach(Machine *pmach, const Hooks *hooks);
+
+//! Détachement des crochets d'une machine
+/*!
+ * \param pmach la machine
+ */
+void hooks_detach(Machine *pmach);
+
+//! Crochets d'instruction renseignés
+/*!
+ * \param hooks les crochets, ou NULL
+ * \return la combinaison de \link Hook_Kind \endlink ; 0 si la machine doit
+ * être exécutée par son moteur
+ */
+unsigned hooks_mask(const Hooks *hooks);
+
+//! Exécution instrumentée jusqu'à \c HALT
+/*!
+ * Appelée par simul() à la place du moteur d'exécution quand hooks_mask()
+ * n'est pas nul. Les instructions sont exécutées une à une, superinstructions
+ * décomposées, dans la boucle spécialisée pour les crochets renseignés. Le
+ * niveau de trace est respecté.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_hooked(Machine *pmach);
+
+#endif
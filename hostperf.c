@@ -0,0 +1,163 @@
+/*!
+ * \file hostperf.c
+ * \brief Compteurs matériels de l'hôte autour de la simulation.
+ *
+ * La glibc n'enveloppe pas \c perf_event_open() : l'appel système est fait
+ * directement. Un compteur peut être partagé par le noyau avec d'autres
+ * (multiplexage) ; sa valeur est alors extrapolée à toute la durée de la
+ * mesure, d'après les temps d'activation et d'exécution rendus avec elle.
+ */
+
+#include "hostperf.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#   include <linux/perf_event.h>
+#   include <sys/ioctl.h>
+#   include <sys/syscall.h>
+#endif
+
+//! Nom de chaque compteur dans le rapport
+static const char *counter_names[HOSTPERF_NCOUNTERS] = {
+	[HOSTPERF_CYCLES] = "cycles",
+	[HOSTPERF_INSTRUCTIONS] = "instructions",
+	[HOSTPERF_BRANCH_MISSES] = "branch-misses",
+	[HOSTPERF_L1D_MISSES] = "L1d-misses",
+	[HOSTPERF_TASK_CLOCK] = "task-clock-ns",
+};
+
+#ifdef __linux__
+//! Événement \c perf_event de chaque compteur : type et configuration
+static const struct
+{
+	uint32_t _type;		//!< Famille d'événements
+	uint64_t _config;	//!< Événement dans la famille
+} counter_events[HOSTPERF_NCOUNTERS] = {
+	[HOSTPERF_CYCLES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[HOSTPERF_INSTRUCTIONS] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[HOSTPERF_BRANCH_MISSES] = { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[HOSTPERF_L1D_MISSES] = { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+				  | PERF_COUNT_HW_CACHE_OP_READ << 8
+				  | PERF_COUNT_HW_CACHE_RESULT_MISS << 16 },
+	[HOSTPERF_TASK_CLOCK] = { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+#endif
+
+//! Ouverture des compteurs, arrêtés
+/*!
+ * \param hc les compteurs
+ * \param inherit vrai pour compter aussi les threads et processus créés ensuite
+ * \return vrai si au moins un compteur est disponible
+ */
+bool hostperf_open(Host_Counters *hc, bool inherit)
+{
+	bool any = false;
+	memset(hc, 0, sizeof(*hc));
+	for (unsigned c = 0; c < HOSTPERF_NCOUNTERS; c++) {
+#ifdef __linux__
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.size = sizeof(attr);
+		attr.type = counter_events[c]._type;
+		attr.config = counter_events[c]._config;
+		attr.disabled = 1;
+		attr.inherit = inherit;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+		hc->_fds[c] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+		hc->_errors[c] = hc->_fds[c] < 0 ? errno : 0;
+#else
+		hc->_fds[c] = -1;
+		hc->_errors[c] = ENOSYS;
+#endif
+		any |= hc->_fds[c] >= 0;
+	}
+	return any;
+}
+
+//! Remise à zéro et démarrage des compteurs disponibles
+/*!
+ * \param hc les compteurs
+ */
+void hostperf_start(Host_Counters *hc)
+{
+#ifdef __linux__
+	for (unsigned c = 0; c < HOSTPERF_NCOUNTERS; c++)
+		if (hc->_fds[c] >= 0) {
+			ioctl(hc->_fds[c], PERF_EVENT_IOC_RESET, 0);
+			ioctl(hc->_fds[c], PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+}
+
+//! Arrêt et lecture des compteurs disponibles
+/*!
+ * Un compteur illisible devient indisponible.
+ *
+ * \param hc les compteurs
+ */
+void hostperf_stop(Host_Counters *hc)
+{
+#ifdef __linux__
+	for (unsigned c = 0; c < HOSTPERF_NCOUNTERS; c++)
+		if (hc->_fds[c] >= 0)
+			ioctl(hc->_fds[c], PERF_EVENT_IOC_DISABLE, 0);
+
+	for (unsigned c = 0; c < HOSTPERF_NCOUNTERS; c++) {
+		if (hc->_fds[c] < 0)
+			continue;
+		//Valeur, temps d'activation, temps d'exécution :
+		uint64_t buf[3];
+		if (read(hc->_fds[c], buf, sizeof(buf)) != sizeof(buf)) {
+			hc->_errors[c] = errno ? errno : EIO;
+			close(hc->_fds[c]);
+			hc->_fds[c] = -1;
+			continue;
+		}
+		hc->_values[c] = buf[0];
+		hc->_scaled[c] = buf[2] != 0 && buf[2] < buf[1];
+		if (hc->_scaled[c])
+			hc->_values[c] = (uint64_t) ((double) buf[0] * buf[1] / buf[2]);
+	}
+#endif
+}
+
+//! Affichage des compteurs, par instruction simulée
+/*!
+ * \param hc les compteurs
+ * \param instrs nombre d'instructions simulées
+ */
+void hostperf_report(const Host_Counters *hc, uint64_t instrs)
+{
+	printf("\n*** Host counters: %llu guest instructions ***\n\n", (unsigned long long) instrs);
+	printf("%-14s %16s %14s\n", "counter", "total", "per instr.");
+	for (unsigned c = 0; c < HOSTPERF_NCOUNTERS; c++) {
+		if (hc->_fds[c] < 0)
+			printf("%-14s %16s %14s  (%s)\n", counter_names[c], "n/a", "n/a", strerror(hc->_errors[c]));
+		else
+			printf("%-14s %16llu %14.3f%s\n", counter_names[c], (unsigned long long) hc->_values[c],
+			       instrs ? (double) hc->_values[c] / instrs : 0.0, hc->_scaled[c] ? "  (scaled)" : "");
+	}
+
+	if (hc->_fds[HOSTPERF_CYCLES] >= 0 && hc->_fds[HOSTPERF_INSTRUCTIONS] >= 0
+	    && hc->_values[HOSTPERF_CYCLES] != 0)
+		printf("%-14s %16.3f\n", "host IPC",
+		       (double) hc->_values[HOSTPERF_INSTRUCTIONS] / hc->_values[HOSTPERF_CYCLES]);
+}
+
+//! Fermeture des compteurs
+/*!
+ * \param hc les compteurs
+ */
+void hostperf_close(Host_Counters *hc)
+{
+	for (unsigned c = 0; c < HOSTPERF_NCOUNTERS; c++)
+		if (hc->_fds[c] >= 0) {
+			close(hc->_fds[c]);
+			hc->_fds[c] = -1;
+		}
+}
@@ -0,0 +1,83 @@
+#ifndef _HOSTPERF_H_
+#define _HOSTPERF_H_
+
+/*!
+ * \file hostperf.h
+ * \brief Compteurs matériels de l'hôte autour de la simulation.
+ *
+ * Les compteurs de performance du processeur hôte (\c perf_event_open() de
+ * Linux) mesurent ce que coûte au simulateur chaque instruction simulée :
+ * cycles, instructions de l'hôte, branchements mal prédits (le dispatch des
+ * moteurs), défauts du cache de données L1 (les accès à \c _data) et temps
+ * processeur. Seul le code utilisateur est compté.
+ *
+ * Chaque compteur est ouvert séparément : un compteur refusé par le système
+ * (noyau sans \c perf_event, \c perf_event_paranoid trop strict, machine
+ * virtuelle sans PMU, événement inconnu du processeur) est signalé comme
+ * indisponible, les autres sont mesurés normalement. Hors Linux, aucun ne
+ * l'est.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//! Compteurs mesurés
+typedef enum
+{
+    HOSTPERF_CYCLES,		//!< Cycles
+    HOSTPERF_INSTRUCTIONS,	//!< Instructions de l'hôte
+    HOSTPERF_BRANCH_MISSES,	//!< Branchements mal prédits
+    HOSTPERF_L1D_MISSES,	//!< Défauts de lecture du cache de données L1
+    HOSTPERF_TASK_CLOCK,	//!< Temps processeur en nanosecondes, compté par le
+				//!< noyau : disponible même sans compteurs matériels
+    HOSTPERF_NCOUNTERS		//!< Nombre de compteurs
+} Hostperf_Counter;
+
+//! Compteurs de l'hôte
+typedef struct
+{
+    int _fds[HOSTPERF_NCOUNTERS];	//!< Descripteur de chaque compteur, -1 s'il est indisponible
+    int _errors[HOSTPERF_NCOUNTERS];	//!< \c errno de l'ouverture d'un compteur indisponible
+    uint64_t _values[HOSTPERF_NCOUNTERS];//!< Valeurs lues par hostperf_stop()
+    bool _scaled[HOSTPERF_NCOUNTERS];	//!< Valeur extrapolée : compteur partagé avec d'autres
+} Host_Counters;
+
+//! Ouverture des compteurs, arrêtés
+/*!
+ * \param hc les compteurs
+ * \param inherit vrai pour compter aussi les threads et processus créés
+ * ensuite par le processus (voir batch.h)
+ * \return vrai si au moins un compteur est disponible
+ */
+bool hostperf_open(Host_Counters *hc, bool inherit);
+
+//! Remise à zéro et démarrage des compteurs disponibles
+/*!
+ * \param hc les compteurs
+ */
+void hostperf_start(Host_Counters *hc);
+
+//! Arrêt et lecture des compteurs disponibles
+/*!
+ * \param hc les compteurs
+ */
+void hostperf_stop(Host_Counters *hc);
+
+//! Affichage des compteurs, par instruction simulée
+/*!
+ * Une ligne par compteur : la valeur totale et la valeur par instruction
+ * simulée, ou la raison de son absence ; puis les instructions de l'hôte par
+ * cycle.
+ *
+ * \param hc les compteurs, lus par hostperf_stop()
+ * \param instrs nombre d'instructions simulées pendant la mesure
+ */
+void hostperf_report(const Host_Counters *hc, uint64_t instrs);
+
+//! Fermeture des compteurs
+/*!
+ * \param hc les compteurs
+ */
+void hostperf_close(Host_Counters *hc);
+
+#endif
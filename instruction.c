@@ -14,48 +14,136 @@ const char* cop_names[] = { "ILLOP", "NOP", "LOAD", "STORE", "ADD", "SUB", "BRAN
 //! Chaines de caracteres correspondant aux codes conditions
 const char* condition_names[] = { "NC", "EQ", "NE", "GT", "GE", "LT", "LE" };
 
+//! Copie d'une chaîne dans un tampon.
+/*!
+ * \param buf tampon de destination
+ * \param str la chaîne
+ * \return la fin de la chaîne copiée dans \c buf
+ */
+static char *put_string(char *buf, const char *str) {
+	while (*str)
+		*buf++ = *str++;
+	return buf;
+}
+
+//! Écriture d'un entier en décimal (comme printf("%0*d")).
+/*!
+ * \param buf tampon de destination
+ * \param value l'entier
+ * \param width nombre minimal de chiffres
+ * \param plus vrai pour écrire le signe + d'un entier positif (comme "%+d")
+ * \return la fin de l'entier écrit dans \c buf
+ */
+static char *put_decimal(char *buf, int value, int width, bool plus) {
+	char digits[12];
+	int n = 0;
+	unsigned magnitude = value < 0 ? 0u - (unsigned) value : (unsigned) value;
+
+	do {
+		digits[n++] = '0' + magnitude % 10;
+		magnitude /= 10;
+	} while (magnitude);
+	while (n < width)
+		digits[n++] = '0';
+	if (value < 0)
+		*buf++ = '-';
+	else if (plus)
+		*buf++ = '+';
+	while (n)
+		*buf++ = digits[--n];
+	return buf;
+}
+
+//! Écriture d'un entier en hexadécimal (comme printf("%0*x")).
+/*!
+ * \param buf tampon de destination
+ * \param value l'entier
+ * \param width nombre minimal de chiffres
+ * \return la fin de l'entier écrit dans \c buf
+ */
+static char *put_hex(char *buf, unsigned value, int width) {
+	char digits[8];
+	int n = 0;
+
+	do {
+		digits[n++] = "0123456789abcdef"[value & 0xf];
+		value >>= 4;
+	} while (value);
+	while (n < width)
+		digits[n++] = '0';
+	while (n)
+		*buf++ = digits[--n];
+	return buf;
+}
+
 //! Impression du registre d'une instruction sous forme lisible.
 //! Affiche le registre sous la forme R0i si 0 < i <= 9 ou Ri si i > 9.
 /*!
+ * \param buf tampon de destination
  * \param instr l'instruction à imprimer
+ * \return la fin du texte écrit dans \c buf
  */
-void print_register(Instruction instr) {
-	printf("R%02d, ", (int) instr.instr_generic._regcond);
+static char *sprint_register(char *buf, Instruction instr) {
+	*buf++ = 'R';
+	buf = put_decimal(buf, instr.instr_generic._regcond, 2, false);
+	return put_string(buf, ", ");
 }
 
 //! Impression du code condition d'une instruction sous forme lisible.
 /*!
+ * \param buf tampon de destination
  * \param instr l'instruction à imprimer
+ * \return la fin du texte écrit dans \c buf
  */
-void print_condition(Instruction instr) {
-	printf("%s ", condition_names[instr.instr_generic._regcond]);
+static char *sprint_condition(char *buf, Instruction instr) {
+	//Une condition illégale n'a pas de nom :
+	unsigned cond = instr.instr_generic._regcond;
+	buf = put_string(buf, cond <= LAST_CONDITION ? condition_names[cond] : "??");
+	*buf++ = ' ';
+	return buf;
 }
 
 //! Impression des opérandes d'une instruction sous forme lisible.
 /*!
+ * \param buf tampon de destination
  * \param instr l'instruction à imprimer
+ * \return la fin du texte écrit dans \c buf
  */
-void print_op(Instruction instr) {
+static char *sprint_op(char *buf, Instruction instr) {
 	if (instr.instr_generic._immediate) { // Si I = 1 : Immediat
-		printf("#%d", instr.instr_immediate._value);
+		*buf++ = '#';
+		return put_decimal(buf, instr.instr_immediate._value, 1, false);
 	} else {				
 		if (instr.instr_generic._indexed) { // Si I = 0 et X = 1 : Adressage indexe
-			printf("%+d[", (int) instr.instr_indexed._offset); // Offset sous la forme +/-offset
-			printf("R%02d]", (int) instr.instr_indexed._rindex); // Registre pour l'adressage indirect [R..]
+			// Offset sous la forme +/-offset
+			buf = put_decimal(buf, instr.instr_indexed._offset, 1, true);
+			// Registre pour l'adressage indirect [R..]
+			buf = put_string(buf, "[R");
+			buf = put_decimal(buf, instr.instr_indexed._rindex, 2, false);
+			*buf++ = ']';
+			return buf;
 		} else { // Si I = 0 et X = 0 : Adressage direct
-			printf("@%04x", (int) instr.instr_absolute._address);	
+			*buf++ = '@';
+			return put_hex(buf, instr.instr_absolute._address, 4);
 		}
 	}
 }
 
-//! Impression d'une instruction sous forme lisible (désassemblage)
+//! Impression d'une instruction sous forme lisible dans un tampon
 /*!
+ * \param buf tampon de destination (au moins \c INSTR_TEXT_SIZE caractères)
  * \param instr l'instruction à imprimer
  * \param addr son adresse
+ * \return le nombre de caractères écrits, sans compter le zéro final
  */
-void print_instruction(Instruction instr, unsigned addr) {
-	printf("%s ", cop_names[instr.instr_generic._cop]);
-	switch (instr.instr_generic._cop) {
+int sprint_instruction(char *buf, Instruction instr, unsigned addr) {
+	(void) addr;
+	char *end = buf;
+	//Un code opération inconnu n'a pas de nom :
+	Code_Op cop = instr.instr_generic._cop;
+	end = put_string(end, cop <= LAST_COP ? cop_names[cop] : "???");
+	*end++ = ' ';
+	switch (cop) {
 		case ILLOP:
 		case NOP:
 		case RET:
@@ -65,17 +153,30 @@ void print_instruction(Instruction instr, unsigned addr) {
 		case STORE:
 		case ADD:
 		case SUB:
-			print_register(instr); 
-			print_op(instr);
+			end = sprint_register(end, instr); 
+			end = sprint_op(end, instr);
 			break;
 		case BRANCH:
 		case CALL:
-			print_condition(instr);
-			print_op(instr);
+			end = sprint_condition(end, instr);
+			end = sprint_op(end, instr);
 			break;
 		case PUSH:
 		case POP:
-			print_op(instr);
+			end = sprint_op(end, instr);
 			break;
 	}
+	*end = '\0';
+	return end - buf;
+}
+
+//! Impression d'une instruction sous forme lisible (désassemblage)
+/*!
+ * \param instr l'instruction à imprimer
+ * \param addr son adresse
+ */
+void print_instruction(Instruction instr, unsigned addr) {
+	char buf[INSTR_TEXT_SIZE];
+	sprint_instruction(buf, instr, addr);
+	fputs(buf, stdout);
 }
@@ -136,4 +136,19 @@ extern const char *condition_names[];
  */
 void print_instruction(Instruction instr, unsigned addr);
 
+//! Taille suffisante pour la forme imprimable d'une instruction
+#define INSTR_TEXT_SIZE 48
+
+//! Impression d'une instruction sous forme lisible dans un tampon
+/*!
+ * C'est le texte affiché par print_instruction(), sans passer par la sortie
+ * standard.
+ *
+ * \param buf tampon de destination (au moins \c INSTR_TEXT_SIZE caractères)
+ * \param instr l'instruction à imprimer
+ * \param addr son adresse
+ * \return le nombre de caractères écrits
+ */
+int sprint_instruction(char *buf, Instruction instr, unsigned addr);
+
 #endif
@@ -0,0 +1,792 @@
+/*!
+ * \file jit.c
+ * \brief Traduction dynamique des blocs de base en code x86-64.
+ *
+ * Organisation du code natif :
+ *
+ *   - le tampon commence par un prologue, appelé depuis le C comme une
+ *   fonction <tt>int entry(Machine *pmach, void *block)</tt>, qui range
+ *   \c pmach dans \c rbx, le segment de données dans \c r12 et la table des
+ *   blocs dans \c r13, puis saute dans le bloc ; et par l'épilogue commun qui
+ *   revient au C avec, dans \c eax, la raison de la sortie ;
+ *
+ *   - les registres de la machine simulée restent dans la structure
+ *   \link Machine \endlink, adressés par rapport à \c rbx ;
+ *
+ *   - chaque sortie d'un bloc range l'adresse de l'instruction suivante dans
+ *   \c _pc avant de revenir au C, de sorte que l'état de la machine est
+ *   toujours à jour lorsque le C reprend la main ;
+ *
+ *   - chaque sortie d'un bloc, chaînée ou non, ajoute à \c _instrs le nombre
+ *   d'instructions du bloc exécutées : une addition par bloc, et non par
+ *   instruction.
+ *
+ * Le tampon n'est jamais à la fois inscriptible et exécutable : il est
+ * inscriptible pendant la traduction et le chaînage des blocs, exécutable
+ * (et non inscriptible) pendant l'exécution du code natif.
+ */
+
+#define _GNU_SOURCE	// MAP_ANONYMOUS
+
+#include "jit.h"
+#include "threaded.h"
+#include "exec.h"
+#include "exec_inline.h"
+#include "decode.h"
+#include "error.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __x86_64__
+
+#include <sys/mman.h>
+
+//! Nombre maximal d'instructions traduites dans un bloc
+#define JIT_MAX_BLOCK 32
+
+//! Taille maximale du code natif d'une instruction (en octets)
+#define JIT_MAX_INSTR 256
+
+//! Taille du tampon de code natif ; il est vidé lorsqu'il est plein
+#define JIT_CODE_SIZE (4 << 20)
+
+//! Raisons de sortie du code natif autres qu'une sortie chaînable
+enum
+{
+	EXIT_INTERPRET = -1,	//!< Exécuter l'instruction \c _pc par sa micro-opération
+	EXIT_LOOKUP = -2,	//!< Cible indirecte \c _pc pas encore traduite
+};
+
+//! Numéros des registres de l'hôte utilisés
+enum
+{
+	EAX = 0,
+	ECX = 1,
+	EDX = 2,
+	EBX = 3,
+	ESI = 6,
+};
+
+//! Codes de condition x86 (second octet de \c Jcc rel32 moins 0x80)
+enum
+{
+	X86_B = 0x2,		//!< Inférieur (non signé), retenue
+	X86_AE = 0x3,		//!< Supérieur ou égal (non signé), pas de retenue
+	X86_A = 0x7,		//!< Strictement supérieur (non signé)
+};
+
+//! Déplacement d'un champ de la machine par rapport à \c rbx
+#define OFF(field) ((int32_t) offsetof(Machine, field))
+
+//! Déplacement d'un registre général par rapport à \c rbx
+#define OFF_REG(r) (OFF(_registers) + (int32_t) sizeof(Word) * (r))
+
+//! Déplacement du pointeur de pile
+#define OFF_SP OFF_REG(NREGISTERS - 1)
+
+//! Sortie chaînable d'un bloc vers une adresse statique
+typedef struct
+{
+	uint8_t *_site;		//!< Saut \c jmp rel32 à corriger
+	unsigned _target;	//!< Adresse cible dans le segment de texte
+} Jit_Exit;
+
+//! État du traducteur
+typedef struct
+{
+	Machine *_pmach;	//!< Machine dont on traduit le programme
+	uint8_t *_code;		//!< Tampon de code exécutable
+	uint8_t *_start;	//!< Début de la zone des blocs
+	uint8_t *_ptr;		//!< Prochain octet libre
+	uint8_t *_epilogue;	//!< Retour au C
+	int (*_entry)(Machine *pmach, void *block); //!< Prologue
+	void **_blocks;		//!< Point d'entrée traduit de chaque adresse, ou NULL
+	Jit_Exit *_exits;	//!< Sorties chaînables
+	unsigned _nexits;	//!< Nombre de sorties chaînables
+	unsigned _maxexits;	//!< Capacité de \c _exits
+	unsigned _flushes;	//!< Nombre de vidages du tampon
+	unsigned _block_pc;	//!< Adresse de début du bloc en cours de traduction
+	bool _writable;		//!< Tampon inscriptible (sinon exécutable)
+} Jit;
+
+//! Écriture d'un octet de code.
+static inline void emit8(Jit *jit, uint8_t byte)
+{
+	*jit->_ptr++ = byte;
+}
+
+//! Écriture d'un mot de 32 bits de code.
+static inline void emit32(Jit *jit, uint32_t word)
+{
+	memcpy(jit->_ptr, &word, sizeof(word));
+	jit->_ptr += sizeof(word);
+}
+
+//! Correction d'un déplacement relatif de 32 bits.
+/*!
+ * \param rel l'adresse du champ rel32
+ * \param target l'adresse visée
+ */
+static void patch_rel32(uint8_t *rel, const uint8_t *target)
+{
+	int32_t offset = (int32_t) (target - (rel + 4));
+	memcpy(rel, &offset, sizeof(offset));
+}
+
+//! <tt>op reg, [rbx + disp32]</tt> : accès à un champ de la machine.
+static void emit_rbx(Jit *jit, uint8_t op, int reg, int32_t disp)
+{
+	emit8(jit, op);
+	emit8(jit, 0x80 | reg << 3 | EBX);
+	emit32(jit, disp);
+}
+
+//! <tt>op reg, [r12 + index * 4]</tt> : accès à un mot de données.
+static void emit_data(Jit *jit, uint8_t op, int reg, int index)
+{
+	emit8(jit, 0x41);
+	emit8(jit, op);
+	emit8(jit, reg << 3 | 4);
+	emit8(jit, 0x80 | index << 3 | 4);
+}
+
+//! <tt>mov reg, imm32</tt>.
+static void emit_mov_imm(Jit *jit, int reg, uint32_t imm)
+{
+	emit8(jit, 0xB8 + reg);
+	emit32(jit, imm);
+}
+
+//! <tt>jmp rel32</tt> ; retourne l'adresse du champ rel32.
+static uint8_t *emit_jmp(Jit *jit, const uint8_t *target)
+{
+	emit8(jit, 0xE9);
+	uint8_t *rel = jit->_ptr;
+	emit32(jit, 0);
+	if (target != NULL)
+		patch_rel32(rel, target);
+	return rel;
+}
+
+//! <tt>jcc rel32</tt> ; retourne l'adresse du champ rel32.
+static uint8_t *emit_jcc(Jit *jit, int cc, const uint8_t *target)
+{
+	emit8(jit, 0x0F);
+	emit8(jit, 0x80 + cc);
+	uint8_t *rel = jit->_ptr;
+	emit32(jit, 0);
+	if (target != NULL)
+		patch_rel32(rel, target);
+	return rel;
+}
+
+//! Décompte des instructions du bloc qui précèdent l'adresse \c pc.
+static void emit_count(Jit *jit, unsigned pc)
+{
+	unsigned n = pc - jit->_block_pc;
+	if (n == 0)
+		return;
+	emit8(jit, 0x48);			// add qword [rbx + _instrs], n
+	emit_rbx(jit, 0x81, 0, OFF(_instrs));
+	emit32(jit, n);
+}
+
+//! Retour au C : <tt>_pc = pc</tt>, raison \c why.
+static void emit_return(Jit *jit, unsigned pc, int why)
+{
+	emit8(jit, 0xC7);			// mov dword [rbx + _pc], pc
+	emit8(jit, 0x80 | EBX);
+	emit32(jit, OFF(_pc));
+	emit32(jit, pc);
+	emit_mov_imm(jit, EAX, why);
+	emit_jmp(jit, jit->_epilogue);
+}
+
+//! Sortie vers le C avant l'instruction \c pc, raison \c why.
+static void emit_leave(Jit *jit, unsigned pc, int why)
+{
+	emit_count(jit, pc);
+	emit_return(jit, pc, why);
+}
+
+//! Code de sortie vers l'interpréteur pour l'instruction \c pc.
+/*!
+ * Il est placé avant le code de l'instruction, que l'on saute : les
+ * vérifications de l'instruction y reviennent par un saut conditionnel.
+ *
+ * \return l'adresse du code de sortie
+ */
+static uint8_t *emit_fail(Jit *jit, unsigned pc)
+{
+	emit8(jit, 0xEB);			// jmp court par-dessus la sortie
+	uint8_t *skip = jit->_ptr;
+	emit8(jit, 0);
+	uint8_t *fail = jit->_ptr;
+	emit_leave(jit, pc, EXIT_INTERPRET);
+	*skip = (uint8_t) (jit->_ptr - (skip + 1));
+	return fail;
+}
+
+//! Sortie chaînable vers l'adresse statique \c target.
+/*!
+ * Le saut initial mène au code de sortie qui le suit ; il sera corrigé pour
+ * mener directement au bloc \c target dès que celui-ci sera traduit. Les
+ * instructions du bloc qui précèdent \c done ont été exécutées.
+ */
+static void emit_exit(Jit *jit, unsigned done, unsigned target)
+{
+	emit_count(jit, done);
+	if (jit->_nexits == jit->_maxexits) {
+		jit->_maxexits = jit->_maxexits ? 2 * jit->_maxexits : 256;
+		jit->_exits = realloc(jit->_exits, jit->_maxexits * sizeof(Jit_Exit));
+		if (jit->_exits == NULL) {
+			fprintf(stderr, "Erreur d'allocation dans <jit.c:emit_exit>\n");
+			exit(1);
+		}
+	}
+	unsigned id = jit->_nexits++;
+	jit->_exits[id]._site = jit->_ptr;
+	jit->_exits[id]._target = target;
+
+	uint8_t *rel = emit_jmp(jit, NULL);
+	patch_rel32(rel, jit->_ptr);
+	emit_return(jit, target, id);
+
+	//Cible déjà traduite : chaînage immédiat.
+	if (target < jit->_pmach->_textsize && jit->_blocks[target] != NULL)
+		patch_rel32(rel, jit->_blocks[target]);
+}
+
+//! Sortie indirecte vers l'adresse contenue dans \c ecx.
+/*!
+ * Si la cible est dans le segment de texte et déjà traduite, on y saute
+ * directement par la table des blocs (\c r13) ; sinon on revient au C. Les
+ * instructions du bloc qui précèdent \c done ont été exécutées.
+ */
+static void emit_indirect_exit(Jit *jit, unsigned done)
+{
+	emit_count(jit, done);
+	emit_rbx(jit, 0x89, ECX, OFF(_pc));	// mov [rbx + _pc], ecx
+	emit8(jit, 0x81);			// cmp ecx, textsize
+	emit8(jit, 0xF9);
+	emit32(jit, jit->_pmach->_textsize);
+	emit8(jit, 0x73);			// jae slow
+	uint8_t *slow1 = jit->_ptr;
+	emit8(jit, 0);
+	emit8(jit, 0x89);			// mov eax, ecx
+	emit8(jit, 0xC8);
+	emit8(jit, 0x49);			// mov rax, [r13 + rax * 8]
+	emit8(jit, 0x8B);
+	emit8(jit, 0x44);
+	emit8(jit, 0xC5);
+	emit8(jit, 0x00);
+	emit8(jit, 0x48);			// test rax, rax
+	emit8(jit, 0x85);
+	emit8(jit, 0xC0);
+	emit8(jit, 0x74);			// jz slow
+	uint8_t *slow2 = jit->_ptr;
+	emit8(jit, 0);
+	emit8(jit, 0xFF);			// jmp rax
+	emit8(jit, 0xE0);
+	*slow1 = (uint8_t) (jit->_ptr - (slow1 + 1));
+	*slow2 = (uint8_t) (jit->_ptr - (slow2 + 1));
+	emit_mov_imm(jit, EAX, EXIT_LOOKUP);
+	emit_jmp(jit, jit->_epilogue);
+}
+
+//! Adresse réelle de l'opérande dans \c ecx.
+static void emit_address(Jit *jit, const Micro_Op *uop)
+{
+	if (uop->_mode == MODE_INDEXED) {
+		emit_rbx(jit, 0x8B, ECX, OFF_REG(uop->_rindex));
+		emit8(jit, 0x81);		// add ecx, offset
+		emit8(jit, 0xC1);
+		emit32(jit, uop->_operand);
+	} else
+		emit_mov_imm(jit, ECX, uop->_operand);
+}
+
+//! check_data_addr() sur l'adresse contenue dans \c ecx.
+/*!
+ * Les adresses absolues ont été vérifiées à la traduction (voir
+ * translatable()) : seul l'adressage indexé est vérifié à l'exécution.
+ */
+static void emit_check_data(Jit *jit, const Micro_Op *uop, const uint8_t *fail)
+{
+	if (uop->_mode != MODE_INDEXED)
+		return;
+	emit_rbx(jit, 0x3B, ECX, OFF(_datasize));
+	emit_jcc(jit, X86_A, fail);
+}
+
+//! check_stack() sur la valeur de pointeur de pile contenue dans \c reg.
+static void emit_check_stack(Jit *jit, int reg, const uint8_t *fail)
+{
+	emit_rbx(jit, 0x3B, reg, OFF(_dataend));
+	emit_jcc(jit, X86_B, fail);
+	emit_rbx(jit, 0x3B, reg, OFF(_datasize));
+	emit_jcc(jit, X86_AE, fail);
+}
+
+//! Opérande source (immédiat ou mot de données) dans \c reg ; utilise \c ecx.
+static void emit_source(Jit *jit, const Micro_Op *uop, int reg, const uint8_t *fail)
+{
+	if (uop->_mode == MODE_IMMEDIATE) {
+		emit_mov_imm(jit, reg, uop->_operand);
+		return;
+	}
+	emit_address(jit, uop);
+	emit_check_data(jit, uop, fail);
+	emit_data(jit, 0x8B, reg, ECX);
+}
+
+//! refresh_cc() sur le résultat contenu dans \c eax.
+/*!
+ * refresh_cc() reçoit le résultat sous forme non signée : le code condition
+ * vaut \c CC_P si le résultat est non nul et \c CC_Z sinon.
+ */
+static void emit_refresh_cc(Jit *jit)
+{
+	emit_mov_imm(jit, EDX, CC_Z);
+	emit_mov_imm(jit, ESI, CC_P);
+	emit8(jit, 0x85);			// test eax, eax
+	emit8(jit, 0xC0);
+	emit8(jit, 0x0F);			// cmovne edx, esi
+	emit8(jit, 0x45);
+	emit8(jit, 0xD6);
+	emit_rbx(jit, 0x89, EDX, OFF(_cc));
+}
+
+//! Évaluation de la condition d'un BRANCH ou d'un CALL.
+/*!
+ * \return l'adresse du champ rel32 du saut pris si la condition est fausse
+ * (à corriger par l'appelant), ou NULL si l'instruction est inconditionnelle
+ */
+static uint8_t *emit_condition(Jit *jit, const Micro_Op *uop)
+{
+	if (uop->_reg == NC)
+		return NULL;
+	emit_rbx(jit, 0x8B, EAX, OFF(_cc));
+	emit_mov_imm(jit, EDX, condition_masks[uop->_reg]);
+	emit8(jit, 0x0F);			// bt edx, eax
+	emit8(jit, 0xA3);
+	emit8(jit, 0xC2);
+	return emit_jcc(jit, X86_AE, NULL);
+}
+
+//! L'instruction peut-elle être traduite ?
+/*!
+ * Ne sont pas traduites : \c HALT et les instructions mal formées, y compris
+ * les accès à une adresse absolue hors segment refusés par predecode(), ainsi
+ * que CALL et RET quand la machine suit ses appels (voir callgraph.h).
+ */
+static bool translatable(Jit *jit, const Micro_Op *uop)
+{
+	//Une superinstruction est traduite comme sa première instruction :
+	Uop_Kind kind = uop_base_kinds[uop->_kind];
+
+	switch (kind) {
+	case UOP_CALL_ABS:
+	case UOP_CALL_IDX:
+	case UOP_RET:
+		//Le graphe d'appels est tenu par l'interpréteur :
+		return jit->_pmach->_calls == NULL;
+	case UOP_FAULT:
+	case UOP_HALT:
+	case UOP_CALL_BADCOND:
+	case UOP_PUSH_BADADDR:
+		return false;
+	default:
+		return true;
+	}
+}
+
+//! Traduction d'une instruction.
+/*!
+ * \param jit le traducteur
+ * \param uop la micro-opération de l'instruction
+ * \param pc l'adresse de l'instruction
+ * \return vrai si l'instruction termine le bloc
+ */
+static bool emit_instr(Jit *jit, const Micro_Op *uop, unsigned pc)
+{
+	uint8_t *fail = NULL;
+	uint8_t *not_taken;
+	Uop_Kind kind = uop_base_kinds[uop->_kind];
+
+	//Sortie vers l'interpréteur si une vérification échoue :
+	if (kind == UOP_CALL_ABS || kind == UOP_CALL_IDX || kind == UOP_RET
+	    || kind == UOP_PUSH_IMM || kind == UOP_PUSH_ABS || kind == UOP_PUSH_IDX
+	    || kind == UOP_POP_ABS || kind == UOP_POP_IDX
+	    || (uop->_mode == MODE_INDEXED && kind != UOP_BRANCH_IDX))
+		fail = emit_fail(jit, pc);
+
+	switch (kind) {
+	case UOP_NOP:
+		return false;
+
+	case UOP_LOAD_IMM:
+	case UOP_LOAD_ABS:
+	case UOP_LOAD_IDX:
+	case UOP_LOAD_IMM_NOCC:
+	case UOP_LOAD_ABS_NOCC:
+	case UOP_LOAD_IDX_NOCC:
+		emit_source(jit, uop, EAX, fail);
+		emit_rbx(jit, 0x89, EAX, OFF_REG(uop->_reg));
+		if (uop_cc_effects[kind] == UOP_CC_WRITE)
+			emit_refresh_cc(jit);
+		return false;
+
+	case UOP_ADD_IMM:
+	case UOP_ADD_ABS:
+	case UOP_ADD_IDX:
+	case UOP_SUB_IMM:
+	case UOP_SUB_ABS:
+	case UOP_SUB_IDX:
+	case UOP_ADD_IMM_NOCC:
+	case UOP_ADD_ABS_NOCC:
+	case UOP_ADD_IDX_NOCC:
+	case UOP_SUB_IMM_NOCC:
+	case UOP_SUB_ABS_NOCC:
+	case UOP_SUB_IDX_NOCC:
+		emit_source(jit, uop, EDX, fail);
+		emit_rbx(jit, 0x8B, EAX, OFF_REG(uop->_reg));
+		//add eax, edx ou sub eax, edx :
+		bool add = kind == UOP_ADD_IMM || kind == UOP_ADD_ABS || kind == UOP_ADD_IDX
+			|| kind == UOP_ADD_IMM_NOCC || kind == UOP_ADD_ABS_NOCC || kind == UOP_ADD_IDX_NOCC;
+		emit8(jit, add ? 0x01 : 0x29);
+		emit8(jit, 0xD0);
+		emit_rbx(jit, 0x89, EAX, OFF_REG(uop->_reg));
+		if (uop_cc_effects[kind] == UOP_CC_WRITE)
+			emit_refresh_cc(jit);
+		return false;
+
+	case UOP_STORE_ABS:
+	case UOP_STORE_IDX:
+		emit_address(jit, uop);
+		emit_check_data(jit, uop, fail);
+		emit_rbx(jit, 0x8B, EAX, OFF_REG(uop->_reg));
+		emit_data(jit, 0x89, EAX, ECX);
+		return false;
+
+	case UOP_PUSH_IMM:
+	case UOP_PUSH_ABS:
+	case UOP_PUSH_IDX:
+		emit_rbx(jit, 0x8B, EAX, OFF_SP);
+		emit_check_stack(jit, EAX, fail);
+		emit_source(jit, uop, EDX, fail);
+		emit_data(jit, 0x89, EDX, EAX);		// mov [r12 + rax * 4], edx
+		emit8(jit, 0x83);			// sub eax, 1
+		emit8(jit, 0xE8);
+		emit8(jit, 0x01);
+		emit_rbx(jit, 0x89, EAX, OFF_SP);
+		return false;
+
+	case UOP_POP_ABS:
+	case UOP_POP_IDX:
+		emit_address(jit, uop);
+		emit_check_data(jit, uop, fail);
+		emit_rbx(jit, 0x8B, EDX, OFF_SP);
+		emit8(jit, 0x83);			// add edx, 1
+		emit8(jit, 0xC2);
+		emit8(jit, 0x01);
+		emit_check_stack(jit, EDX, fail);
+		emit_rbx(jit, 0x89, EDX, OFF_SP);
+		emit_data(jit, 0x8B, EAX, EDX);		// mov eax, [r12 + rdx * 4]
+		emit_data(jit, 0x89, EAX, ECX);		// mov [r12 + rcx * 4], eax
+		return false;
+
+	case UOP_BRANCH_ABS:
+	case UOP_BRANCH_IDX:
+		not_taken = emit_condition(jit, uop);
+		if (kind == UOP_BRANCH_ABS)
+			emit_exit(jit, pc + 1, uop->_operand);
+		else {
+			emit_address(jit, uop);
+			emit_indirect_exit(jit, pc + 1);
+		}
+		if (not_taken != NULL) {
+			patch_rel32(not_taken, jit->_ptr);
+			emit_exit(jit, pc + 1, pc + 1);
+		}
+		return true;
+
+	case UOP_CALL_ABS:
+	case UOP_CALL_IDX:
+		emit_rbx(jit, 0x8B, EAX, OFF_SP);
+		emit_check_stack(jit, EAX, fail);
+		not_taken = emit_condition(jit, uop);
+		emit_rbx(jit, 0x8B, EAX, OFF_SP);
+		emit_data(jit, 0xC7, 0, EAX);		// mov dword [r12 + rax * 4], pc + 1
+		emit32(jit, pc + 1);
+		emit8(jit, 0x83);			// sub eax, 1
+		emit8(jit, 0xE8);
+		emit8(jit, 0x01);
+		emit_rbx(jit, 0x89, EAX, OFF_SP);
+		if (kind == UOP_CALL_ABS)
+			emit_exit(jit, pc + 1, uop->_operand);
+		else {
+			emit_address(jit, uop);
+			emit_indirect_exit(jit, pc + 1);
+		}
+		if (not_taken != NULL) {
+			patch_rel32(not_taken, jit->_ptr);
+			emit_exit(jit, pc + 1, pc + 1);
+		}
+		return true;
+
+	case UOP_RET:
+		emit_rbx(jit, 0x8B, EDX, OFF_SP);
+		emit8(jit, 0x83);			// add edx, 1
+		emit8(jit, 0xC2);
+		emit8(jit, 0x01);
+		emit_check_stack(jit, EDX, fail);
+		emit_rbx(jit, 0x89, EDX, OFF_SP);
+		emit_data(jit, 0x8B, ECX, EDX);		// mov ecx, [r12 + rdx * 4]
+		emit_indirect_exit(jit, pc + 1);
+		return true;
+
+	default:
+		//Écarté par translatable() :
+		emit_leave(jit, pc, EXIT_INTERPRET);
+		return true;
+	}
+}
+
+//! Passage du tampon de code en écriture ou en exécution.
+/*!
+ * \param jit le traducteur
+ * \param writable vrai avant d'écrire dans le tampon, faux avant d'exécuter
+ */
+static void code_protect(Jit *jit, bool writable)
+{
+	if (jit->_writable == writable)
+		return;
+	if (mprotect(jit->_code, JIT_CODE_SIZE,
+		     writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+		fprintf(stderr, "Erreur de protection du code natif dans <jit.c:code_protect>\n");
+		exit(1);
+	}
+	jit->_writable = writable;
+}
+
+//! Vidage du tampon de code : toutes les traductions sont oubliées.
+static void flush(Jit *jit)
+{
+	memset(jit->_blocks, 0, jit->_pmach->_textsize * sizeof(void *));
+	jit->_ptr = jit->_start;
+	jit->_nexits = 0;
+	jit->_flushes++;
+}
+
+//! Traduction du bloc de base qui commence à l'adresse \c pc.
+/*!
+ * \return le point d'entrée du bloc, ou NULL si sa première instruction ne
+ * peut pas être traduite
+ */
+static void *compile_block(Jit *jit, unsigned pc)
+{
+	Machine *pmach = jit->_pmach;
+
+	if (!translatable(jit, &pmach->_uops[pc]))
+		return NULL;
+	code_protect(jit, true);
+	if (jit->_ptr + (JIT_MAX_BLOCK + 1) * JIT_MAX_INSTR > jit->_code + JIT_CODE_SIZE)
+		flush(jit);
+
+	uint8_t *block = jit->_ptr;
+	jit->_block_pc = pc;
+	//Enregistré d'abord : une boucle sur elle-même est chaînée immédiatement.
+	jit->_blocks[pc] = block;
+
+	unsigned n;
+	for (n = 0; n < JIT_MAX_BLOCK && pc + n < pmach->_textsize; n++) {
+		const Micro_Op *uop = &pmach->_uops[pc + n];
+		if (!translatable(jit, uop)) {
+			emit_leave(jit, pc + n, EXIT_INTERPRET);
+			return block;
+		}
+		if (emit_instr(jit, uop, pc + n))
+			return block;
+	}
+	//Bloc interrompu ou fin du texte : on continue à l'adresse suivante.
+	emit_exit(jit, pc + n, pc + n);
+	return block;
+}
+
+//! Chaînage d'une sortie statique vers son bloc cible.
+static void link_exit(Jit *jit, unsigned id)
+{
+	unsigned target = jit->_exits[id]._target;
+	unsigned flushes = jit->_flushes;
+
+	if (target >= jit->_pmach->_textsize)
+		return;
+	void *block = jit->_blocks[target];
+	if (block == NULL)
+		block = compile_block(jit, target);
+	//La traduction a pu vider le tampon, et la sortie avec lui :
+	if (block != NULL && flushes == jit->_flushes) {
+		code_protect(jit, true);
+		patch_rel32(jit->_exits[id]._site + 1, block);
+	}
+}
+
+//! Initialisation du traducteur : tampon exécutable, prologue et épilogue.
+/*!
+ * Le tampon est rendu exécutable une première fois, pour s'assurer que le
+ * système l'accepte.
+ *
+ * \return faux si la mémoire exécutable ne peut être obtenue
+ */
+static bool jit_init(Jit *jit, Machine *pmach)
+{
+	memset(jit, 0, sizeof(*jit));
+	jit->_pmach = pmach;
+
+	jit->_code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (jit->_code == MAP_FAILED)
+		return false;
+	jit->_blocks = calloc(pmach->_textsize ? pmach->_textsize : 1, sizeof(void *));
+	if (jit->_blocks == NULL) {
+		munmap(jit->_code, JIT_CODE_SIZE);
+		return false;
+	}
+	jit->_ptr = jit->_code;
+	jit->_writable = true;
+
+	//Épilogue : pop r13 ; pop r12 ; pop rbx ; ret
+	jit->_epilogue = jit->_ptr;
+	emit8(jit, 0x41);
+	emit8(jit, 0x5D);
+	emit8(jit, 0x41);
+	emit8(jit, 0x5C);
+	emit8(jit, 0x5B);
+	emit8(jit, 0xC3);
+
+	//Prologue : push rbx ; push r12 ; push r13 ; mov rbx, rdi ;
+	//mov r12, [rbx + _data] ; mov r13, blocks ; jmp rsi
+	uint8_t *entry = jit->_ptr;
+	emit8(jit, 0x53);
+	emit8(jit, 0x41);
+	emit8(jit, 0x54);
+	emit8(jit, 0x41);
+	emit8(jit, 0x55);
+	emit8(jit, 0x48);
+	emit8(jit, 0x89);
+	emit8(jit, 0xFB);
+	emit8(jit, 0x4C);
+	emit_rbx(jit, 0x8B, 4, OFF(_data));
+	emit8(jit, 0x49);
+	emit8(jit, 0xBD);
+	uint64_t blocks = (uintptr_t) jit->_blocks;
+	memcpy(jit->_ptr, &blocks, sizeof(blocks));
+	jit->_ptr += sizeof(blocks);
+	emit8(jit, 0xFF);
+	emit8(jit, 0xE6);
+
+	jit->_entry = (int (*)(Machine *, void *)) entry;
+	jit->_start = jit->_ptr;
+
+	if (mprotect(jit->_code, JIT_CODE_SIZE, PROT_READ | PROT_EXEC) != 0) {
+		munmap(jit->_code, JIT_CODE_SIZE);
+		free(jit->_blocks);
+		return false;
+	}
+	jit->_writable = false;
+	return true;
+}
+
+//! Libération du traducteur.
+static void jit_free(Jit *jit)
+{
+	munmap(jit->_code, JIT_CODE_SIZE);
+	free(jit->_blocks);
+	free(jit->_exits);
+}
+
+//! Exécution de l'instruction \c _pc par sa micro-opération.
+/*!
+ * \return faux après l'exécution de \c HALT ; vrai sinon
+ */
+static bool interpret(Machine *pmach)
+{
+	if (pmach->_pc >= pmach->_textsize)
+		error(ERR_SEGTEXT, pmach->_pc - 1);
+	const Micro_Op *uop = &pmach->_uops[pmach->_pc++];
+	pmach->_instrs++;
+	//Une seule instruction, même au début d'une superinstruction :
+	return uop_handlers[uop_base_kinds[uop->_kind]](pmach, uop);
+}
+
+//! Exécution par traduction dynamique jusqu'à \c HALT
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_jit(Machine *pmach)
+{
+	Jit jit;
+
+	//Le code natif ne trace pas : toute trace, binaire comprise, est faite
+	//par le dispatch direct.
+	if (pmach->_trace != TRACE_OFF) {
+		simul_threaded(pmach);
+		return;
+	}
+
+	if (!jit_init(&jit, pmach)) {
+		fprintf(stderr, "Memoire executable indisponible, moteur 'threaded' utilise <jit.c:simul_jit>\n");
+		simul_threaded(pmach);
+		return;
+	}
+
+	//Sur une erreur, le code traduit est libéré avant de transmettre l'erreur :
+	Fault_Handler handler;
+	fault_push(&handler);
+	if (setjmp(handler._env)) {
+		jit_free(&jit);
+		fault_raise(handler._fault);
+	}
+
+	for (;;) {
+		if (pmach->_pc >= pmach->_textsize)
+			error(ERR_SEGTEXT, pmach->_pc - 1);
+
+		void *block = jit._blocks[pmach->_pc];
+		if (block == NULL)
+			block = compile_block(&jit, pmach->_pc);
+		if (block == NULL) {
+			//Première instruction non traduisible :
+			if (!interpret(pmach))
+				break;
+			continue;
+		}
+
+		code_protect(&jit, false);
+		int why = jit._entry(pmach, block);
+		if (why >= 0)
+			link_exit(&jit, why);
+		else if (why == EXIT_INTERPRET && !interpret(pmach))
+			break;
+	}
+
+	fault_pop(&handler);
+	jit_free(&jit);
+}
+
+#else
+
+//! Exécution par traduction dynamique : hôte non x86-64, repli.
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_jit(Machine *pmach)
+{
+	simul_threaded(pmach);
+}
+
+#endif
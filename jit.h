@@ -0,0 +1,38 @@
+#ifndef _JIT_H_
+#define _JIT_H_
+
+/*!
+ * \file jit.h
+ * \brief Traduction dynamique des blocs de base en code x86-64.
+ */
+
+#include "machine.h"
+
+//! Exécution par traduction dynamique jusqu'à \c HALT
+/*!
+ * Les blocs de base du segment de texte sont traduits à leur première
+ * exécution en code natif x86-64 : LOAD, STORE, ADD, SUB, BRANCH, CALL, RET,
+ * PUSH, POP et NOP, y compris l'évaluation des conditions et la mise à jour du
+ * code condition. Les blocs sont chaînés : la sortie d'un bloc vers une
+ * adresse statique est corrigée pour sauter directement dans le bloc cible
+ * dès que celui-ci est traduit, et les sorties indirectes (RET, adressage
+ * indexé) consultent la table des blocs sans repasser par le C.
+ *
+ * Tout ce que le code natif ne traite pas est confié aux micro-opérations :
+ * \c HALT, les instructions mal formées, et toute instruction dont une
+ * vérification (check_data_addr(), check_stack()) échoue. Dans ce dernier cas
+ * le code natif sort \e avant l'instruction, sans effet de bord, et c'est la
+ * micro-opération qui signale l'erreur : \c ERR_SEGDATA, \c ERR_SEGSTACK et
+ * les adresses d'erreur sont donc exactement celles de l'interpréteur.
+ *
+ * Le code natif ne trace pas : avec un niveau de trace autre que
+ * \c TRACE_OFF (trace binaire comprise), la machine est exécutée par le
+ * moteur \c ENGINE_THREADED, qui trace chaque instruction voulue. On s'y
+ * replie aussi si la mémoire exécutable ne peut être obtenue, ou sur un hôte
+ * autre que x86-64.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_jit(Machine *pmach);
+
+#endif
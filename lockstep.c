@@ -0,0 +1,365 @@
+/*!
+ * \file lockstep.c
+ * \brief Exécution simultanée de plusieurs machines qui partagent un programme.
+ *
+ * Les registres et le code condition du groupe sont des vecteurs de GNU C,
+ * une voie par machine. Seuls les opérandes immédiats sont communs à tout le
+ * groupe ; un opérande absolu ou indexé est lu dans le segment de chaque
+ * voie. Les voies inactives (machines sorties du groupe ou
+ * absentes) participent aux opérations vectorielles sans conséquence : les
+ * accès mémoire et les sorties du groupe ne sont faits que pour les voies
+ * actives.
+ *
+ * Une machine qui quitte le groupe y reprend son état : registres, code
+ * condition, \c _pc et instructions exécutées. Elle le quitte soit \e avant
+ * une instruction qui échouerait pour elle, que simul_run() exécutera à
+ * nouveau pour signaler l'erreur, soit \e après une instruction qui l'a menée
+ * ailleurs que la majorité du groupe.
+ */
+
+#include "lockstep.h"
+#include "decode.h"
+#include "exec_inline.h"
+#include "hooks.h"
+#include "sample.h"
+#include <string.h>
+
+//! Un mot par voie
+/*!
+ * Les vecteurs sont passés par adresse, et les fonctions qui en rendent un
+ * sont intégrées à la boucle d'exécution : la convention d'appel AVX, qui
+ * diffère selon que AVX est disponible ou non, ne s'applique jamais.
+ */
+#pragma GCC diagnostic ignored "-Wpsabi"
+typedef Word Lanes __attribute__((vector_size(LOCKSTEP_LANES * sizeof(Word))));
+
+//! Boucle d'exécution compilée pour AVX2 et pour le jeu d'instructions de
+//! base, la version utilisée étant choisie au chargement selon l'hôte.
+#if defined(__GNUC__) && defined(__x86_64__)
+#   define LOCKSTEP_TARGET __attribute__((target_clones("avx2", "default")))
+#else
+#   define LOCKSTEP_TARGET
+#endif
+
+//! Groupe de machines exécutées ensemble
+typedef struct
+{
+	Lanes _registers[NREGISTERS];	//!< Registres généraux, par registre
+	Lanes _cc;			//!< Codes condition
+	unsigned _pc;			//!< Adresse de l'instruction commune
+	unsigned _active;		//!< Voies actives (bit \c l pour la voie \c l)
+	uint64_t _steps;		//!< Instructions exécutées par le groupe
+	Machine *_machines[LOCKSTEP_LANES];//!< Machine de chaque voie
+	Word *_data[LOCKSTEP_LANES];	//!< Segment de données de chaque voie
+	const Micro_Op *_uops;		//!< Micro-opérations partagées
+	unsigned _textsize;		//!< Taille du segment de texte
+	unsigned _datasize;		//!< Taille du segment de données
+	unsigned _dataend;		//!< Première adresse libre après les données statiques
+} Lockstep;
+
+//! Vecteur dont toutes les voies valent \c w.
+EXEC_INLINE Lanes broadcast(Word w)
+{
+	return (Lanes) { 0 } + w;
+}
+
+//! Sortie du groupe des voies \c mask, à l'adresse de leur voie dans \c pc.
+static void leave(Lockstep *ls, unsigned mask, const Lanes *pc)
+{
+	for (unsigned l = 0; l < LOCKSTEP_LANES; l++) {
+		if (!(mask >> l & 1))
+			continue;
+		Machine *pmach = ls->_machines[l];
+		for (unsigned r = 0; r < NREGISTERS; r++)
+			pmach->_registers[r] = ls->_registers[r][l];
+		pmach->_cc = ls->_cc[l];
+		pmach->_pc = (*pc)[l];
+		pmach->_instrs += ls->_steps;
+	}
+	ls->_active &= ~mask;
+}
+
+//! Sortie du groupe des voies \c mask avant l'instruction en cours.
+EXEC_INLINE void fail(Lockstep *ls, unsigned mask)
+{
+	Lanes pc = broadcast(ls->_pc);
+	if (mask)
+		leave(ls, mask, &pc);
+}
+
+//! Adresses réelles d'une micro-opération en adressage absolu ou indexé.
+EXEC_INLINE Lanes address(const Lockstep *ls, const Micro_Op *uop)
+{
+	if (uop->_mode == MODE_INDEXED)
+		return ls->_registers[uop->_rindex] + (Word) uop->_operand;
+	return broadcast(uop->_operand);
+}
+
+//! Voies actives dont l'adresse indexée est hors du segment de données.
+/*!
+ * Une adresse absolue a été vérifiée au prédécodage (voir check_data_addr()).
+ */
+EXEC_INLINE unsigned bad_addresses(const Lockstep *ls, const Micro_Op *uop, const Lanes *addr)
+{
+	unsigned bad = 0;
+	if (uop->_mode == MODE_INDEXED)
+		for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+			if ((ls->_active >> l & 1) && (*addr)[l] > ls->_datasize)
+				bad |= 1u << l;
+	return bad;
+}
+
+//! Voies actives dont le pointeur de pile \c sp est hors de la pile (voir check_stack()).
+EXEC_INLINE unsigned bad_stack(const Lockstep *ls, const Lanes *sp)
+{
+	unsigned bad = 0;
+	for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+		if ((ls->_active >> l & 1) && ((*sp)[l] < ls->_dataend || (*sp)[l] >= ls->_datasize))
+			bad |= 1u << l;
+	return bad;
+}
+
+//! Opérandes source d'une micro-opération, immédiat ou lu dans chaque segment.
+EXEC_INLINE Lanes source(const Lockstep *ls, const Micro_Op *uop, const Lanes *addr)
+{
+	if (uop->_mode == MODE_IMMEDIATE)
+		return broadcast(uop->_operand);
+	Lanes value = { 0 };
+	for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+		if (ls->_active >> l & 1)
+			value[l] = ls->_data[l][(*addr)[l]];
+	return value;
+}
+
+//! Voies dont la condition d'une micro-opération est satisfaite (tous bits à 1).
+EXEC_INLINE Lanes condition(const Lockstep *ls, const Micro_Op *uop)
+{
+	return -((broadcast(condition_masks[uop->_reg]) >> ls->_cc) & 1);
+}
+
+//! Opération d'un LOAD, ADD ou SUB
+typedef enum { ARITH_LOAD, ARITH_ADD, ARITH_SUB } Arith;
+
+//! Exécute un LOAD, ADD ou SUB pour tout le groupe.
+/*!
+ * Le code condition est celui de refresh_cc() : \c CC_Z pour un résultat
+ * nul, \c CC_P sinon.
+ */
+EXEC_INLINE void exec_arith(Lockstep *ls, const Micro_Op *uop, Arith op, bool cc)
+{
+	Lanes addr = address(ls, uop);
+	fail(ls, bad_addresses(ls, uop, &addr));
+	Lanes src = source(ls, uop, &addr);
+
+	Lanes *reg = &ls->_registers[uop->_reg];
+	if (op == ARITH_LOAD)
+		*reg = src;
+	else if (op == ARITH_ADD)
+		*reg += src;
+	else
+		*reg -= src;
+	//(*reg == 0) vaut -1 dans les voies nulles : CC_P - 1 == CC_Z.
+	if (cc)
+		ls->_cc = broadcast(CC_P) + (Lanes) (*reg == 0);
+}
+
+//! Masque des voies dont le résultat d'une comparaison vectorielle est vrai.
+EXEC_INLINE unsigned lanes_mask(const Lanes *cmp)
+{
+	unsigned mask = 0;
+	for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+		mask |= ((*cmp)[l] & 1) << l;
+	return mask;
+}
+
+//! Adresse suivie par la majorité des voies actives.
+static unsigned majority(const Lockstep *ls, const Lanes *next)
+{
+	unsigned best = 0, leader = (*next)[__builtin_ctz(ls->_active)];
+	for (unsigned l = 0; l < LOCKSTEP_LANES; l++) {
+		if (!(ls->_active >> l & 1))
+			continue;
+		unsigned count = 0;
+		for (unsigned k = 0; k < LOCKSTEP_LANES; k++)
+			count += (ls->_active >> k & 1) && (*next)[k] == (*next)[l];
+		if (count > best) {
+			best = count;
+			leader = (*next)[l];
+		}
+	}
+	return leader;
+}
+
+//! Exécution du groupe tant qu'il compte au moins deux machines.
+/*!
+ * \return les voies arrêtées par \c HALT, sorties du groupe après celui-ci
+ */
+LOCKSTEP_TARGET
+static unsigned run(Lockstep *ls)
+{
+	while (__builtin_popcount(ls->_active) >= 2 && ls->_pc < ls->_textsize) {
+		const Micro_Op *uop = &ls->_uops[ls->_pc];
+		Lanes next = broadcast(ls->_pc + 1);
+		Lanes addr, sp, taken, value;
+		bool uniform = true;
+
+		switch (uop_base_kinds[uop->_kind]) {
+		case UOP_NOP:
+			break;
+
+		case UOP_HALT: {
+			unsigned halted = ls->_active;
+			ls->_steps++;
+			leave(ls, halted, &next);
+			return halted;
+		}
+
+		case UOP_LOAD_IMM: case UOP_LOAD_ABS: case UOP_LOAD_IDX:
+			exec_arith(ls, uop, ARITH_LOAD, true);
+			break;
+		case UOP_LOAD_IMM_NOCC: case UOP_LOAD_ABS_NOCC: case UOP_LOAD_IDX_NOCC:
+			exec_arith(ls, uop, ARITH_LOAD, false);
+			break;
+		case UOP_ADD_IMM: case UOP_ADD_ABS: case UOP_ADD_IDX:
+			exec_arith(ls, uop, ARITH_ADD, true);
+			break;
+		case UOP_ADD_IMM_NOCC: case UOP_ADD_ABS_NOCC: case UOP_ADD_IDX_NOCC:
+			exec_arith(ls, uop, ARITH_ADD, false);
+			break;
+		case UOP_SUB_IMM: case UOP_SUB_ABS: case UOP_SUB_IDX:
+			exec_arith(ls, uop, ARITH_SUB, true);
+			break;
+		case UOP_SUB_IMM_NOCC: case UOP_SUB_ABS_NOCC: case UOP_SUB_IDX_NOCC:
+			exec_arith(ls, uop, ARITH_SUB, false);
+			break;
+
+		case UOP_STORE_ABS: case UOP_STORE_IDX:
+			addr = address(ls, uop);
+			fail(ls, bad_addresses(ls, uop, &addr));
+			for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+				if (ls->_active >> l & 1)
+					ls->_data[l][addr[l]] = ls->_registers[uop->_reg][l];
+			break;
+
+		case UOP_BRANCH_ABS: case UOP_BRANCH_IDX:
+			taken = condition(ls, uop);
+			next = (address(ls, uop) & taken) | (next & ~taken);
+			uniform = false;
+			break;
+
+		case UOP_CALL_ABS: case UOP_CALL_IDX:
+			fail(ls, bad_stack(ls, &ls->_sp));
+			taken = condition(ls, uop);
+			for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+				if ((ls->_active >> l & 1) && taken[l])
+					ls->_data[l][ls->_sp[l]] = ls->_pc + 1;
+			ls->_sp += taken;		// taken vaut -1 : SP--
+			//L'adresse indexée est calculée après l'empilement, comme dans call() :
+			next = (address(ls, uop) & taken) | (next & ~taken);
+			uniform = false;
+			break;
+
+		case UOP_RET:
+			sp = ls->_sp + 1;
+			fail(ls, bad_stack(ls, &sp));
+			ls->_sp = sp;
+			for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+				if (ls->_active >> l & 1)
+					next[l] = ls->_data[l][sp[l]];
+			uniform = false;
+			break;
+
+		case UOP_PUSH_IMM: case UOP_PUSH_ABS: case UOP_PUSH_IDX:
+			fail(ls, bad_stack(ls, &ls->_sp));
+			addr = address(ls, uop);
+			fail(ls, bad_addresses(ls, uop, &addr));
+			value = source(ls, uop, &addr);
+			for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+				if (ls->_active >> l & 1)
+					ls->_data[l][ls->_sp[l]] = value[l];
+			ls->_sp -= 1;
+			break;
+
+		case UOP_POP_ABS: case UOP_POP_IDX:
+			addr = address(ls, uop);
+			fail(ls, bad_addresses(ls, uop, &addr));
+			sp = ls->_sp + 1;
+			fail(ls, bad_stack(ls, &sp));
+			ls->_sp = sp;
+			for (unsigned l = 0; l < LOCKSTEP_LANES; l++)
+				if (ls->_active >> l & 1)
+					ls->_data[l][addr[l]] = ls->_data[l][sp[l]];
+			break;
+
+		default:
+			//Instruction mal formée : l'erreur est signalée par simul_run().
+			fail(ls, ls->_active);
+			continue;
+		}
+
+		ls->_steps++;
+		unsigned pc = ls->_pc + 1;
+		if (!uniform && ls->_active) {
+			pc = next[__builtin_ctz(ls->_active)];
+			Lanes differ = next != broadcast(pc);
+			unsigned diverged = lanes_mask(&differ) & ls->_active;
+			if (diverged) {
+				pc = majority(ls, &next);
+				differ = next != broadcast(pc);
+				diverged = lanes_mask(&differ) & ls->_active;
+				leave(ls, diverged, &next);
+			}
+		}
+		ls->_pc = pc;
+	}
+
+	fail(ls, ls->_active);
+	return 0;
+}
+
+//! Exécution simultanée jusqu'à \c HALT ou jusqu'à une erreur
+/*!
+ * \param n nombre de machines
+ * \param machines les machines
+ * \param faults reçoit le résultat de chaque machine
+ */
+void simul_lockstep(unsigned n, Machine *machines[n], Fault faults[n])
+{
+	Lockstep ls;
+	memset(&ls, 0, sizeof(ls));
+	const Machine *first = machines[0];
+	ls._pc = first->_pc;
+	ls._uops = first->_uops;
+	ls._textsize = first->_textsize;
+	ls._datasize = first->_datasize;
+	ls._dataend = first->_dataend;
+
+	//Les machines qui ne commencent pas avec la première s'exécutent seules,
+	//comme celles dont chaque instruction doit être observée (trace, profil,
+	//échantillonnage, graphe d'appels, crochets) :
+	for (unsigned i = 0; i < n && i < LOCKSTEP_LANES; i++) {
+		Machine *pmach = machines[i];
+		if (pmach->_uops != ls._uops || pmach->_pc != ls._pc || pmach->_datasize != ls._datasize
+		    || pmach->_dataend != ls._dataend)
+			continue;
+		if (pmach->_trace != TRACE_OFF || pmach->_bintrace != NULL || pmach->_profile != NULL
+		    || pmach->_calls != NULL || sample_running(pmach) || hooks_mask(pmach->_hooks) != 0)
+			continue;
+		for (unsigned r = 0; r < NREGISTERS; r++)
+			ls._registers[r][i] = pmach->_registers[r];
+		ls._cc[i] = pmach->_cc;
+		ls._machines[i] = pmach;
+		ls._data[i] = pmach->_data;
+		ls._active |= 1u << i;
+	}
+
+	unsigned halted = run(&ls);
+
+	for (unsigned i = 0; i < n; i++) {
+		if (halted >> i & 1) {
+			warning(WARN_HALT, machines[i]->_pc - 1);
+			faults[i] = (Fault) { ERR_NOERROR, machines[i]->_pc - 1 };
+		} else
+			faults[i] = simul_run(machines[i], false);
+	}
+}
@@ -0,0 +1,47 @@
+#ifndef _LOCKSTEP_H_
+#define _LOCKSTEP_H_
+
+/*!
+ * \file lockstep.h
+ * \brief Exécution simultanée de plusieurs machines qui partagent un programme.
+ */
+
+#include "machine.h"
+
+//! Nombre maximal de machines exécutées ensemble (une par voie vectorielle)
+#define LOCKSTEP_LANES 8
+
+//! Exécution simultanée jusqu'à \c HALT ou jusqu'à une erreur
+/*!
+ * Les machines doivent exécuter le même programme : mêmes micro-opérations et
+ * mêmes tailles de segments, seul le contenu des segments de données et des
+ * registres pouvant différer. Leurs registres et leurs codes condition sont
+ * rangés par registre (un vecteur de \c LOCKSTEP_LANES voies par registre) et
+ * toutes les machines qui ont le même \c _pc exécutent chaque instruction
+ * ensemble : un LOAD, ADD ou SUB immédiat est une seule opération
+ * vectorielle sur l'hôte, AVX2 s'il le permet. En adressage absolu ou
+ * indexé, l'opérande est lu voie par voie, chaque machine ayant son propre
+ * segment de données, puis l'opération est vectorielle ; STORE, PUSH et POP
+ * sont faits voie par voie.
+ *
+ * Une machine quitte le groupe lorsque son \c _pc diffère de celui de la
+ * majorité (BRANCH, CALL ou RET dépendant des données), ou juste avant une
+ * instruction qui s'arrêterait sur une erreur ; le groupe est dissous quand
+ * il ne reste qu'une machine. Chaque machine sortie du groupe termine son
+ * exécution seule par simul_run(), avec son moteur \c _engine. L'état final
+ * de chaque machine, \c _instrs compris, est donc exactement celui qu'aurait
+ * produit simul_run().
+ *
+ * Une machine tracée (\c _trace autre que \c TRACE_OFF, trace binaire
+ * comprise), profilée, échantillonnée, dont les appels sont suivis ou qui a
+ * des crochets d'instruction n'entre pas dans le groupe : elle est exécutée
+ * seule par simul_run(), et chacune de ses instructions est observée.
+ *
+ * \param n nombre de machines, au plus \c LOCKSTEP_LANES
+ * \param machines les machines
+ * \param faults reçoit le résultat de chaque machine, comme celui de
+ * simul_run()
+ */
+void simul_lockstep(unsigned n, Machine *machines[n], Fault faults[n]);
+
+#endif
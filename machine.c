@@ -1,13 +1,22 @@
 #include "machine.h"
 #include "exec.h"
+#include "decode.h"
+#include "threaded.h"
+#include "verify.h"
+#include "jit.h"
 #include "debug.h"
 #include "error.h"
+#include "snapshot.h"
+#include "profile.h"
+#include "callgraph.h"
+#include "hooks.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <sys/mman.h>
 #include <string.h>
 
 //! Lecture d'un programme depuis un fichier binaire
@@ -22,7 +31,8 @@
  *    segment de texte (les instructions) ;
  *
  *    - une suite de \c datasize entiers non signés représentant le contenu initial du
- *    segment de données.
+ *    segment de données ; elle peut s'arrêter après les \c dataend premiers
+ *    (les données statiques), le reste du segment valant alors 0.
  *
  * Tous les entiers font 32 bits et les adresses de chaque segment commencent à
  * 0. La fonction initialise complétement la machine.
@@ -34,60 +44,141 @@
 void read_program(Machine *pmach, const char *programfile)
 {
 //  printf("Entree dans read_program\n");
-  int bits_read;
-  unsigned textsize;
-  unsigned datasize;
-  unsigned dataend;
+  unsigned header[3];
+  Snapshot_Header snapshot;
+  struct stat st;
   //Ouverture du fichier :
   int handle = open(programfile,O_RDONLY);
-  if(handle < 0) {
+  if(handle < 0 || fstat(handle, &st) != 0) {
     fprintf(stderr, "Erreur d'ouverture du fichier binaire dans <machine.c:read_program>\n");
     exit(1);
   }
 
-  if( (bits_read = read(handle, &textsize, sizeof(pmach->_textsize))) != sizeof(pmach->_textsize)) {
-    fprintf(stderr, "Erreur de lecture de 'textsize' dans <machine.c:read_program> dans '%s': %d bits lus au lieu de %ld\n", programfile, bits_read, sizeof(textsize));
+  //En-tête : textsize, datasize et dataend
+  if(st.st_size < (off_t) sizeof(header)) {
+    fprintf(stderr, "Erreur de lecture de l'en-tête dans <machine.c:read_program> dans '%s': %ld octets au lieu de %ld\n", programfile, (long) st.st_size, sizeof(header));
     exit(1);
   }
-
-  if( (bits_read = read(handle, &datasize, sizeof(pmach->_datasize))) != sizeof(pmach->_datasize)) {
-    fprintf(stderr, "Erreur de lecture de 'datasize' dans <machine.c:read_program> dans '%s': %d bits lus au lieu de %ld\n",programfile,bits_read,sizeof(datasize));
+  if(pread(handle, header, sizeof(header), 0) != sizeof(header)) {
+    fprintf(stderr, "Erreur de lecture de l'en-tête dans <machine.c:read_program> dans '%s'\n", programfile);
     exit(1);
   }
+  off_t text_offset = sizeof(header);
 
-  if( (bits_read = read(handle, &dataend, sizeof(pmach->_dataend))) != sizeof(pmach->_dataend)) {
-    fprintf(stderr, "Erreur de lecture de 'dataend' dans <machine.c:read_program> '%s': %d bits lus au lieu de %ld\n",programfile,bits_read,sizeof(dataend));
-    exit(1);
+  //...ou en-tête d'un fichier d'instantané :
+  bool is_snapshot = header[0] == SNAPSHOT_MAGIC;
+  if(is_snapshot) {
+    if(pread(handle, &snapshot, sizeof(snapshot), 0) != sizeof(snapshot)
+       || snapshot._version != SNAPSHOT_VERSION) {
+      fprintf(stderr, "Erreur de lecture de l'en-tête d'instantané dans <machine.c:read_program> dans '%s'\n", programfile);
+      exit(1);
+    }
+    header[0] = snapshot._textsize;
+    header[1] = snapshot._datasize;
+    header[2] = snapshot._dataend;
+    text_offset = sizeof(snapshot);
   }
+  unsigned textsize = header[0];
+  unsigned datasize = header[1];
+  unsigned dataend = header[2];
 
-  Instruction *text = malloc(textsize * sizeof(Instruction));
-  //lecture des instructions :
-  if( (bits_read = read(handle, text, textsize * sizeof(Instruction))) != (textsize * sizeof(Instruction)) ) {
-    fprintf(stderr, "Erreur de lecture de 'text' dans <machine.c:read_program> '%s': %d bits lus au lieu de %ld\n",programfile,bits_read,textsize * sizeof(Instruction));
+  off_t data_offset = text_offset + (off_t) textsize * sizeof(Instruction);
+  //L'image du segment de données peut s'arrêter après les données statiques ;
+  //le reste du segment (la pile notamment) vaut alors 0 :
+  off_t image = (st.st_size - data_offset) / (off_t) sizeof(Word);
+  if(image > datasize)
+    image = datasize;
+  if(st.st_size < data_offset || image < dataend) {
+    off_t needed = data_offset + (off_t) dataend * sizeof(Word);
+    fprintf(stderr, "Erreur de lecture de '%s' dans <machine.c:read_program> '%s': %ld octets au lieu de %ld\n",
+            st.st_size < data_offset ? "text" : "data", programfile, (long) st.st_size, (long) needed);
     exit(1);
   }
 
-  Word *data = malloc(datasize * sizeof(Word));
-  //lecture des données :
-  if( (bits_read = read(handle, data, datasize * sizeof(Word))) != (datasize * sizeof(Word))) {
-    fprintf(stderr, "Erreur de lecture de 'data' dans <machine.c:read_program> '%s': %d bits lus au lieu de %ld\n",programfile,bits_read,datasize * sizeof(Word));
+  //Projection du texte en lecture seule, partagé avec les autres processus
+  //qui chargent le même fichier :
+  long pagesize = sysconf(_SC_PAGESIZE);
+  size_t text_maplen = data_offset;
+  void *text_map = mmap(NULL, text_maplen, PROT_READ, MAP_PRIVATE, handle, 0);
+
+  //Segment de données : une réservation sans mémoire ni espace d'échange
+  //(MAP_NORESERVE), dont les pages sont créées à zéro au premier accès, et sur
+  //le début de laquelle on projette l'image du fichier en copie sur écriture.
+  //La projection du fichier commence sur une frontière de page : le segment
+  //est décalé d'autant dans la réservation. Un mot de plus est réservé car
+  //check_data_addr() autorise l'adresse datasize.
+  off_t data_start = data_offset & ~(off_t) (pagesize - 1);
+  size_t prefix = data_offset - data_start;
+  size_t data_maplen = prefix + ((size_t) datasize + 1) * sizeof(Word);
+  void *data_map = mmap(NULL, data_maplen, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if(text_map == MAP_FAILED || data_map == MAP_FAILED
+     || (image > 0 && mmap(data_map, prefix + image * sizeof(Word), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_FIXED, handle, data_start) == MAP_FAILED)) {
+    fprintf(stderr, "Erreur de projection du fichier binaire dans <machine.c:read_program>\n");
     exit(1);
   }
 
-  //Fermeture du fichier :
+  //Fermeture du fichier (les projections restent valides) :
   if(close(handle) != 0) {
     fprintf(stderr, "Erreur de fermeture du fichier binaire dans <machine.c:read_program>\n");
     exit(1);
   }
 
+  Instruction *text = (Instruction *) ((char *) text_map + text_offset);
+  Word *data = (Word *) ((char *) data_map + prefix);
+
   //On charge le programme dans la machine :
   load_program(pmach, textsize, text, datasize, data, dataend);
+  pmach->_text_map = text_map;
+  pmach->_text_maplen = text_maplen;
+  pmach->_data_map = data_map;
+  pmach->_data_maplen = data_maplen;
+  pmach->_dataimage = image;
+
+  //Reprise de l'exécution là où l'instantané a été pris :
+  if(is_snapshot) {
+    pmach->_pc = snapshot._pc;
+    pmach->_cc = snapshot._cc;
+    memcpy(pmach->_registers, snapshot._registers, sizeof(pmach->_registers));
+  }
+}
+
+//! Libération du programme chargé
+/*!
+ * \param pmach la machine
+ */
+void free_program(Machine *pmach)
+{
+  snapshot_stop(pmach);
+  profile_stop(pmach);
+  callgraph_stop(pmach);
+  free_predecoded(pmach->_uops);
+  pmach->_uops = NULL;
+
+  //Segments projetés par read_program() :
+  if(pmach->_text_map != NULL)
+    munmap(pmach->_text_map, pmach->_text_maplen);
+  if(pmach->_data_map != NULL)
+    munmap(pmach->_data_map, pmach->_data_maplen);
+  pmach->_text_map = pmach->_data_map = NULL;
+  pmach->_text = NULL;
+  pmach->_data = NULL;
 }
 
 //! Chargement d'un programme
 /*!
  * La machine est réinitialisée et ses segments de texte et de données sont
- * remplacés par ceux fournis en paramètre.
+ * remplacés par ceux fournis en paramètre. Le segment de texte est prédécodé
+ * en micro-opérations et ses adresses absolues sont vérifiées (voir
+ * predecode()) : les erreurs détectées sont signalées dès le chargement, avant
+ * toute exécution. Le moteur d'exécution est
+ * \c ENGINE_CALL et toutes les instructions sont tracées (\c TRACE_FULL).
+ *
+ * Les champs de la machine sont tous écrasés : elle n'a pas à être
+ * initialisée, mais un programme déjà chargé doit d'abord être libéré par
+ * free_program(), faute de quoi ses micro-opérations (et ses projections)
+ * sont perdues.
  *
  * \param pmach la machine en cours d'exécution
  * \param textsize taille utile du segment de texte
@@ -110,6 +201,11 @@ void load_program(Machine *pmach,
   pmach->_datasize = datasize;
   //.. et dataend :
   pmach->_dataend = dataend;
+  //.. et taille de l'image initiale :
+  pmach->_dataimage = datasize;
+
+  //Prédécodage et vérification du segment de texte :
+  pmach->_uops = predecode(textsize, text, datasize);
 
   //Mise à zéro des registres :
   for(int i = 0 ; i < NREGISTERS ; i++)
@@ -122,6 +218,26 @@ void load_program(Machine *pmach,
 
   //Init de SP ;
   pmach->_sp = datasize-1;
+
+  //Moteur d'exécution et niveau de trace par défaut :
+  pmach->_engine = ENGINE_CALL;
+  pmach->_trace = TRACE_FULL;
+  pmach->_bintrace = NULL;
+  pmach->_profile = NULL;
+  pmach->_calls = NULL;
+  pmach->_hooks = NULL;
+
+  //Aucune instruction exécutée :
+  pmach->_instrs = 0;
+  pmach->_fused_ops = 0;
+  pmach->_fused_instrs = 0;
+
+  //Segments fournis par l'appelant, qui reste chargé de les libérer :
+  pmach->_text_map = NULL;
+  pmach->_data_map = NULL;
+
+  //Aucun instantané :
+  pmach->_snapshots = NULL;
 }
 
 //! Affichage du programme et des données
@@ -280,31 +396,127 @@ void print_data(Machine *pmach)
   putchar('\n');
 }
 
-//! Simulation
+//! Exécution par appel de routine jusqu'à \c HALT
 /*!
- * La boucle de simualtion est très simple : recherche de l'instruction
- * suivante (pointée par le compteur ordinal \c _pc) puis décodage et exécution
- * de l'instruction.
- *
  * \param pmach la machine en cours d'exécution
- * \param debug mode de mise au point (pas à apas) ?
  */
-void simul(Machine *pmach, bool debug)
+static void simul_call(Machine *pmach)
 {
   bool stop = true;
-  //decode_execute retourne false si on est à la fin du programme :
+
+  //Le handler retourne false si on est à la fin du programme.
+  //Sans trace, la boucle ne teste pas le niveau de trace :
+  if (pmach->_trace == TRACE_OFF) {
+    while (stop)
+    {
+      if (pmach->_pc >= pmach->_textsize) {
+      	error(ERR_SEGTEXT, pmach->_pc - 1);
+      }
+      const Micro_Op *uop = &pmach->_uops[pmach->_pc++];
+      pmach->_instrs++;
+      stop = uop->_handler(pmach, uop);
+    }
+    return;
+  }
+
   while (stop)
-  { 
+  {
+    if (pmach->_pc >= pmach->_textsize) {
+    	error(ERR_SEGTEXT, pmach->_pc - 1);
+    }
     //On trace l'exécution courrante :
-    trace("Executing", pmach, pmach->_text[pmach->_pc], pmach->_pc);
-    
+    if (trace_wanted(pmach->_trace, pmach->_text[pmach->_pc]))
+      trace_exec(pmach, pmach->_pc);
+
+    const Micro_Op *uop = &pmach->_uops[pmach->_pc++];
+    pmach->_instrs++;
+    stop = uop->_handler(pmach, uop);
+  }
+}
+
+//! Simulation jusqu'à HALT, selon le mode et le moteur d'exécution
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param debug mode de mise au point (pas à apas) ?
+ */
+static void simul_engine(Machine *pmach, bool debug)
+{
+  bool stop = true;
+  //En mode debug on décode une instruction à la fois, jusqu'à ce que
+  //l'utilisateur quitte le mode pas à pas :
+  while (stop && debug)
+  {
     if (pmach->_pc >= pmach->_textsize) {
     	error(ERR_SEGTEXT, pmach->_pc - 1);
     }
+    //On trace l'exécution courrante :
+    trace("Executing", pmach, pmach->_text[pmach->_pc], pmach->_pc);
+
+    pmach->_instrs++;
     stop = decode_execute(pmach, pmach->_text[pmach->_pc++]);
-    
-    //Si on est en mode debug on ne fait qu'une ligne a la fois
-    if (debug)
-	debug = debug_ask(pmach);
+    debug = debug_ask(pmach);
+  }
+
+  //Une machine profilée ou instrumentée a sa propre boucle ; les moteurs
+  //n'en savent rien :
+  if (stop && pmach->_profile != NULL)
+    simul_profile(pmach);
+  else if (stop && hooks_mask(pmach->_hooks) != 0)
+    simul_hooked(pmach);
+  else if (stop) {
+    switch (pmach->_engine) {
+    case ENGINE_THREADED:
+    case ENGINE_LOCKSTEP:
+      simul_threaded(pmach);
+      break;
+    case ENGINE_VERIFY:
+      simul_verify(pmach);
+      break;
+    case ENGINE_JIT:
+      simul_jit(pmach);
+      break;
+    default:
+      simul_call(pmach);
+      break;
+    }
   }
 }
+
+//! Simulation
+/*!
+ * La boucle de simualtion est très simple : recherche de l'instruction
+ * suivante (pointée par le compteur ordinal \c _pc) puis décodage et exécution
+ * de l'instruction.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param debug mode de mise au point (pas à apas) ?
+ */
+void simul(Machine *pmach, bool debug)
+{
+  Fault fault = simul_run(pmach, debug);
+  //Comportement historique : l'erreur est affichée et termine le simulateur.
+  if (fault._error != ERR_NOERROR)
+    error(fault._error, fault._addr);
+}
+
+//! Simulation jusqu'à HALT ou jusqu'à une erreur d'exécution
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param debug mode de mise au point (pas à apas) ?
+ * \return l'erreur, ou \c ERR_NOERROR et l'adresse du HALT
+ */
+Fault simul_run(Machine *pmach, bool debug)
+{
+  Fault_Handler handler;
+  fault_push(&handler);
+  if (setjmp(handler._env)) {
+    if (pmach->_hooks != NULL && pmach->_hooks->_fault != NULL)
+      pmach->_hooks->_fault(pmach->_hooks->_ctx, pmach, handler._fault);
+    return handler._fault;
+  }
+
+  simul_engine(pmach, debug);
+
+  fault_pop(&handler);
+  return (Fault) { ERR_NOERROR, pmach->_pc - 1 };
+}
@@ -7,8 +7,17 @@
  */
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 
 #include "instruction.h"
+#include "error.h"
+
+struct Micro_Op;
+struct Bin_Trace;
+struct Profile;
+struct Call_Graph;
+struct Hooks;
 
 //! Nombre de resitres généraux
 #define NREGISTERS 16
@@ -34,6 +43,36 @@ typedef enum
 //! Dernière valeur possible du code condition
 static const unsigned LAST_CC = CC_N;
 
+//! Moteur d'exécution
+/*!
+ * Les différents moteurs exécutent les mêmes micro-opérations et produisent
+ * exactement le même état final de la machine ; seule la façon d'enchaîner
+ * les instructions change.
+ */
+typedef enum
+{
+    ENGINE_CALL = 0,	//!< Appel de la routine de chaque micro-opération
+    ENGINE_THREADED,	//!< Dispatch direct par \e computed \e goto (voir threaded.h)
+    ENGINE_VERIFY,	//!< Comparaison pas à pas avec decode_execute() (voir verify.h)
+    ENGINE_JIT,		//!< Traduction des blocs de base en code x86-64 (voir jit.h)
+    ENGINE_LOCKSTEP,	//!< Plusieurs machines à la fois (voir lockstep.h) ; seule,
+			//!< une machine est exécutée comme par \c ENGINE_THREADED
+} Engine;
+
+//! Niveau de trace de l'exécution
+/*!
+ * Le niveau est choisi avant simul(), qui exécute une boucle différente selon
+ * qu'il y a une trace ou non : sans trace, la boucle ne teste pas le niveau.
+ */
+typedef enum
+{
+    TRACE_OFF = 0,	//!< Aucune trace
+    TRACE_BRANCHES,	//!< Trace des seules instructions BRANCH
+    TRACE_CALLS,	//!< Trace des seules instructions CALL et RET
+    TRACE_FULL,		//!< Trace de toutes les instructions
+    TRACE_BINARY,	//!< Trace binaire de toutes les instructions (voir bintrace.h)
+} Trace_Level;
+
 //! Taille minimale de la pile d'exécution
 static const unsigned MINSTACKSIZE = 10;
 
@@ -72,17 +111,38 @@ typedef struct
     // Segments de mémoire
     Instruction *_text;		//!< Mémoire pour les instructions
     unsigned int _textsize;	//!< Taille utilisée pour les instructions
+    struct Micro_Op *_uops;	//!< Instructions prédécodées (voir decode.h)
 
     Word *_data;		//!< Mémoire de données
     unsigned int _datasize;	//!< Taille utilisée pour les données
 
     unsigned int _dataend;      //!< Première adresse libre après les données statiques
+    unsigned int _dataimage;	//!< Taille de l'image initiale des données (au-delà, 0)
 
     // Registres de l'unité centrale
     unsigned _pc;		//!< Compteur ordinal
     Condition_Code _cc;		//!< Code condition : signe de la dernière opération
     Word _registers[NREGISTERS];//!< Registres généraux (accumulateurs)
 
+    Engine _engine;		//!< Moteur d'exécution utilisé par simul()
+    Trace_Level _trace;		//!< Niveau de trace utilisé par simul()
+    struct Bin_Trace *_bintrace;//!< Trace binaire ouverte, au niveau \c TRACE_BINARY
+    struct Profile *_profile;	//!< Profil en cours, ou NULL (voir profile.h)
+    struct Call_Graph *_calls;	//!< Graphe d'appels en cours, ou NULL (voir callgraph.h)
+    const struct Hooks *_hooks;	//!< Crochets d'instrumentation, ou NULL (voir hooks.h)
+
+    // Statistiques d'exécution
+    uint64_t _instrs;		//!< Instructions exécutées, y compris celle d'une erreur
+    uint64_t _fused_ops;	//!< Superinstructions exécutées
+    uint64_t _fused_instrs;	//!< Instructions exécutées par ces superinstructions
+
+    // Projections du fichier binaire (voir read_program())
+    void *_text_map;		//!< Projection contenant le segment de texte, ou NULL
+    size_t _text_maplen;	//!< Taille de cette projection
+    void *_data_map;		//!< Projection contenant le segment de données, ou NULL
+    size_t _data_maplen;	//!< Taille de cette projection
+    struct Snapshot_Tracker *_snapshots;//!< Suivi des pages modifiées (voir snapshot.h)
+
 //! Définition de _sp comme synonyme du registre R15    
 #   define _sp _registers[NREGISTERS - 1] 
 } Machine;
@@ -90,7 +150,16 @@ typedef struct
 //! Chargement d'un programme
 /*!
  * La machine est réinitialisée et ses segments de texte et de données sont
- * remplacés par ceux fournis en paramètre.
+ * remplacés par ceux fournis en paramètre. Le segment de texte est prédécodé
+ * en micro-opérations et ses adresses absolues sont vérifiées (voir
+ * predecode()) : les erreurs détectées sont signalées dès le chargement, avant
+ * toute exécution. Le moteur d'exécution est
+ * \c ENGINE_CALL et toutes les instructions sont tracées (\c TRACE_FULL).
+ *
+ * Les champs de la machine sont tous écrasés : elle n'a pas à être
+ * initialisée, mais un programme déjà chargé doit d'abord être libéré par
+ * free_program(), faute de quoi ses micro-opérations (et ses projections)
+ * sont perdues.
  *
  * \param pmach la machine en cours d'exécution
  * \param textsize taille utile du segment de texte
@@ -114,16 +183,45 @@ void load_program(Machine *pmach,
  *    segment de texte (les instructions) ;
  *
  *    - une suite de \c datasize entiers non signés représentant le contenu initial du
- *    segment de données.
+ *    segment de données ; elle peut s'arrêter après les \c dataend premiers
+ *    (les données statiques), le reste du segment valant alors 0.
  *
  * Tous les entiers font 32 bits et les adresses de chaque segment commencent à
  * 0. La fonction initialise complétement la machine.
  *
+ * Le fichier n'est pas lu mais projeté en mémoire : le segment de texte en
+ * lecture seule (ses pages sont partagées par tous les processus qui chargent
+ * le même fichier), le segment de données en copie sur écriture. Celui-ci est
+ * réservé sans être alloué : ses pages sont créées au premier accès, à zéro
+ * au-delà de l'image du fichier. Seules les pages touchées par le prédécodage
+ * ou l'exécution deviennent résidentes, si grand que soit \c datasize ; le
+ * fichier lui-même n'est jamais modifié. Les projections sont libérées par
+ * free_program().
+ *
+ * Le fichier peut aussi être un fichier d'instantané (voir snapshot_write()),
+ * reconnu à son premier mot \c SNAPSHOT_MAGIC : après le chargement, les
+ * registres, \c _pc et \c _cc sont ceux de l'instantané.
+ *
+ * Comme pour load_program(), un programme déjà chargé doit d'abord être
+ * libéré par free_program().
+ *
  * \param pmach la machine à simuler
  * \param programfile le nom du fichier binaire
  *
  */
 void read_program(Machine *mach, const char *programfile);  
+
+//! Libération du programme chargé
+/*!
+ * Arrête le suivi des instantanés (voir snapshot_stop()) et le profil
+ * (voir profile_stop()), libère les instructions prédécodées et, si le
+ * programme a été chargé par read_program(), les projections de ses segments. Les segments fournis à
+ * load_program() restent à la charge de l'appelant. La machine ne doit plus
+ * être exécutée ensuite, sauf après un nouveau chargement.
+ *
+ * \param pmach la machine
+ */
+void free_program(Machine *pmach);
  
 //! Affichage du programme et des données
 /*!
@@ -165,12 +263,34 @@ void print_cpu(Machine *pmach);
 //! Simulation
 /*!
  * La boucle de simualtion est très simple : recherche de l'instruction
- * suivante (pointée par le compteur ordinal \c _pc) puis décodage et exécution
- * de l'instruction.
+ * suivante (pointée par le compteur ordinal \c _pc) puis exécution de la
+ * micro-opération correspondante, prédécodée au chargement, avec le moteur
+ * choisi dans \c _engine. En mode de mise au point, les instructions sont
+ * décodées une à une par decode_execute().
+ *
+ * Une erreur d'exécution est affichée et termine le simulateur ; simul() est
+ * construite sur simul_run(), qui rend l'erreur à l'appelant.
  *
  * \param pmach la machine en cours d'exécution
  * \param debug mode de mise au point (pas à apas) ?
  */
 void simul(Machine *pmach, bool debug);
 
+//! Simulation jusqu'à HALT ou jusqu'à une erreur d'exécution
+/*!
+ * Comme simul(), mais une erreur d'exécution ne termine pas le simulateur :
+ * elle arrête la simulation et est rendue à l'appelant, avec l'adresse de
+ * l'instruction fautive. La machine reste dans son état au moment de
+ * l'erreur, code condition compris (voir uop_reads_cc()) : on peut l'examiner,
+ * la restaurer (voir snapshot_restore()) ou y charger un autre programme, et
+ * l'exécuter à nouveau. Aucune ressource du moteur d'exécution n'est perdue.
+ * Le crochet d'erreur de la machine (voir hooks.h) est appelé avant que
+ * l'erreur ne soit rendue.
+ *
+ * \param pmach la machine en cours d'exécution
+ * \param debug mode de mise au point (pas à apas) ?
+ * \return l'erreur, ou \c ERR_NOERROR et l'adresse du HALT
+ */
+Fault simul_run(Machine *pmach, bool debug);
+
 #endif
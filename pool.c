@@ -0,0 +1,342 @@
+/*!
+ * \file pool.c
+ * \brief Programmes partagés et réserves de machines réutilisables.
+ *
+ * Un programme est une machine chargée une fois (\c _image) et jamais
+ * exécutée : les machines créées en recopient les champs, partagent son
+ * segment de texte et ses micro-opérations, et recopient son segment de
+ * données dans le leur.
+ */
+
+#define _GNU_SOURCE	// MAP_ANONYMOUS, MAP_NORESERVE, MADV_DONTNEED
+
+#include "pool.h"
+#include "snapshot.h"
+#include "profile.h"
+#include "callgraph.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+//! Au-delà de cette taille (en octets), un segment est remis à zéro en
+//! rendant ses pages au système plutôt qu'en les écrivant.
+#define POOL_ZERO_LIMIT (256 * 1024)
+
+//! Programme partagé
+struct Program
+{
+	Machine _image;		//!< Machine chargée avec le programme, jamais exécutée
+	Instruction *_text;		//!< Copie du segment de texte (program_create()), ou NULL
+	Word *_data;		//!< Copie du segment de données (program_create()), ou NULL
+	unsigned _refs;		//!< Nombre de références
+};
+
+//! Machine d'une réserve et son segment de données
+typedef struct Pool_Slot
+{
+	Machine _mach;		//!< La machine (en tête : un Machine * désigne l'emplacement)
+	Machine_Pool *_pool;	//!< Réserve d'origine
+	Program *_program;		//!< Programme exécuté, ou NULL si libre
+	Word *_buffer;		//!< Segment de données, projection anonyme
+	size_t _buflen;		//!< Taille de cette projection
+	struct Pool_Slot *_next;	//!< Emplacement libre suivant
+} Pool_Slot;
+
+//! Réserve de machines
+struct Machine_Pool
+{
+	pthread_mutex_t _lock;	//!< Protège les champs suivants
+	Pool_Slot *_free;		//!< Emplacements libres, avec leur segment
+	unsigned _live;		//!< Nombre de machines non détruites
+};
+
+//! Allocation sans échec.
+/*!
+ * \param size taille en octets
+ * \param where fonction appelante, pour le message d'erreur
+ */
+static void *xmalloc(size_t size, const char *where)
+{
+	void *p = malloc(size);
+	if (p == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <pool.c:%s>\n", where);
+		exit(1);
+	}
+	return p;
+}
+
+//! Nouveau programme, d'une seule référence.
+static Program *new_program(void)
+{
+	Program *prog = xmalloc(sizeof(*prog), "new_program");
+	prog->_text = NULL;
+	prog->_data = NULL;
+	prog->_refs = 1;
+	return prog;
+}
+
+//! Chargement d'un programme depuis un fichier binaire
+/*!
+ * \param programfile le nom du fichier binaire
+ * \return le programme
+ */
+Program *program_load(const char *programfile)
+{
+	Program *prog = new_program();
+	read_program(&prog->_image, programfile);
+	return prog;
+}
+
+//! Création d'un programme à partir de segments en mémoire
+/*!
+ * \return le programme
+ */
+Program *program_create(unsigned textsize, const Instruction text[textsize],
+			unsigned datasize, const Word data[datasize], unsigned dataend)
+{
+	Program *prog = new_program();
+	prog->_text = xmalloc((textsize ? textsize : 1) * sizeof(Instruction), "program_create");
+	prog->_data = xmalloc(((size_t) datasize + 1) * sizeof(Word), "program_create");
+	memcpy(prog->_text, text, textsize * sizeof(Instruction));
+	memcpy(prog->_data, data, datasize * sizeof(Word));
+	prog->_data[datasize] = 0;
+	load_program(&prog->_image, textsize, prog->_text, datasize, prog->_data, dataend);
+	return prog;
+}
+
+//! Nouvelle référence à un programme
+/*!
+ * \param prog le programme
+ * \return \c prog
+ */
+Program *program_retain(Program *prog)
+{
+	__atomic_fetch_add(&prog->_refs, 1, __ATOMIC_RELAXED);
+	return prog;
+}
+
+//! Abandon d'une référence à un programme
+/*!
+ * \param prog le programme
+ */
+void program_release(Program *prog)
+{
+	if (__atomic_sub_fetch(&prog->_refs, 1, __ATOMIC_ACQ_REL) != 0)
+		return;
+	free_program(&prog->_image);
+	free(prog->_text);
+	free(prog->_data);
+	free(prog);
+}
+
+//! État initial d'un programme
+/*!
+ * \param prog le programme
+ * \return sa machine initiale
+ */
+const Machine *program_image(const Program *prog)
+{
+	return &prog->_image;
+}
+
+//! Création d'une réserve de machines
+/*!
+ * \return la réserve
+ */
+Machine_Pool *pool_create(void)
+{
+	Machine_Pool *pool = xmalloc(sizeof(*pool), "pool_create");
+	pthread_mutex_init(&pool->_lock, NULL);
+	pool->_free = NULL;
+	pool->_live = 0;
+	return pool;
+}
+
+//! Destruction d'une réserve de machines
+/*!
+ * \param pool la réserve
+ */
+void pool_destroy(Machine_Pool *pool)
+{
+	if (pool->_live != 0) {
+		fprintf(stderr, "Erreur : %u machines non détruites dans <pool.c:pool_destroy>\n", pool->_live);
+		exit(1);
+	}
+	while (pool->_free != NULL) {
+		Pool_Slot *slot = pool->_free;
+		pool->_free = slot->_next;
+		munmap(slot->_buffer, slot->_buflen);
+		free(slot);
+	}
+	pthread_mutex_destroy(&pool->_lock);
+	free(pool);
+}
+
+//! Remise à zéro d'une partie d'un segment de données.
+/*!
+ * Les pages entièrement comprises dans une grande zone sont rendues au
+ * système : elles seront recréées à zéro au premier accès. Une petite zone
+ * est simplement écrite, ses pages restant présentes.
+ *
+ * \param words début de la zone
+ * \param count nombre de mots
+ */
+static void clear_words(Word *words, size_t count)
+{
+	size_t len = count * sizeof(Word);
+	if (len <= POOL_ZERO_LIMIT) {
+		memset(words, 0, len);
+		return;
+	}
+
+	uintptr_t pagesize = sysconf(_SC_PAGESIZE);
+	uintptr_t lo = (uintptr_t) words, hi = lo + len;
+	uintptr_t plo = (lo + pagesize - 1) & ~(pagesize - 1), phi = hi & ~(pagesize - 1);
+	memset(words, 0, plo - lo);
+	if (madvise((void *) plo, phi - plo, MADV_DONTNEED) != 0)
+		memset((void *) plo, 0, phi - plo);
+	memset((void *) phi, 0, hi - phi);
+}
+
+//! Création d'une machine
+/*!
+ * \param pool la réserve
+ * \param prog le programme à exécuter
+ * \return la machine
+ */
+Machine *machine_create(Machine_Pool *pool, Program *prog)
+{
+	size_t needed = ((size_t) prog->_image._datasize + 1) * sizeof(Word);
+
+	//Premier emplacement libre dont le segment est assez grand, à défaut le
+	//premier emplacement libre :
+	pthread_mutex_lock(&pool->_lock);
+	Pool_Slot **link = &pool->_free;
+	while (*link != NULL && (*link)->_buflen < needed)
+		link = &(*link)->_next;
+	if (*link == NULL)
+		link = &pool->_free;
+	Pool_Slot *slot = *link;
+	if (slot != NULL)
+		*link = slot->_next;
+	pool->_live++;
+	pthread_mutex_unlock(&pool->_lock);
+
+	if (slot == NULL) {
+		slot = xmalloc(sizeof(*slot), "machine_create");
+		slot->_pool = pool;
+		slot->_buffer = NULL;
+		slot->_buflen = 0;
+	}
+
+	//Segment trop petit : on le remplace. La réservation ne consomme ni
+	//mémoire ni espace d'échange tant que ses pages ne sont pas touchées.
+	if (slot->_buflen < needed) {
+		if (slot->_buffer != NULL)
+			munmap(slot->_buffer, slot->_buflen);
+		size_t pagesize = sysconf(_SC_PAGESIZE);
+		slot->_buflen = (needed + pagesize - 1) & ~(pagesize - 1);
+		slot->_buffer = mmap(NULL, slot->_buflen, PROT_READ | PROT_WRITE,
+				     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+		if (slot->_buffer == MAP_FAILED) {
+			fprintf(stderr, "Erreur d'allocation du segment de données dans <pool.c:machine_create>\n");
+			exit(1);
+		}
+	}
+
+	//Texte et micro-opérations partagés, segment de données propre. La
+	//projection reste à l'emplacement : elle est signalée (voir cache_store())
+	//mais n'est jamais libérée par free_program().
+	slot->_program = program_retain(prog);
+	slot->_mach = prog->_image;
+	slot->_mach._data = slot->_buffer;
+	slot->_mach._text_map = NULL;
+	slot->_mach._data_map = slot->_buffer;
+	slot->_mach._data_maplen = slot->_buflen;
+	slot->_mach._snapshots = NULL;
+	slot->_mach._engine = ENGINE_CALL;
+	slot->_mach._trace = TRACE_FULL;
+	slot->_mach._bintrace = NULL;
+	slot->_mach._profile = NULL;
+	slot->_mach._calls = NULL;
+	slot->_mach._hooks = NULL;
+	machine_reset(&slot->_mach);
+	return &slot->_mach;
+}
+
+//! Réinitialisation d'une machine, avec l'image de données \c data.
+/*!
+ * \param pmach la machine
+ * \param count taille de l'image
+ * \param data l'image initiale du segment de données
+ */
+static void reset(Machine *pmach, unsigned count, const Word data[count])
+{
+	Pool_Slot *slot = (Pool_Slot *) pmach;
+	const Machine *image = &slot->_program->_image;
+
+	snapshot_stop(pmach);
+
+	//Image initiale, puis zéros jusqu'au mot datasize compris (voir
+	//check_data_addr()) :
+	memcpy(pmach->_data, data, (size_t) count * sizeof(Word));
+	clear_words(pmach->_data + count, (size_t) image->_datasize + 1 - count);
+
+	pmach->_pc = image->_pc;
+	pmach->_cc = image->_cc;
+	memcpy(pmach->_registers, image->_registers, sizeof(pmach->_registers));
+	pmach->_instrs = 0;
+	pmach->_fused_ops = 0;
+	pmach->_fused_instrs = 0;
+}
+
+//! Réinitialisation d'une machine
+/*!
+ * \param pmach la machine
+ */
+void machine_reset(Machine *pmach)
+{
+	const Machine *image = &((Pool_Slot *) pmach)->_program->_image;
+	reset(pmach, image->_dataimage, image->_data);
+}
+
+//! Réinitialisation d'une machine avec une autre image de données
+/*!
+ * \param pmach la machine
+ * \param count taille de l'image
+ * \param data l'image initiale du segment de données
+ */
+void machine_reset_data(Machine *pmach, unsigned count, const Word data[count])
+{
+	if (count > pmach->_datasize) {
+		fprintf(stderr, "Erreur : image de %u mots pour un segment de %u dans <pool.c:machine_reset_data>\n",
+			count, pmach->_datasize);
+		exit(1);
+	}
+	reset(pmach, count, data);
+}
+
+//! Destruction d'une machine
+/*!
+ * \param pmach la machine
+ */
+void machine_destroy(Machine *pmach)
+{
+	Pool_Slot *slot = (Pool_Slot *) pmach;
+	Machine_Pool *pool = slot->_pool;
+
+	snapshot_stop(pmach);
+	profile_stop(pmach);
+	callgraph_stop(pmach);
+	program_release(slot->_program);
+	slot->_program = NULL;
+
+	pthread_mutex_lock(&pool->_lock);
+	slot->_next = pool->_free;
+	pool->_free = slot;
+	pool->_live--;
+	pthread_mutex_unlock(&pool->_lock);
+}
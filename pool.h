@@ -0,0 +1,148 @@
+#ifndef _POOL_H_
+#define _POOL_H_
+
+/*!
+ * \file pool.h
+ * \brief Programmes partagés et réserves de machines réutilisables.
+ *
+ * Ces fonctions font du simulateur une bibliothèque réentrante : un programme
+ * hôte peut exécuter de nombreux travaux, dans plusieurs threads, sans
+ * recharger les programmes ni réallouer les segments à chaque travail.
+ *
+ * Un \link Program \endlink est un programme chargé une fois pour toutes :
+ * segment de texte, micro-opérations prédécodées et image initiale du segment
+ * de données. Il est en lecture seule et partagé, avec un compteur de
+ * références, par toutes les machines qui l'exécutent.
+ *
+ * Une \link Machine_Pool \endlink fournit les machines (machine_create()) et
+ * leurs segments de données. Une machine détruite (machine_destroy()) retourne
+ * à sa réserve avec son segment, déjà alloué et dont les pages sont déjà
+ * présentes : la machine suivante le réutilise sans malloc() ni défaut de
+ * page. machine_reset() remet une machine dans l'état initial de son
+ * programme, pour une nouvelle exécution.
+ *
+ * Les machines ainsi créées s'exécutent avec simul() ou simul_run() comme les
+ * autres, mais ne doivent pas être passées à load_program(), read_program()
+ * ou free_program().
+ */
+
+#include "machine.h"
+
+//! Programme partagé par plusieurs machines
+typedef struct Program Program;
+
+//! Réserve de machines et de segments de données
+typedef struct Machine_Pool Machine_Pool;
+
+//! Chargement d'un programme depuis un fichier binaire
+/*!
+ * Le fichier, programme ou instantané, est chargé par read_program() : ses
+ * segments restent projetés en mémoire et sont partagés par les machines.
+ *
+ * \param programfile le nom du fichier binaire
+ * \return le programme, avec une référence à rendre par program_release()
+ */
+Program *program_load(const char *programfile);
+
+//! Création d'un programme à partir de segments en mémoire
+/*!
+ * Les segments sont recopiés : l'appelant peut libérer les siens au retour.
+ * Les paramètres sont ceux de load_program().
+ *
+ * \return le programme, avec une référence à rendre par program_release()
+ */
+Program *program_create(unsigned textsize, const Instruction text[textsize],
+                        unsigned datasize, const Word data[datasize], unsigned dataend);
+
+//! Nouvelle référence à un programme
+/*!
+ * \param prog le programme
+ * \return \c prog
+ */
+Program *program_retain(Program *prog);
+
+//! Abandon d'une référence à un programme
+/*!
+ * Le programme est libéré avec sa dernière référence ; chaque machine qui
+ * l'exécute en détient une.
+ *
+ * \param prog le programme
+ */
+void program_release(Program *prog);
+
+//! État initial d'un programme
+/*!
+ * La machine rendue est celle dont les machines créées recopient l'état :
+ * segments, registres, \c _pc et \c _cc. Elle ne doit être ni modifiée ni
+ * exécutée.
+ *
+ * \param prog le programme
+ * \return sa machine initiale, valide tant que le programme l'est
+ */
+const Machine *program_image(const Program *prog);
+
+//! Création d'une réserve de machines
+/*!
+ * Une réserve peut être utilisée par plusieurs threads à la fois.
+ *
+ * \return la réserve, à détruire par pool_destroy()
+ */
+Machine_Pool *pool_create(void);
+
+//! Destruction d'une réserve de machines
+/*!
+ * Libère les segments de données conservés. Toutes les machines de la
+ * réserve doivent avoir été détruites.
+ *
+ * \param pool la réserve
+ */
+void pool_destroy(Machine_Pool *pool);
+
+//! Création d'une machine
+/*!
+ * La machine est prise dans la réserve, avec un segment de données assez
+ * grand s'il y en a un, et mise dans l'état initial du programme (voir
+ * machine_reset()). Elle détient une référence au programme. Le moteur
+ * d'exécution est \c ENGINE_CALL et toutes les instructions sont tracées
+ * (\c TRACE_FULL), comme après load_program().
+ *
+ * \param pool la réserve
+ * \param prog le programme à exécuter
+ * \return la machine, à détruire par machine_destroy()
+ */
+Machine *machine_create(Machine_Pool *pool, Program *prog);
+
+//! Réinitialisation d'une machine
+/*!
+ * Remet le segment de données, les registres, \c _pc et \c _cc dans l'état
+ * initial du programme (celui de l'instantané pour un fichier d'instantané),
+ * et arrête le suivi des instantanés. Le moteur d'exécution, le niveau de
+ * trace et la trace binaire éventuelle sont conservés.
+ *
+ * \param pmach la machine, créée par machine_create()
+ */
+void machine_reset(Machine *pmach);
+
+//! Réinitialisation d'une machine avec une autre image de données
+/*!
+ * Comme machine_reset(), mais le segment de données commence par l'image
+ * fournie au lieu de celle du programme ; le reste du segment vaut 0. Les
+ * registres, \c _pc et \c _cc sont ceux de l'état initial du programme.
+ *
+ * \param pmach la machine, créée par machine_create()
+ * \param count taille de l'image, au plus \c _datasize mots
+ * \param data l'image initiale du segment de données
+ */
+void machine_reset_data(Machine *pmach, unsigned count, const Word data[count]);
+
+//! Destruction d'une machine
+/*!
+ * La machine et son segment de données retournent à leur réserve ; la
+ * référence au programme est rendue et le profil éventuel est libéré. Une
+ * trace binaire ouverte doit avoir été fermée.
+ *
+ * \param pmach la machine, créée par machine_create()
+ */
+void machine_destroy(Machine *pmach);
+
+#endif
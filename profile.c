@@ -0,0 +1,245 @@
+/*!
+ * \file profile.c
+ * \brief Profil d'exécution : instructions par adresse, par code opération et
+ * accès aux données.
+ *
+ * Chaque instruction est exécutée par la routine de sa sorte de base (voir
+ * \c uop_base_kinds) : une superinstruction n'exécute ainsi que sa première
+ * instruction, les suivantes gardant leurs propres micro-opérations.
+ */
+
+#include "profile.h"
+#include "exec.h"
+#include "exec_inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Ligne d'un tableau du rapport
+typedef struct
+{
+	uint64_t _count;		//!< Nombre d'exécutions ou d'accès
+	uint32_t _index;		//!< Adresse, ou code opération et mode
+} Profile_Line;
+
+//! Nom des modes d'adressage dans le rapport
+static const char *mode_names[] = {
+	[MODE_NONE] = "",
+	[MODE_IMMEDIATE] = "immediate",
+	[MODE_ABSOLUTE] = "absolute",
+	[MODE_INDEXED] = "indexed",
+};
+
+//! Allocation de \c count compteurs nuls.
+static uint64_t *counters(size_t count)
+{
+	uint64_t *p = calloc(count, sizeof(uint64_t));
+	if (p == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <profile.c:profile_start>\n");
+		exit(1);
+	}
+	return p;
+}
+
+//! Début du profil d'une machine
+/*!
+ * \param pmach la machine
+ */
+void profile_start(Machine *pmach)
+{
+	profile_stop(pmach);
+	Profile *prof = malloc(sizeof(Profile));
+	if (prof == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <profile.c:profile_start>\n");
+		exit(1);
+	}
+	memset(prof->_ops, 0, sizeof(prof->_ops));
+	prof->_textsize = pmach->_textsize;
+	prof->_datasize = pmach->_datasize;
+	prof->_pcs = counters(pmach->_textsize + 1);
+	//Un mot de plus : check_data_addr() autorise l'adresse datasize.
+	prof->_reads = counters((size_t) pmach->_datasize + 1);
+	prof->_writes = counters((size_t) pmach->_datasize + 1);
+	pmach->_profile = prof;
+}
+
+//! Fin du profil d'une machine
+/*!
+ * \param pmach la machine
+ */
+void profile_stop(Machine *pmach)
+{
+	Profile *prof = pmach->_profile;
+	if (prof == NULL)
+		return;
+	free(prof->_pcs);
+	free(prof->_reads);
+	free(prof->_writes);
+	free(prof);
+	pmach->_profile = NULL;
+}
+
+//! Mode d'adressage d'une instruction
+/*!
+ * \param instr l'instruction
+ * \return son mode d'adressage, \c MODE_NONE pour les instructions sans
+ * opérande
+ */
+Addressing_Mode profile_mode(Instruction instr)
+{
+	switch (instr.instr_generic._cop) {
+	case ILLOP:
+	case NOP:
+	case RET:
+	case HALT:
+		return MODE_NONE;
+	default:
+		if (instr.instr_generic._immediate)
+			return MODE_IMMEDIATE;
+		return instr.instr_generic._indexed ? MODE_INDEXED : MODE_ABSOLUTE;
+	}
+}
+
+//! Exécution profilée jusqu'à \c HALT
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_profile(Machine *pmach)
+{
+	Profile *prof = pmach->_profile;
+	bool stop = true;
+
+	while (stop)
+	{
+		unsigned pc = pmach->_pc;
+		if (pc >= pmach->_textsize)
+			error(ERR_SEGTEXT, pc - 1);
+		Instruction instr = pmach->_text[pc];
+		if (trace_wanted(pmach->_trace, instr))
+			trace_exec(pmach, pc);
+
+		prof->_pcs[pc]++;
+		if (instr.instr_generic._cop <= LAST_COP)
+			prof->_ops[instr.instr_generic._cop][profile_mode(instr)]++;
+		Data_Access acc = instr_accesses(pmach, instr);
+
+		const Micro_Op *uop = &pmach->_uops[pc];
+		pmach->_pc++;
+		pmach->_instrs++;
+		stop = uop_handlers[uop_base_kinds[uop->_kind]](pmach, uop);
+
+		//Adresses vérifiées par l'exécution, sauf pour un code inconnu :
+		if (acc._read <= prof->_datasize)
+			prof->_reads[acc._read]++;
+		if (acc._write <= prof->_datasize)
+			prof->_writes[acc._write]++;
+	}
+}
+
+//! Comparaison de lignes, pour qsort() : les plus fréquentes d'abord.
+static int compare_lines(const void *a, const void *b)
+{
+	const Profile_Line *la = a, *lb = b;
+	if (la->_count != lb->_count)
+		return la->_count > lb->_count ? -1 : 1;
+	return la->_index < lb->_index ? -1 : la->_index > lb->_index;
+}
+
+//! Lignes non nulles d'un tableau de compteurs, triées.
+/*!
+ * \param counts les compteurs, ou NULL pour la somme de \c reads et \c writes
+ * \param reads, writes compteurs ajoutés quand \c counts est NULL
+ * \param size nombre de compteurs
+ * \param nlines reçoit le nombre de lignes
+ * \return les lignes, à libérer par free()
+ */
+static Profile_Line *sorted_lines(const uint64_t *counts, const uint64_t *reads, const uint64_t *writes,
+				  size_t size, size_t *nlines)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < size; i++)
+		if (counts != NULL ? counts[i] != 0 : reads[i] + writes[i] != 0)
+			n++;
+	Profile_Line *lines = malloc((n ? n : 1) * sizeof(Profile_Line));
+	if (lines == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <profile.c:profile_report>\n");
+		exit(1);
+	}
+	n = 0;
+	for (size_t i = 0; i < size; i++) {
+		uint64_t count = counts != NULL ? counts[i] : reads[i] + writes[i];
+		if (count != 0)
+			lines[n++] = (Profile_Line) { count, i };
+	}
+	qsort(lines, n, sizeof(Profile_Line), compare_lines);
+	*nlines = n;
+	return lines;
+}
+
+//! Affichage du profil
+/*!
+ * \param pmach la machine profilée
+ * \param top nombre maximal de lignes
+ */
+void profile_report(const Machine *pmach, unsigned top)
+{
+	if (pmach->_profile != NULL)
+		profile_print(pmach, pmach->_profile, "instructions", top);
+}
+
+//! Affichage de compteurs au format du profil
+/*!
+ * \param pmach la machine dont le programme est désassemblé
+ * \param prof les compteurs
+ * \param unit ce que comptent les compteurs
+ * \param top nombre maximal de lignes
+ */
+void profile_print(const Machine *pmach, const Profile *prof, const char *unit, unsigned top)
+{
+	uint64_t total = 0;
+	for (unsigned pc = 0; pc < prof->_textsize; pc++)
+		total += prof->_pcs[pc];
+	double scale = total ? 100.0 / total : 0.0;
+	printf("\n*** Profile: %llu %s ***\n", (unsigned long long) total, unit);
+
+	//Points chauds, avec le pourcentage cumulé :
+	size_t n;
+	Profile_Line *lines = sorted_lines(prof->_pcs, NULL, NULL, prof->_textsize, &n);
+	printf("\n%12s %7s %7s  instruction\n", "count", "%", "cum.%");
+	uint64_t cumul = 0;
+	for (size_t i = 0; i < n && i < top; i++) {
+		unsigned pc = lines[i]._index;
+		cumul += lines[i]._count;
+		printf("%12llu %6.2f%% %6.2f%%  0x%04x: ", (unsigned long long) lines[i]._count,
+		       lines[i]._count * scale, cumul * scale, pc);
+		print_instruction(pmach->_text[pc], pc);
+		putchar('\n');
+	}
+	if (n > top)
+		printf("%12s (%zu more addresses)\n", "...", n - top);
+	free(lines);
+
+	//Répartition par code opération et mode d'adressage :
+	lines = sorted_lines(&prof->_ops[0][0], NULL, NULL, (HALT + 1) * 4, &n);
+	printf("\n%12s %7s  operation\n", "count", "%");
+	for (size_t i = 0; i < n; i++) {
+		unsigned cop = lines[i]._index / 4, mode = lines[i]._index % 4;
+		printf("%12llu %6.2f%%  %-6s %s\n", (unsigned long long) lines[i]._count,
+		       lines[i]._count * scale, cop_names[cop], mode_names[mode]);
+	}
+	free(lines);
+
+	//Mots de données les plus accédés :
+	if (prof->_reads == NULL)
+		return;
+	lines = sorted_lines(NULL, prof->_reads, prof->_writes, (size_t) prof->_datasize + 1, &n);
+	printf("\n%12s %12s  data address\n", "reads", "writes");
+	for (size_t i = 0; i < n && i < top; i++) {
+		unsigned addr = lines[i]._index;
+		printf("%12llu %12llu  0x%08x\n", (unsigned long long) prof->_reads[addr],
+		       (unsigned long long) prof->_writes[addr], addr);
+	}
+	if (n > top)
+		printf("%12s (%zu more addresses)\n", "...", n - top);
+	free(lines);
+}
@@ -0,0 +1,105 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+/*!
+ * \file profile.h
+ * \brief Profil d'exécution : instructions par adresse, par code opération et
+ * accès aux données.
+ *
+ * Une machine profilée est exécutée par simul_profile(), une boucle qui
+ * exécute les instructions une à une quel que soit le moteur choisi : les
+ * superinstructions n'y sont pas fusionnées, pour que chaque adresse soit
+ * comptée. Le choix de cette boucle est fait une fois par simul() ; une
+ * machine non profilée s'exécute exactement comme avant, sans aucun test
+ * supplémentaire par instruction.
+ */
+
+#include <stdint.h>
+
+#include "machine.h"
+#include "decode.h"
+
+//! Nombre de lignes affichées par défaut dans chaque tableau du rapport
+#define PROFILE_TOP 20
+
+//! Profil d'exécution d'une machine
+typedef struct Profile
+{
+    unsigned _textsize;		//!< Taille du segment de texte profilé
+    unsigned _datasize;		//!< Taille du segment de données profilé
+    uint64_t *_pcs;		//!< Exécutions de chaque instruction, par adresse
+    uint64_t _ops[HALT + 1][4];	//!< Exécutions par code opération et mode
+				//!< d'adressage (\link Addressing_Mode \endlink)
+    uint64_t *_reads;		//!< Lectures de chaque mot du segment de données,
+				//!< ou NULL si elles ne sont pas comptées
+    uint64_t *_writes;		//!< Écritures de chaque mot du segment de données
+} Profile;
+
+//! Début du profil d'une machine
+/*!
+ * Les compteurs sont remis à zéro. Le profil couvre les exécutions suivantes
+ * par simul() ou simul_run(), hors mode pas à pas, jusqu'à profile_stop().
+ *
+ * \param pmach la machine, dont le programme est chargé
+ */
+void profile_start(Machine *pmach);
+
+//! Fin du profil d'une machine
+/*!
+ * Libère les compteurs ; la machine s'exécute de nouveau avec son moteur.
+ * Appelée par free_program() et machine_destroy() ; sans effet si la
+ * machine n'est pas profilée.
+ *
+ * \param pmach la machine
+ */
+void profile_stop(Machine *pmach);
+
+//! Exécution profilée jusqu'à \c HALT
+/*!
+ * Appelée par simul() à la place du moteur d'exécution quand \c _profile
+ * n'est pas NULL. Chaque instruction est comptée avant son exécution, comme
+ * dans \c _instrs : celle qui s'arrête sur une erreur l'est aussi. Ses accès
+ * aux données ne sont comptés que si elle se termine normalement. Le niveau
+ * de trace est respecté.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_profile(Machine *pmach);
+
+//! Affichage du profil
+/*!
+ * Affiche les instructions les plus exécutées, désassemblées, par ordre
+ * décroissant du nombre d'exécutions, la répartition des exécutions par code
+ * opération et mode d'adressage, puis les mots du segment de données les plus
+ * lus ou écrits.
+ *
+ * \param pmach la machine profilée
+ * \param top nombre maximal de lignes des tableaux d'instructions et de
+ * données
+ */
+void profile_report(const Machine *pmach, unsigned top);
+
+//! Affichage de compteurs au format du profil
+/*!
+ * Utilisée par profile_report() et par les profils d'autres sources (voir
+ * sample.h) : les tableaux sont ceux du profil, le tableau des mots de
+ * données étant omis si \c _reads est NULL.
+ *
+ * \param pmach la machine dont le programme est désassemblé
+ * \param prof les compteurs
+ * \param unit ce que comptent les compteurs (\c "instructions",
+ * \c "samples"...), pour le titre
+ * \param top nombre maximal de lignes des tableaux d'instructions et de
+ * données
+ */
+void profile_print(const Machine *pmach, const Profile *prof, const char *unit, unsigned top);
+
+//! Mode d'adressage d'une instruction
+/*!
+ * \param instr l'instruction
+ * \return son mode d'adressage, \c MODE_NONE pour les instructions sans
+ * opérande, index de la seconde dimension de \c _ops
+ */
+Addressing_Mode profile_mode(Instruction instr);
+
+#endif
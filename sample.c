@@ -0,0 +1,192 @@
+/*!
+ * \file sample.c
+ * \brief Profil par échantillonnage : adresse courante relevée à intervalles
+ * réguliers.
+ *
+ * Le gestionnaire de signal n'alloue rien et n'appelle aucune fonction de la
+ * bibliothèque : il lit deux champs de la machine et écrit un élément du
+ * tableau, dont le nombre d'éléments remplis n'est publié qu'ensuite.
+ */
+
+#include "sample.h"
+#include "profile.h"
+#include "callgraph.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+//! Échantillonnage en cours
+typedef struct
+{
+	Machine *volatile _pmach;		//!< Machine échantillonnée, ou NULL
+	Sample *_samples;			//!< Échantillons
+	unsigned _max;			//!< Capacité de \c _samples
+	volatile sig_atomic_t _count;	//!< Nombre d'échantillons
+	volatile sig_atomic_t _lost;	//!< Échantillons perdus, tableau plein
+	struct sigaction _old;		//!< Gestionnaire précédent de \c SIGPROF
+} Sampler;
+
+//! L'échantillonnage du processus
+static Sampler sampler;
+
+//! Gestionnaire de \c SIGPROF : relevé d'un échantillon.
+static void tick(int sig)
+{
+	(void) sig;
+	Machine *pmach = sampler._pmach;
+	if (pmach == NULL)
+		return;
+	unsigned n = sampler._count;
+	if (n >= sampler._max) {
+		sampler._lost++;
+		return;
+	}
+	//Lecture unique de la mémoire, sans barrière (voir sample.h) :
+	unsigned pc = __atomic_load_n(&pmach->_pc, __ATOMIC_RELAXED);
+	sampler._samples[n] = (Sample) { pc, callgraph_depth(pmach) };
+	sampler._count = n + 1;
+}
+
+//! Armement du minuteur de temps processeur ; 0 le désarme.
+static void arm(unsigned period)
+{
+	struct itimerval timer;
+	timer.it_interval.tv_sec = period / 1000000;
+	timer.it_interval.tv_usec = period % 1000000;
+	timer.it_value = timer.it_interval;
+	if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+		perror("setitimer");
+		fprintf(stderr, "Erreur de minuteur dans <sample.c:arm>\n");
+		exit(1);
+	}
+}
+
+//! Début de l'échantillonnage d'une machine
+/*!
+ * \param pmach la machine
+ * \param period période en microsecondes
+ * \param max nombre maximal d'échantillons
+ */
+void sample_start(Machine *pmach, unsigned period, unsigned max)
+{
+	if (sampler._pmach != NULL) {
+		fprintf(stderr, "Erreur : échantillonnage déjà en cours dans <sample.c:sample_start>\n");
+		exit(1);
+	}
+	if (period == 0 || max == 0) {
+		fprintf(stderr, "Erreur : période ou capacité nulle dans <sample.c:sample_start>\n");
+		exit(1);
+	}
+
+	free(sampler._samples);
+	sampler._samples = malloc((size_t) max * sizeof(Sample));
+	if (sampler._samples == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <sample.c:sample_start>\n");
+		exit(1);
+	}
+	sampler._max = max;
+	sampler._count = 0;
+	sampler._lost = 0;
+
+	//SA_RESTART : les sorties du simulateur ne sont pas interrompues.
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = tick;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGPROF, &action, &sampler._old) != 0) {
+		perror("sigaction");
+		fprintf(stderr, "Erreur de signal dans <sample.c:sample_start>\n");
+		exit(1);
+	}
+	//Le code natif ne range _pc qu'en sortie de bloc :
+	if (pmach->_engine == ENGINE_JIT)
+		pmach->_engine = ENGINE_THREADED;
+	sampler._pmach = pmach;
+	arm(period);
+}
+
+//! Machine en cours d'échantillonnage
+/*!
+ * \param pmach la machine
+ * \return vrai si \c pmach est échantillonnée
+ */
+bool sample_running(const Machine *pmach)
+{
+	return sampler._pmach == pmach;
+}
+
+//! Fin de l'échantillonnage
+void sample_stop(void)
+{
+	if (sampler._pmach == NULL)
+		return;
+	arm(0);
+	sampler._pmach = NULL;
+	sigaction(SIGPROF, &sampler._old, NULL);
+}
+
+//! Affichage du profil échantillonné
+/*!
+ * \param pmach la machine échantillonnée
+ * \param top nombre maximal de lignes
+ */
+void sample_report(const Machine *pmach, unsigned top)
+{
+	unsigned count = sampler._count;
+	Profile prof;
+	memset(&prof, 0, sizeof(prof));
+	prof._textsize = pmach->_textsize;
+	prof._datasize = pmach->_datasize;
+	prof._pcs = calloc(pmach->_textsize + 1, sizeof(uint64_t));
+	if (prof._pcs == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <sample.c:sample_report>\n");
+		exit(1);
+	}
+
+	//L'instruction en cours précède _pc ; hors du programme, l'échantillon
+	//n'est pas attribué :
+	unsigned outside = 0, maxdepth = 0;
+	for (unsigned i = 0; i < count; i++) {
+		if (sampler._samples[i]._depth > maxdepth)
+			maxdepth = sampler._samples[i]._depth;
+		unsigned pc = sampler._samples[i]._pc;
+		pc = pc > 0 ? pc - 1 : 0;
+		if (pc >= pmach->_textsize) {
+			outside++;
+			continue;
+		}
+		prof._pcs[pc]++;
+		Instruction instr = pmach->_text[pc];
+		if (instr.instr_generic._cop <= LAST_COP)
+			prof._ops[instr.instr_generic._cop][profile_mode(instr)]++;
+	}
+	profile_print(pmach, &prof, "samples", top);
+	if (outside > 0 || sampler._lost > 0)
+		printf("\n%12u samples outside the program, %u lost (buffer full)\n",
+		       outside, (unsigned) sampler._lost);
+
+	//Échantillons par profondeur d'appel :
+	if (pmach->_calls != NULL) {
+		uint64_t *depths = calloc(maxdepth + 1, sizeof(uint64_t));
+		if (depths == NULL) {
+			fprintf(stderr, "Erreur d'allocation dans <sample.c:sample_report>\n");
+			exit(1);
+		}
+		for (unsigned i = 0; i < count; i++)
+			depths[sampler._samples[i]._depth]++;
+		double scale = count ? 100.0 / count : 0.0;
+		printf("\n%12s %7s  call depth\n", "samples", "%");
+		for (unsigned d = 0; d <= maxdepth; d++)
+			if (depths[d] != 0)
+				printf("%12llu %6.2f%%  %u\n", (unsigned long long) depths[d], depths[d] * scale, d);
+		free(depths);
+	}
+
+	free(prof._pcs);
+	free(sampler._samples);
+	sampler._samples = NULL;
+	sampler._count = 0;
+}
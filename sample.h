@@ -0,0 +1,91 @@
+#ifndef _SAMPLE_H_
+#define _SAMPLE_H_
+
+/*!
+ * \file sample.h
+ * \brief Profil par échantillonnage : adresse courante relevée à intervalles
+ * réguliers.
+ *
+ * Un minuteur du système (\c setitimer(ITIMER_PROF), en temps processeur)
+ * interrompt périodiquement le simulateur ; le gestionnaire du signal relève
+ * le compteur ordinal \c _pc de la machine échantillonnée et la profondeur de
+ * sa pile d'appels fantôme (voir callgraph.h) dans un tableau alloué
+ * d'avance. La boucle d'exécution n'est pas modifiée : le coût ne dépend que
+ * de la fréquence des échantillons, quelle que soit la durée de l'exécution.
+ *
+ * Les moteurs qui interprètent incrémentent \c _pc avant d'exécuter une
+ * instruction : un échantillon est attribué à l'instruction qui précède
+ * \c _pc. Entre un branchement pris et l'instruction suivante, c'est celle
+ * qui précède la cible qui est désignée. Le JIT ne met \c _pc à jour qu'en
+ * sortie de bloc : une machine échantillonnée confiée au moteur
+ * \c ENGINE_JIT passe au moteur \c ENGINE_THREADED.
+ *
+ * Le gestionnaire lit \c _pc et la profondeur en mémoire, par des lectures
+ * atomiques sans barrière : la valeur n'est jamais déchirée, mais c'est la
+ * dernière que le moteur a rangée. Un moteur peut garder \c _pc dans un
+ * registre de l'hôte entre deux rangements (le dispatch direct entre deux
+ * appels de fonction, par exemple) ; l'échantillon désigne alors une
+ * instruction un peu antérieure, dans la même portion de code sans appel.
+ * Rendre \c _pc volatile supprimerait ce décalage au prix d'un rangement par
+ * instruction dans tous les moteurs, échantillonnés ou non.
+ *
+ * Un seul échantillonnage peut être en cours dans le processus.
+ */
+
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Période d'échantillonnage par défaut, en microsecondes de temps processeur
+#define SAMPLE_PERIOD 1000
+
+//! Nombre maximal d'échantillons par défaut
+#define SAMPLE_MAX (1u << 20)
+
+//! Échantillon
+typedef struct
+{
+    uint32_t _pc;		//!< Compteur ordinal relevé
+    uint32_t _depth;		//!< Profondeur de la pile d'appels fantôme
+} Sample;
+
+//! Début de l'échantillonnage d'une machine
+/*!
+ * Alloue le tableau des échantillons, installe le gestionnaire de \c SIGPROF
+ * et arme le minuteur. Les échantillons précédents sont oubliés. Une machine
+ * confiée au moteur \c ENGINE_JIT passe au moteur \c ENGINE_THREADED.
+ *
+ * \param pmach la machine, dont le programme est chargé
+ * \param period période en microsecondes de temps processeur
+ * \param max nombre maximal d'échantillons ; les suivants sont perdus
+ */
+void sample_start(Machine *pmach, unsigned period, unsigned max);
+
+//! Machine en cours d'échantillonnage
+/*!
+ * \param pmach la machine
+ * \return vrai si \c pmach est échantillonnée, entre sample_start() et
+ * sample_stop()
+ */
+bool sample_running(const Machine *pmach);
+
+//! Fin de l'échantillonnage
+/*!
+ * Désarme le minuteur et rétablit le gestionnaire précédent de \c SIGPROF.
+ * Les échantillons sont gardés pour sample_report().
+ */
+void sample_stop(void);
+
+//! Affichage du profil échantillonné
+/*!
+ * Affiche les instructions les plus échantillonnées et la répartition par
+ * code opération et mode d'adressage, au format de profile_report(), puis
+ * la répartition des échantillons selon la profondeur d'appel si les appels
+ * de la machine sont suivis. Libère les échantillons.
+ *
+ * \param pmach la machine échantillonnée
+ * \param top nombre maximal de lignes du tableau des instructions
+ */
+void sample_report(const Machine *pmach, unsigned top);
+
+#endif
@@ -0,0 +1,517 @@
+/*!
+ * \file snapshot.c
+ * \brief Instantanés de la machine et points de reprise incrémentaux.
+ *
+ * Le gestionnaire de SIGSEGV ne touche qu'à des structures allouées par
+ * mmap() : elles ne peuvent pas partager une page avec le segment de données
+ * protégé.
+ *
+ * mprotect() agit sur des pages entières : seul est suivi un segment de
+ * données dont les pages n'appartiennent qu'à lui, projeté par read_program()
+ * ou commençant et finissant sur une frontière de page. Un segment alloué par
+ * malloc() ou un tableau statique protégerait aussi les données voisines.
+ */
+
+#define _GNU_SOURCE	// MAP_ANONYMOUS, siginfo_t
+
+#include "snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+//! Suivi des pages modifiées du segment de données d'une machine
+struct Snapshot_Tracker
+{
+	uintptr_t _start;		//!< Début de la première page du segment
+	uintptr_t _seg_lo;		//!< Début du segment
+	uintptr_t _seg_hi;		//!< Fin du segment
+	size_t _npages;		//!< Nombre de pages couvrant le segment
+
+	uint8_t *_dirty;		//!< Pages modifiées depuis le dernier instantané
+	unsigned *_dirty_list;	//!< Les mêmes, dans l'ordre des fautes
+	unsigned _ndirty;		//!< Nombre de pages modifiées
+	uint8_t *_touched;		//!< Pages pouvant différer de l'instantané complet
+	unsigned *_touched_list;	//!< Les mêmes
+	unsigned _ntouched;		//!< Nombre de ces pages
+
+	const Snapshot *_root;	//!< Instantané complet de référence, ou NULL
+	const Snapshot *_last;	//!< Dernier instantané pris ou restauré, ou NULL
+
+	size_t _maplen;		//!< Taille de la projection contenant cette structure
+};
+
+//! Instantané ou point de reprise
+struct Snapshot
+{
+	const Snapshot *_parent;	//!< Instantané précédent (NULL si complet)
+	const Snapshot *_root;	//!< Instantané complet d'origine
+	unsigned _children;		//!< Points de reprise qui en dépendent
+	bool _released;		//!< snapshot_free() a été appelée
+
+	unsigned _pc;		//!< Compteur ordinal
+	Condition_Code _cc;		//!< Code condition
+	Word _registers[NREGISTERS];//!< Registres généraux
+
+	unsigned _datasize;		//!< Taille du segment de données
+	size_t _npages;		//!< Nombre de pages du segment
+	unsigned _count;		//!< Nombre de pages copiées
+	unsigned *_index;		//!< Numéros des pages copiées
+	uint8_t **_pages;		//!< Leurs copies (NULL : page nulle)
+};
+
+//! Machines suivies, consultées par le gestionnaire de SIGSEGV
+static struct Snapshot_Tracker *volatile trackers[SNAPSHOT_MAX_MACHINES];
+
+//! Gestionnaire de SIGSEGV en place avant le nôtre
+static struct sigaction previous;
+
+//! Taille d'une page
+static size_t pagesize;
+
+//! Protège l'installation du gestionnaire et l'attribution des places de
+//! \c trackers ; le gestionnaire, lui, les lit sans verrou
+static pthread_mutex_t trackers_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//! Interception des écritures dans les pages protégées.
+/*!
+ * Une faute dans une page suivie marque la page et la rend accessible en
+ * écriture ; l'instruction fautive est alors réexécutée. Les autres fautes
+ * sont transmises au gestionnaire précédent.
+ */
+static void on_fault(int sig, siginfo_t *info, void *context)
+{
+	uintptr_t addr = (uintptr_t) info->si_addr;
+
+	for (int i = 0; i < SNAPSHOT_MAX_MACHINES; i++) {
+		struct Snapshot_Tracker *t = __atomic_load_n(&trackers[i], __ATOMIC_ACQUIRE);
+		if (t == NULL || addr - t->_start >= t->_npages * pagesize)
+			continue;
+		unsigned page = (addr - t->_start) / pagesize;
+		//Une faute simultanée d'un autre thread a pu marquer la page :
+		if (!__atomic_exchange_n(&t->_dirty[page], 1, __ATOMIC_RELAXED))
+			t->_dirty_list[__atomic_fetch_add(&t->_ndirty, 1, __ATOMIC_RELAXED)] = page;
+		if (!__atomic_exchange_n(&t->_touched[page], 1, __ATOMIC_RELAXED))
+			t->_touched_list[__atomic_fetch_add(&t->_ntouched, 1, __ATOMIC_RELAXED)] = page;
+		mprotect((void *) (t->_start + page * pagesize), pagesize, PROT_READ | PROT_WRITE);
+		return;
+	}
+
+	if (previous.sa_flags & SA_SIGINFO)
+		previous.sa_sigaction(sig, info, context);
+	else if (previous.sa_handler != SIG_DFL && previous.sa_handler != SIG_IGN)
+		previous.sa_handler(sig);
+	else
+		//Au retour, la faute se reproduit et termine le programme :
+		sigaction(SIGSEGV, &previous, NULL);
+}
+
+//! Allocation hors du tas.
+/*!
+ * \param size taille en octets
+ * \return la mémoire, initialisée à 0
+ */
+static void *alloc_pages(size_t size)
+{
+	void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		fprintf(stderr, "Erreur d'allocation dans <snapshot.c:alloc_pages>\n");
+		exit(1);
+	}
+	return p;
+}
+
+//! Allocation dans le tas, avec erreur fatale en cas d'échec.
+static void *xmalloc(size_t size)
+{
+	void *p = malloc(size ? size : 1);
+	if (p == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <snapshot.c:xmalloc>\n");
+		exit(1);
+	}
+	return p;
+}
+
+//! Partie d'une page qui appartient au segment de données.
+/*!
+ * \param t le suivi
+ * \param page numéro de la page
+ * \param len longueur de cette partie, en octets
+ * \return son début
+ */
+static uint8_t *page_range(const struct Snapshot_Tracker *t, unsigned page, size_t *len)
+{
+	uintptr_t lo = t->_start + page * pagesize;
+	uintptr_t hi = lo + pagesize;
+	if (lo < t->_seg_lo)
+		lo = t->_seg_lo;
+	if (hi > t->_seg_hi)
+		hi = t->_seg_hi;
+	*len = hi - lo;
+	return (uint8_t *) lo;
+}
+
+//! Protection en écriture des pages marquées, et remise à zéro des marques.
+/*!
+ * \param t le suivi
+ */
+static void protect_dirty(struct Snapshot_Tracker *t)
+{
+	for (unsigned i = 0; i < t->_ndirty; i++) {
+		unsigned page = t->_dirty_list[i];
+		mprotect((void *) (t->_start + page * pagesize), pagesize, PROT_READ);
+		t->_dirty[page] = 0;
+	}
+	t->_ndirty = 0;
+}
+
+//! Suivi des pages modifiées d'une machine, créé au premier instantané.
+/*!
+ * Plusieurs threads peuvent suivre chacun leur machine : la création est
+ * faite sous \c trackers_lock.
+ *
+ * \param pmach la machine
+ * \return le suivi
+ */
+static struct Snapshot_Tracker *get_tracker(Machine *pmach)
+{
+	if (pmach->_snapshots)
+		return pmach->_snapshots;
+
+	pthread_mutex_lock(&trackers_lock);
+	if (pagesize == 0) {
+		pagesize = sysconf(_SC_PAGESIZE);
+		struct sigaction sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sa_sigaction = on_fault;
+		sa.sa_flags = SA_SIGINFO | SA_RESTART;
+		sigemptyset(&sa.sa_mask);
+		if (sigaction(SIGSEGV, &sa, &previous) != 0) {
+			fprintf(stderr, "Erreur d'installation du gestionnaire de SIGSEGV dans <snapshot.c:get_tracker>\n");
+			exit(1);
+		}
+	}
+
+	uintptr_t seg_lo = (uintptr_t) pmach->_data;
+	uintptr_t seg_hi = seg_lo + (uintptr_t) pmach->_datasize * sizeof(Word);
+	uintptr_t start = seg_lo & ~(uintptr_t) (pagesize - 1);
+	size_t npages = pmach->_datasize ? (seg_hi - start + pagesize - 1) / pagesize : 0;
+
+	//Les pages du segment ne doivent contenir rien d'autre :
+	if (pmach->_data_map == NULL && (seg_lo % pagesize != 0 || seg_hi % pagesize != 0)) {
+		fprintf(stderr, "Erreur : segment de données non aligné sur les pages dans <snapshot.c:get_tracker>\n");
+		exit(1);
+	}
+
+	//La structure et ses tableaux, dans une même projection :
+	size_t maplen = sizeof(struct Snapshot_Tracker) + npages * 2 * (1 + sizeof(unsigned)) + 16;
+	struct Snapshot_Tracker *t = alloc_pages(maplen);
+	unsigned *lists = (unsigned *) (t + 1);
+	t->_dirty_list = lists;
+	t->_touched_list = lists + npages;
+	t->_dirty = (uint8_t *) (lists + 2 * npages);
+	t->_touched = t->_dirty + npages;
+	t->_start = start;
+	t->_seg_lo = seg_lo;
+	t->_seg_hi = seg_hi;
+	t->_npages = npages;
+	t->_maplen = maplen;
+
+	int slot = 0;
+	while (slot < SNAPSHOT_MAX_MACHINES && trackers[slot] != NULL)
+		slot++;
+	if (slot == SNAPSHOT_MAX_MACHINES) {
+		fprintf(stderr, "Erreur : plus de %d machines suivies <snapshot.c:get_tracker>\n", SNAPSHOT_MAX_MACHINES);
+		exit(1);
+	}
+	//Publié une fois rempli, pour le gestionnaire d'un autre thread :
+	__atomic_store_n(&trackers[slot], t, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&trackers_lock);
+	pmach->_snapshots = t;
+	return t;
+}
+
+//! Création d'un instantané : état du processeur seulement.
+/*!
+ * \param pmach la machine
+ * \param parent l'instantané parent, ou NULL
+ * \param count nombre de pages qui seront copiées
+ * \return l'instantané
+ */
+static Snapshot *new_snapshot(Machine *pmach, const Snapshot *parent, unsigned count)
+{
+	Snapshot *snap = xmalloc(sizeof(*snap));
+	snap->_parent = parent;
+	snap->_root = parent ? parent->_root : snap;
+	snap->_children = 0;
+	snap->_released = false;
+	if (parent)
+		((Snapshot *) parent)->_children++;
+
+	snap->_pc = pmach->_pc;
+	snap->_cc = pmach->_cc;
+	memcpy(snap->_registers, pmach->_registers, sizeof(snap->_registers));
+
+	snap->_datasize = pmach->_datasize;
+	snap->_npages = pmach->_snapshots->_npages;
+	snap->_count = 0;
+	snap->_index = xmalloc(count * sizeof(unsigned));
+	snap->_pages = xmalloc(count * sizeof(uint8_t *));
+	return snap;
+}
+
+//! Copie d'une page dans un instantané.
+/*!
+ * \param t le suivi
+ * \param snap l'instantané
+ * \param page numéro de la page
+ * \param skip_zero vrai pour ne pas copier une page nulle
+ */
+static void copy_page(const struct Snapshot_Tracker *t, Snapshot *snap, unsigned page, bool skip_zero)
+{
+	size_t len;
+	const uint8_t *src = page_range(t, page, &len);
+	uint8_t *copy = NULL;
+
+	if (!skip_zero || src[0] != 0 || memcmp(src, src + 1, len - 1) != 0) {
+		copy = xmalloc(len);
+		memcpy(copy, src, len);
+	}
+	snap->_index[snap->_count] = page;
+	snap->_pages[snap->_count++] = copy;
+}
+
+//! Instantané complet
+/*!
+ * \param pmach la machine
+ * \return l'instantané
+ */
+Snapshot *snapshot_take(Machine *pmach)
+{
+	struct Snapshot_Tracker *t = get_tracker(pmach);
+	Snapshot *snap = new_snapshot(pmach, NULL, t->_npages);
+
+	//Toutes les pages redeviennent accessibles pendant la copie :
+	if (t->_npages)
+		mprotect((void *) t->_start, t->_npages * pagesize, PROT_READ | PROT_WRITE);
+	for (unsigned page = 0; page < t->_npages; page++)
+		copy_page(t, snap, page, true);
+
+	memset(t->_dirty, 0, t->_npages);
+	memset(t->_touched, 0, t->_npages);
+	t->_ndirty = t->_ntouched = 0;
+	if (t->_npages)
+		mprotect((void *) t->_start, t->_npages * pagesize, PROT_READ);
+	t->_root = t->_last = snap;
+	return snap;
+}
+
+//! Point de reprise incrémental
+/*!
+ * \param pmach la machine
+ * \return le point de reprise
+ */
+Snapshot *snapshot_checkpoint(Machine *pmach)
+{
+	struct Snapshot_Tracker *t = pmach->_snapshots;
+	if (t == NULL || t->_last == NULL) {
+		fprintf(stderr, "Erreur : point de reprise sans instantané <snapshot.c:snapshot_checkpoint>\n");
+		exit(1);
+	}
+
+	Snapshot *snap = new_snapshot(pmach, t->_last, t->_ndirty);
+	for (unsigned i = 0; i < t->_ndirty; i++)
+		copy_page(t, snap, t->_dirty_list[i], false);
+	protect_dirty(t);
+	t->_last = snap;
+	return snap;
+}
+
+//! Réécriture d'une page du segment de données.
+/*!
+ * \param t le suivi
+ * \param page numéro de la page
+ * \param src contenu de la page (NULL : page nulle)
+ */
+static void write_page(const struct Snapshot_Tracker *t, unsigned page, const uint8_t *src)
+{
+	size_t len;
+	uint8_t *dst = page_range(t, page, &len);
+
+	if (src ? memcmp(dst, src, len) == 0 : (dst[0] == 0 && memcmp(dst, dst + 1, len - 1) == 0))
+		return;		// déjà à jour
+	void *addr = (void *) (t->_start + page * pagesize);
+	mprotect(addr, pagesize, PROT_READ | PROT_WRITE);
+	if (src)
+		memcpy(dst, src, len);
+	else
+		memset(dst, 0, len);
+	mprotect(addr, pagesize, PROT_READ);
+}
+
+//! Application des pages d'un instantané et de ses ancêtres.
+/*!
+ * Les plus anciens d'abord : chaque page prend la valeur du plus récent.
+ *
+ * \param t le suivi
+ * \param snap l'instantané
+ * \param mark vrai pour marquer les pages comme différant de l'original
+ */
+static void apply_chain(struct Snapshot_Tracker *t, const Snapshot *snap, bool mark)
+{
+	if (snap->_parent == NULL)
+		return;
+	apply_chain(t, snap->_parent, mark);
+	for (unsigned i = 0; i < snap->_count; i++) {
+		unsigned page = snap->_index[i];
+		write_page(t, page, snap->_pages[i]);
+		if (mark && !t->_touched[page]) {
+			t->_touched[page] = 1;
+			t->_touched_list[t->_ntouched++] = page;
+		}
+	}
+}
+
+//! Restauration d'un instantané ou d'un point de reprise
+/*!
+ * \param pmach la machine
+ * \param snap l'instantané
+ */
+void snapshot_restore(Machine *pmach, const Snapshot *snap)
+{
+	struct Snapshot_Tracker *t = get_tracker(pmach);
+	if (snap->_datasize != pmach->_datasize || snap->_npages != t->_npages) {
+		fprintf(stderr, "Erreur : instantané d'un autre segment de données <snapshot.c:snapshot_restore>\n");
+		exit(1);
+	}
+
+	//Les pages modifiées sont protégées à nouveau par write_page() :
+	for (unsigned i = 0; i < t->_ndirty; i++)
+		t->_dirty[t->_dirty_list[i]] = 0;
+	t->_ndirty = 0;
+	if (t->_npages)
+		mprotect((void *) t->_start, t->_npages * pagesize, PROT_READ);
+
+	const Snapshot *root = snap->_root;
+	if (t->_root == root) {
+		//Retour à l'instantané complet sur les seules pages qui en diffèrent :
+		for (unsigned i = 0; i < t->_ntouched; i++) {
+			unsigned page = t->_touched_list[i];
+			write_page(t, page, root->_pages[page]);
+			t->_touched[page] = 0;
+		}
+	} else {
+		for (unsigned page = 0; page < t->_npages; page++)
+			write_page(t, page, root->_pages[page]);
+		memset(t->_touched, 0, t->_npages);
+		t->_root = root;
+	}
+	t->_ntouched = 0;
+	apply_chain(t, snap, true);
+	t->_last = snap;
+
+	pmach->_pc = snap->_pc;
+	pmach->_cc = snap->_cc;
+	memcpy(pmach->_registers, snap->_registers, sizeof(pmach->_registers));
+}
+
+//! Libération effective d'un instantané et de ses parents libérés.
+static void release(Snapshot *snap)
+{
+	while (snap && snap->_released && snap->_children == 0) {
+		Snapshot *parent = (Snapshot *) snap->_parent;
+		for (unsigned i = 0; i < snap->_count; i++)
+			free(snap->_pages[i]);
+		free(snap->_pages);
+		free(snap->_index);
+		free(snap);
+		if (parent)
+			parent->_children--;
+		snap = parent;
+	}
+}
+
+//! Libération d'un instantané
+/*!
+ * \param snap l'instantané
+ */
+void snapshot_free(Snapshot *snap)
+{
+	if (snap == NULL)
+		return;
+
+	//Le suivi ne doit plus y faire référence :
+	pthread_mutex_lock(&trackers_lock);
+	for (int i = 0; i < SNAPSHOT_MAX_MACHINES; i++) {
+		struct Snapshot_Tracker *t = trackers[i];
+		if (t && t->_last == snap)
+			t->_last = NULL;
+		if (t && t->_root == snap)
+			t->_root = NULL;
+	}
+	pthread_mutex_unlock(&trackers_lock);
+	snap->_released = true;
+	release(snap);
+}
+
+//! Fin du suivi des pages modifiées
+/*!
+ * \param pmach la machine
+ */
+void snapshot_stop(Machine *pmach)
+{
+	struct Snapshot_Tracker *t = pmach->_snapshots;
+	if (t == NULL)
+		return;
+
+	if (t->_npages)
+		mprotect((void *) t->_start, t->_npages * pagesize, PROT_READ | PROT_WRITE);
+	pthread_mutex_lock(&trackers_lock);
+	for (int i = 0; i < SNAPSHOT_MAX_MACHINES; i++)
+		if (trackers[i] == t)
+			trackers[i] = NULL;
+	pthread_mutex_unlock(&trackers_lock);
+	munmap(t, t->_maplen);
+	pmach->_snapshots = NULL;
+}
+
+//! Écriture de l'état de la machine dans un fichier d'instantané
+/*!
+ * \param pmach la machine
+ * \param filename le nom du fichier
+ */
+void snapshot_write(Machine *pmach, const char *filename)
+{
+	Snapshot_Header header = {
+		._magic = SNAPSHOT_MAGIC,
+		._version = SNAPSHOT_VERSION,
+		._textsize = pmach->_textsize,
+		._datasize = pmach->_datasize,
+		._dataend = pmach->_dataend,
+		._pc = pmach->_pc,
+		._cc = pmach->_cc,
+	};
+	memcpy(header._registers, pmach->_registers, sizeof(header._registers));
+
+	//Image des données jusqu'au dernier mot non nul (au moins dataend) :
+	unsigned image = pmach->_datasize;
+	while (image > pmach->_dataend && pmach->_data[image - 1] == 0)
+		image--;
+
+	FILE *f = fopen(filename, "wb");
+	if (f == NULL) {
+		fprintf(stderr, "Erreur d'ouverture du fichier d'instantané dans <snapshot.c:snapshot_write>\n");
+		exit(1);
+	}
+	if (fwrite(&header, sizeof(header), 1, f) != 1
+	    || fwrite(pmach->_text, sizeof(Instruction), pmach->_textsize, f) != pmach->_textsize
+	    || fwrite(pmach->_data, sizeof(Word), image, f) != image
+	    || fclose(f) != 0) {
+		fprintf(stderr, "Erreur d'écriture du fichier d'instantané dans <snapshot.c:snapshot_write>\n");
+		exit(1);
+	}
+}
@@ -0,0 +1,133 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+/*!
+ * \file snapshot.h
+ * \brief Instantanés de la machine et points de reprise incrémentaux.
+ *
+ * Un instantané contient les registres, \c _pc, \c _cc et le segment de
+ * données d'une machine. Pour que les points de reprise et les restaurations
+ * ne coûtent que les pages effectivement modifiées, le segment de données est
+ * protégé en écriture après chaque instantané : la première écriture dans une
+ * page provoque une faute (SIGSEGV) que l'on intercepte pour noter la page
+ * comme modifiée et la rendre à nouveau accessible en écriture. Ce suivi est
+ * indépendant du moteur d'exécution, code natif du JIT compris.
+ *
+ * Un instantané complet (snapshot_take()) copie tout le segment, sauf les
+ * pages nulles. Un point de reprise (snapshot_checkpoint()) ne copie que les
+ * pages modifiées depuis l'instantané précédent, pris ou restauré, qui devient
+ * son parent. Une restauration (snapshot_restore()) ne réécrit que les pages
+ * qui peuvent différer de l'instantané restauré.
+ *
+ * Les pages du segment de données ne doivent contenir rien d'autre : il doit
+ * avoir été projeté par read_program(), ou commencer et finir sur une
+ * frontière de page. Sinon, le premier instantané est une erreur fatale.
+ * Chaque thread peut suivre sa propre machine.
+ *
+ * Enfin snapshot_write() écrit l'état courant de la machine dans un fichier
+ * que read_program() sait charger à la place d'un programme binaire.
+ */
+
+#include <stdint.h>
+
+#include "machine.h"
+
+//! Identification d'un fichier d'instantané (premier mot du fichier)
+#define SNAPSHOT_MAGIC 0x50414e53	// "SNAP"
+
+//! Version du format de fichier d'instantané
+#define SNAPSHOT_VERSION 1
+
+//! Nom du fichier d'instantané écrit par défaut (test_simul, mise au point)
+#define SNAPSHOT_FILE "snapshot.bin"
+
+//! Nombre maximal de machines suivies en même temps
+#define SNAPSHOT_MAX_MACHINES 16
+
+//! En-tête d'un fichier d'instantané
+/*!
+ * L'en-tête est suivi du segment de texte (\c _textsize instructions) puis
+ * de l'image du segment de données : ses mots jusqu'au dernier non nul, et au
+ * moins les \c _dataend premiers ; le reste du segment vaut 0. Tous les
+ * entiers sont écrits dans l'ordre des octets de l'hôte.
+ */
+typedef struct
+{
+    uint32_t _magic;		//!< \c SNAPSHOT_MAGIC
+    uint32_t _version;		//!< \c SNAPSHOT_VERSION
+    uint32_t _textsize;		//!< Taille du segment de texte
+    uint32_t _datasize;		//!< Taille du segment de données
+    uint32_t _dataend;		//!< Première adresse libre après les données statiques
+    uint32_t _pc;		//!< Compteur ordinal
+    uint32_t _cc;		//!< Code condition
+    uint32_t _pad;		//!< Alignement
+    Word _registers[NREGISTERS];//!< Registres généraux (SP compris)
+} Snapshot_Header;
+
+//! Instantané ou point de reprise d'une machine
+typedef struct Snapshot Snapshot;
+
+//! Instantané complet
+/*!
+ * Copie l'état de la machine et commence (ou recommence) le suivi des pages
+ * modifiées de son segment de données.
+ *
+ * \param pmach la machine
+ * \return l'instantané, à libérer par snapshot_free()
+ */
+Snapshot *snapshot_take(Machine *pmach);
+
+//! Point de reprise incrémental
+/*!
+ * Copie les registres et les seules pages modifiées depuis le dernier
+ * instantané pris, point de reprise ou restauration de cette machine, qui
+ * devient le parent du point de reprise. Erreur fatale s'il n'y en a pas.
+ *
+ * \param pmach la machine
+ * \return le point de reprise, à libérer par snapshot_free()
+ */
+Snapshot *snapshot_checkpoint(Machine *pmach);
+
+//! Restauration d'un instantané ou d'un point de reprise
+/*!
+ * La machine doit avoir le même segment de données que lors de la prise de
+ * l'instantané. Seules les pages modifiées depuis l'instantané complet
+ * d'origine sont réécrites, sauf si un autre instantané complet a été pris
+ * depuis : tout le segment est alors réécrit.
+ *
+ * \param pmach la machine
+ * \param snap l'instantané
+ */
+void snapshot_restore(Machine *pmach, const Snapshot *snap);
+
+//! Libération d'un instantané
+/*!
+ * Un instantané dont dépendent encore des points de reprise n'est libéré
+ * qu'avec le dernier d'entre eux ; il ne peut plus être utilisé.
+ *
+ * \param snap l'instantané
+ */
+void snapshot_free(Snapshot *snap);
+
+//! Fin du suivi des pages modifiées
+/*!
+ * Rend le segment de données accessible en écriture. Appelée par
+ * free_program() ; sans effet si la machine n'est pas suivie. Les instantanés
+ * existants restent valides.
+ *
+ * \param pmach la machine
+ */
+void snapshot_stop(Machine *pmach);
+
+//! Écriture de l'état de la machine dans un fichier d'instantané
+/*!
+ * Le fichier contient aussi le segment de texte : read_program() le charge
+ * comme un programme binaire, et l'exécution reprend à \c _pc avec les
+ * registres et le code condition enregistrés.
+ *
+ * \param pmach la machine
+ * \param filename le nom du fichier
+ */
+void snapshot_write(Machine *pmach, const char *filename);
+
+#endif
@@ -5,9 +5,18 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "machine.h"
+#include "exec.h"
+#include "bintrace.h"
+#include "snapshot.h"
 #include "debug.h"
+#include "cache.h"
+#include "profile.h"
+#include "callgraph.h"
+#include "sample.h"
+#include "hostperf.h"
 
 //! Segment de texte
 extern Instruction text[];
@@ -24,6 +33,70 @@ extern const unsigned dataend;
 //! Taille utile du segment de données
 extern const unsigned datasize;  
 
+//! Copie du segment de données d'une machine
+/*!
+ * \param pmach la machine
+ * \return la copie, à libérer par free()
+ */
+static Word *copy_data(const Machine *pmach)
+{
+    Word *copy = malloc(((size_t) pmach->_datasize + 1) * sizeof(Word));
+    if (copy == NULL) {
+        fprintf(stderr, "Erreur d'allocation dans <test_simul.c:copy_data>\n");
+        exit(1);
+    }
+    memcpy(copy, pmach->_data, (size_t) pmach->_datasize * sizeof(Word));
+    return copy;
+}
+
+//! Comparaison de l'état d'une machine avec une copie
+/*!
+ * \param pmach la machine
+ * \param ref copie de la machine : \c _pc, \c _cc et registres
+ * \param data copie de son segment de données
+ * \return vrai si les états sont identiques
+ */
+static bool same_state(const Machine *pmach, const Machine *ref, const Word *data)
+{
+    return pmach->_pc == ref->_pc && pmach->_cc == ref->_cc
+        && memcmp(pmach->_registers, ref->_registers, sizeof(ref->_registers)) == 0
+        && memcmp(pmach->_data, data, (size_t) pmach->_datasize * sizeof(Word)) == 0;
+}
+
+//! Vérification des instantanés après l'exécution (option \c -k)
+/*!
+ * Prend un point de reprise de l'état final, restaure l'état initial puis
+ * le point de reprise, et compare chaque fois la machine à sa copie. Une
+ * différence est une erreur fatale.
+ *
+ * \param pmach la machine, après l'exécution
+ * \param initial instantané complet pris avant l'exécution, libéré ici
+ * \param before copie de la machine avant l'exécution
+ * \param before_data copie de son segment de données, libérée ici
+ */
+static void check_snapshots(Machine *pmach, Snapshot *initial, const Machine *before, Word *before_data)
+{
+    Machine after = *pmach;
+    Word *after_data = copy_data(pmach);
+    Snapshot *final = snapshot_checkpoint(pmach);
+
+    snapshot_restore(pmach, initial);
+    bool initial_ok = same_state(pmach, before, before_data);
+    snapshot_restore(pmach, final);
+    bool final_ok = same_state(pmach, &after, after_data);
+
+    printf("\n*** Snapshots: initial state %s, final state %s ***\n",
+           initial_ok ? "restored" : "DIFFERS", final_ok ? "restored" : "DIFFERS");
+    snapshot_free(final);
+    snapshot_free(initial);
+    free(after_data);
+    free(before_data);
+    if (!initial_ok || !final_ok) {
+        fprintf(stderr, "Erreur : instantané restauré différent de la machine dans <test_simul.c:check_snapshots>\n");
+        exit(1);
+    }
+}
+
 //! Help message.
 /*!
  * Printed with option \c -h.
@@ -35,6 +108,28 @@ static void usage()
            "\t-d\tDebug mode (interactive execution)\n"
            "\t-b\tA binary file is provided\n"
            "\t-l\tDo not execute; just display the listing\n"
+           "\t-e\tExecution engine: 'call' (default), 'threaded', 'verify' or 'jit'\n"
+           "\t\t('jit' runs traced or sampled (-i) programs on 'threaded')\n"
+           "\t-t\tTrace level: 'off', 'branches', 'calls', 'full' (default)\n"
+           "\t\t'binary' (full trace into the binary file trace.bin)\n"
+           "\t\tor 'delta' (same, delta-compressed)\n"
+           "\t-s\tAfter execution, write a snapshot of the machine into the\n"
+           "\t\tfile given as next argument (loadable with -b)\n"
+           "\t-p\tProfile the execution and print the hot spots, the opcode\n"
+           "\t\tmix and the most accessed data words\n"
+           "\t-i\tSample the running instruction every N microseconds of CPU\n"
+           "\t\ttime (N given as next argument) and print the sampled hot spots\n"
+           "\t-P\tCount host cycles, instructions, branch misses and L1d misses\n"
+           "\t\tduring the execution, per guest instruction (best with -t off)\n"
+           "\t-g\tFollow the calls, print the costliest subroutines and write\n"
+           "\t\tthe folded call stacks (flamegraph input) into the file\n"
+           "\t\tgiven as next argument\n"
+           "\t-k\tCheck the snapshots: take one before the execution and a\n"
+           "\t\tcheckpoint after it, restore both and compare them with the\n"
+           "\t\tsaved machine states (needs -b)\n"
+           "\t-c\tTake the final state from the cache directory given as next\n"
+           "\t\targument if it is there (no trace), else run and store it;\n"
+           "\t\tignored with -d, -t binary/delta, -p, -i, -P and -g\n"
            "\t-h\tprint this help message\n"
            "If -b is given, the next argument must be a file name containing\n"
            "a valid program in binary format. Otherwise an internally defined\n"
@@ -53,6 +148,56 @@ static void usage()
  *   fichier doit être fourni également en paramètre de la ligne de
  *   commande ; sans cette option, on exécute un programme de test prédéfini.</dd>
  *
+ *   <dt>-e</dt><dd>moteur d'exécution, suivi de son nom : \c call (appel de
+ *   routine, par défaut), \c threaded (dispatch direct), \c verify
+ *   (comparaison avec le décodeur de référence) ou \c jit (traduction en
+ *   code natif x86-64 ; un programme tracé est exécuté par \c threaded).</dd>
+ *
+ *   <dt>-t</dt><dd>niveau de trace, suivi de son nom : \c off (aucune trace),
+ *   \c branches (BRANCH seulement), \c calls (CALL et RET seulement) ou
+ *   \c full (toutes les instructions, par défaut), \c binary (toutes les
+ *   instructions, dans le fichier de trace binaire \c trace.bin ; voir
+ *   bintrace.h, trace_decode.c et trace_analyze.c) ou \c delta (de même, au
+ *   format compressé).</dd>
+ *
+ *   <dt>-s</dt><dd>après l'exécution, écrit un instantané de la machine dans
+ *   le fichier dont le nom suit (voir snapshot.h). Chargé avec \c -b,
+ *   l'instantané reprend l'exécution là où elle s'était arrêtée, c'est-à-dire
+ *   après le HALT : un programme qui termine ainsi sa phase d'initialisation
+ *   n'a plus à la réexécuter.</dd>
+ *
+ *   <dt>-p</dt><dd>profil de l'exécution (voir profile.h), affiché à la
+ *   fin : instructions les plus exécutées, répartition par code opération et
+ *   mode d'adressage, mots de données les plus lus ou écrits.</dd>
+ *
+ *   <dt>-i</dt><dd>profil par échantillonnage (voir sample.h), suivi de la
+ *   période en microsecondes de temps processeur : l'instruction en cours est
+ *   relevée à chaque période, sans ralentir l'exécution ; les instructions
+ *   les plus échantillonnées sont affichées à la fin, au format de \c -p.</dd>
+ *
+ *   <dt>-P</dt><dd>compteurs matériels de l'hôte (voir hostperf.h) pendant
+ *   l'exécution : cycles, instructions, branchements mal prédits et défauts
+ *   du cache L1 de données, affichés à la fin avec le nombre d'instructions
+ *   simulées et rapportés à chacune. Les compteurs indisponibles sont
+ *   signalés, sans empêcher l'exécution. La trace est comptée aussi.</dd>
+ *
+ *   <dt>-g</dt><dd>graphe d'appels de l'exécution (voir callgraph.h) : les
+ *   sous-programmes les plus coûteux sont affichés à la fin, et les piles
+ *   d'appels repliées, lues par les outils de \e flamegraph, sont écrites
+ *   dans le fichier dont le nom suit.</dd>
+ *
+ *   <dt>-k</dt><dd>vérification des instantanés (voir snapshot.h) : un
+ *   instantané complet est pris avant l'exécution et un point de reprise
+ *   après ; chacun est restauré et comparé à une copie de l'état de la
+ *   machine au même moment. L'état final est remis en place avant d'être
+ *   affiché. Le programme doit être lu dans un fichier (\c -b).</dd>
+ *
+ *   <dt>-c</dt><dd>cache des résultats, dans le répertoire dont le nom suit
+ *   (voir cache.h) : si le même état initial a déjà été exécuté, l'état final
+ *   est pris dans le cache, sans exécution ni trace ; sinon il y est ajouté
+ *   après l'exécution. Sans effet en mise au point, avec une trace binaire,
+ *   avec \c -p, \c -i, \c -P et \c -g.</dd>
+ *
  * </dl>
  */
 int main(int argc, char *argv[])
@@ -60,7 +205,17 @@ int main(int argc, char *argv[])
     bool debug = false;
     bool binfile = false;
     bool no_exec = false;
+    Engine engine = ENGINE_CALL;
+    Trace_Level trace_level = TRACE_FULL;
+    Bintrace_Format trace_format = BINTRACE_RAW;
     char *programfile = NULL;
+    char *snapshotfile = NULL;
+    char *cachedir = NULL;
+    char *callfile = NULL;
+    unsigned period = 0;
+    bool hostperf = false;
+    bool profile = false;
+    bool snapcheck = false;
 
     if (argc > 1) 
     {
@@ -78,6 +233,85 @@ int main(int argc, char *argv[])
                  case 'l': 
                     no_exec = true;
                     break;
+                 case 'e':
+                    if (iarg + 1 < argc && strcmp(argv[iarg + 1], "call") == 0)
+                        engine = ENGINE_CALL;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "threaded") == 0)
+                        engine = ENGINE_THREADED;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "verify") == 0)
+                        engine = ENGINE_VERIFY;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "jit") == 0)
+                        engine = ENGINE_JIT;
+                    else {
+                        fprintf(stderr, "Unknown engine for option -e\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    ++iarg;
+                    break;
+                 case 't':
+                    if (iarg + 1 < argc && strcmp(argv[iarg + 1], "off") == 0)
+                        trace_level = TRACE_OFF;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "branches") == 0)
+                        trace_level = TRACE_BRANCHES;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "calls") == 0)
+                        trace_level = TRACE_CALLS;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "full") == 0)
+                        trace_level = TRACE_FULL;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "binary") == 0)
+                        trace_level = TRACE_BINARY;
+                    else if (iarg + 1 < argc && strcmp(argv[iarg + 1], "delta") == 0) {
+                        trace_level = TRACE_BINARY;
+                        trace_format = BINTRACE_DELTA;
+                    }
+                    else {
+                        fprintf(stderr, "Unknown trace level for option -t\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    ++iarg;
+                    break;
+                case 's':
+                    if (iarg + 1 >= argc) {
+                        fprintf(stderr, "Missing file name for option -s\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    snapshotfile = argv[++iarg];
+                    break;
+                case 'p':
+                    profile = true;
+                    break;
+                case 'i':
+                    if (iarg + 1 >= argc || (period = strtoul(argv[iarg + 1], NULL, 0)) == 0) {
+                        fprintf(stderr, "Missing or null sampling period for option -i\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    ++iarg;
+                    break;
+                case 'P':
+                    hostperf = true;
+                    break;
+                case 'g':
+                    if (iarg + 1 >= argc) {
+                        fprintf(stderr, "Missing file name for option -g\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    callfile = argv[++iarg];
+                    break;
+                case 'k':
+                    snapcheck = true;
+                    break;
+                case 'c':
+                    if (iarg + 1 >= argc) {
+                        fprintf(stderr, "Missing directory name for option -c\n");
+                        usage();
+                        exit(EXIT_FAILURE);
+                    }
+                    cachedir = argv[++iarg];
+                    break;
                   case 'h':
                     usage();
                     exit(EXIT_SUCCESS);
@@ -93,12 +327,24 @@ int main(int argc, char *argv[])
         }
     }
 
+    //Hors mise au point, la sortie n'est pas interactive :
+    if (!debug)
+        trace_sink();
+
     Machine mach;
 
     if (!binfile) 
         load_program(&mach, textsize, text, datasize, data, dataend);
     else 
         read_program(&mach, programfile);   
+    mach._engine = engine;
+    mach._trace = trace_level;
+    if (trace_level == TRACE_BINARY)
+        bintrace_open(&mach, BINTRACE_FILE, trace_format);
+    if (profile)
+        profile_start(&mach);
+    if (callfile)
+        callgraph_start(&mach);
 
     printf("\n*** Sauvegarde des programmes et données initiales en format binaire ***\n\n");
     dump_memory(&mach);
@@ -108,15 +354,106 @@ int main(int argc, char *argv[])
     print_data(&mach);
     print_cpu(&mach);
 
-    if (no_exec) 
+    if (no_exec) {
+        free_program(&mach);
         return 0;
+    }
+
+    //Instantané et copie de l'état initial, comparés après l'exécution :
+    Snapshot *initial = NULL;
+    Machine before;
+    Word *before_data = NULL;
+    if (snapcheck) {
+        before = mach;
+        before_data = copy_data(&mach);
+        initial = snapshot_take(&mach);
+    }
+
+    Result_Cache *cache = NULL;
+    if (cachedir != NULL && !debug && trace_level != TRACE_BINARY && !profile
+        && callfile == NULL && period == 0 && !hostperf)
+        cache = cache_open(cachedir, CACHE_LIMIT);
+    else if (cachedir != NULL)
+        fprintf(stderr, "Option -c ignored with -d, -t binary/delta, -p, -i, -P or -g\n");
+
+    if (cache == NULL && (profile || callfile != NULL || period != 0 || hostperf)) {
+        //Les profils et le graphe d'appels sont affichés avant une éventuelle
+        //erreur, qui termine le simulateur :
+        printf("\n*** Execution trace ***\n\n");
+        Host_Counters hc;
+        if (hostperf)
+            hostperf_open(&hc, false);
+        if (period != 0)
+            sample_start(&mach, period, SAMPLE_MAX);
+        if (hostperf)
+            hostperf_start(&hc);
+        uint64_t instrs = mach._instrs;
+        Fault fault = simul_run(&mach, debug);
+        if (hostperf)
+            hostperf_stop(&hc);
+        sample_stop();
+        profile_report(&mach, PROFILE_TOP);
+        if (period != 0)
+            sample_report(&mach, PROFILE_TOP);
+        if (hostperf) {
+            hostperf_report(&hc, mach._instrs - instrs);
+            hostperf_close(&hc);
+        }
+        callgraph_report(&mach, PROFILE_TOP);
+        callgraph_write(&mach, callfile);
+        if (fault._error != ERR_NOERROR)
+            error(fault._error, fault._addr);
+    }
+    else if (cache == NULL) {
+        printf("\n*** Execution trace ***\n\n");
+        simul(&mach, debug);
+    }
+    else {
+        //L'empreinte et l'image initiale sont prises avant l'exécution, qui
+        //modifie le segment de données :
+        Cache_Key key = cache_key(&mach, mach._dataimage);
+        Fault fault;
+        if (cache_lookup(cache, &key, &mach, &fault)) {
+            printf("\n*** Final state taken from the cache (not traced) ***\n\n");
+            if (fault._error == ERR_NOERROR)
+                warning(WARN_HALT, fault._addr);
+        }
+        else {
+            Word *image = malloc(((size_t) mach._dataimage + 1) * sizeof(Word));
+            if (image == NULL) {
+                fprintf(stderr, "Erreur d'allocation dans <test_simul.c:main>\n");
+                exit(1);
+            }
+            memcpy(image, mach._data, (size_t) mach._dataimage * sizeof(Word));
+            printf("\n*** Execution trace ***\n\n");
+            fault = simul_run(&mach, debug);
+            cache_store(cache, &key, &mach, fault, mach._dataimage, image);
+            free(image);
+        }
 
-    printf("\n*** Execution trace ***\n\n");
-    simul(&mach, debug);
+        Cache_Stats stats;
+        cache_stats(cache, &stats);
+        printf("*** Cache %s: %llu hits, %llu misses ***\n", cachedir,
+               (unsigned long long) stats._hits, (unsigned long long) stats._misses);
+        cache_close(cache);
+        //Comportement de simul() : l'erreur termine le simulateur.
+        if (fault._error != ERR_NOERROR)
+            error(fault._error, fault._addr);
+    }
+    bintrace_close(&mach);
+    if (snapcheck)
+        check_snapshots(&mach, initial, &before, before_data);
+    if (snapshotfile)
+        snapshot_write(&mach, snapshotfile);
 
     printf("\n*** Machine state after execution ***\n");
     print_cpu(&mach);
     print_data(&mach);
 
+    if (mach._fused_ops)
+        printf("\n*** Superinstructions: %llu executed, covering %llu instructions ***\n",
+               (unsigned long long) mach._fused_ops, (unsigned long long) mach._fused_instrs);
+
+    free_program(&mach);
     return 0; 
 }
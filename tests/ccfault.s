@@ -0,0 +1,16 @@
+// Erreur juste après une instruction dont le code condition n'est jamais lu :
+// le second SUB le calcule pour rien si le ADD indexé qui suit réussit, mais
+// c'est lui que doit laisser l'erreur quand l'adresse 26 - n sort du segment.
+TEXT
+	LOAD R1, #6
+	SUB R1, @n
+	LOAD R2, @k
+	SUB R2, @k
+	ADD R3, 20[R1]
+	STORE R3, @k
+	HALT
+END
+DATA
+n	WORD 3
+k	WORD 5
+END
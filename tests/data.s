@@ -0,0 +1,33 @@
+// Données du segment : n rotations des quatre mots a, b, c et d par la pile,
+// en adressage absolu ; sum reçoit la somme des valeurs successives de a et
+// diff l'écart final b - d.
+TEXT
+	LOAD R1, @n
+	LOAD R2, #0
+turn	PUSH @a
+	PUSH @b
+	PUSH @c
+	PUSH @d
+	POP @a
+	POP @d
+	POP @c
+	POP @b
+	LOAD R3, @sum
+	ADD R3, @a
+	STORE R3, @sum
+	SUB R1, #1
+	BRANCH NE, @turn
+	LOAD R4, @b
+	SUB R4, @d
+	STORE R4, @diff
+	HALT
+END
+DATA
+n	WORD 5
+a	WORD 9
+b	WORD -4
+c	WORD 17
+d	WORD 3
+sum	WORD 0
+diff	WORD 0
+END
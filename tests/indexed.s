@@ -0,0 +1,46 @@
+// Adressage indexé : somme des n premiers mots de v, recopie de v dans w à
+// l'envers par PUSH et POP indexés, accès à déplacement négatif, puis lecture
+// à l'indice n + 30, hors du segment dès que n dépasse 8.
+TEXT
+	LOAD R1, @n
+	LOAD R2, #0
+sum	SUB R1, #1
+	ADD R2, v[R1]
+	SUB R1, #0
+	BRANCH NE, @sum
+	STORE R2, @total
+	LOAD R1, @n
+	LOAD R3, #0
+rev	SUB R1, #1
+	PUSH v[R3]
+	POP w[R1]
+	ADD R3, #1
+	SUB R1, #0
+	BRANCH NE, @rev
+	LOAD R4, #1
+	LOAD R5, w[R3]
+	SUB R5, -1[R4]
+	STORE R5, w[R4]
+	LOAD R6, 30[R3]
+	HALT
+END
+DATA
+n	WORD 5
+total	WORD 0
+v	WORD 3
+	WORD -1
+	WORD 4
+	WORD 1
+	WORD -5
+	WORD 9
+	WORD 2
+	WORD -6
+w	WORD 0
+	WORD 0
+	WORD 0
+	WORD 0
+	WORD 0
+	WORD 0
+	WORD 0
+	WORD 0
+END
@@ -0,0 +1,21 @@
+// Boucles imbriquées : sum reçoit la somme des i*i pour 1 <= i <= n.
+// La boucle interne (LOAD, ADD, STORE puis SUB, BRANCH) est fusionnée en
+// superinstructions par les moteurs qui le font.
+TEXT
+	LOAD R1, @n
+outer	STORE R1, @i
+	LOAD R2, @i
+inner	LOAD R3, @sum
+	ADD R3, @i
+	STORE R3, @sum
+	SUB R2, #1
+	BRANCH NE, @inner
+	SUB R1, #1
+	BRANCH GT, @outer
+	HALT
+END
+DATA
+n	WORD 12
+i	WORD 0
+sum	WORD 0
+END
@@ -0,0 +1,200 @@
+#!/bin/sh
+#
+# Test différentiel des moteurs d'exécution sur le corpus tests/*.s.
+#
+# Chaque programme est assemblé par asm, puis :
+#
+#   - exécuté par test_simul avec chaque moteur (-e call, threaded, verify et
+#   jit) : l'état final (registres, PC, CC, segment de données, erreur) doit
+#   être celui du moteur call ;
+#
+#   - exécuté par batch_simul en mode balayage sur IMAGES images de données
+#   (le mot 0 de l'image k vaut n + k, où n est le mot 0 du programme), avec
+#   -e threaded puis -e lockstep : les deux exécutions de chaque image doivent
+#   aboutir au même état final ;
+#
+#   - tracé par test_simul avec chaque moteur en -t full, -t binary et
+#   -t delta : les traces binaires, décodées par trace_decode, doivent
+#   redonner la trace textuelle du moteur call.
+#
+# test_simul s'arrête sur une erreur sans afficher la machine : l'état final
+# est donc relevé dans le cache de résultats (option -c), qui l'enregistre
+# même en cas d'erreur. Les programmes compilés sont pris à la racine du dépôt,
+# sauf si les variables ASM, TEST_SIMUL, BATCH_SIMUL ou TRACE_DECODE donnent
+# un autre chemin.
+#
+# Sortie : une ligne par test en échec, puis un bilan ; le code de retour est
+# non nul si un test a échoué.
+
+root=$(cd "$(dirname "$0")/.." && pwd)
+ASM=${ASM:-$root/asm}
+TEST_SIMUL=${TEST_SIMUL:-$root/test_simul}
+BATCH_SIMUL=${BATCH_SIMUL:-$root/batch_simul}
+TRACE_DECODE=${TRACE_DECODE:-$root/trace_decode}
+
+ENGINES="call threaded verify jit"
+TRACES="binary delta"
+IMAGES=16
+
+#Durée maximale de chaque exécution, si la commande timeout existe : un
+#moteur qui boucle fait échouer son test au lieu de bloquer les suivants.
+limit=
+if command -v timeout > /dev/null; then
+	limit="timeout 10"
+fi
+
+for tool in "$ASM" "$TEST_SIMUL" "$BATCH_SIMUL" "$TRACE_DECODE"; do
+	if [ ! -x "$tool" ]; then
+		echo "Missing program: $tool (build it, or set its variable)" >&2
+		exit 2
+	fi
+done
+
+work=$(mktemp -d) || exit 2
+trap 'rm -rf "$work"' EXIT
+
+tests=0
+failures=0
+
+#Échec d'un test : message, puis différences éventuelles (fichier $2 et $3).
+fail()
+{
+	echo "FAIL: $1"
+	if [ $# -eq 3 ]; then
+		diff "$2" "$3" | head -20
+	fi
+	failures=$((failures + 1))
+}
+
+#Comparaison de deux fichiers, comptée comme un test.
+check()
+{
+	tests=$((tests + 1))
+	if ! cmp -s "$2" "$3"; then
+		fail "$1" "$2" "$3"
+	fi
+}
+
+#État final enregistré dans un fichier de résultat du cache (voir
+#Cache_Entry dans cache.c), une valeur par ligne. L'empreinte et les
+#compteurs de superinstructions, propres à chaque moteur, sont omis ; les
+#intervalles modifiés du segment de données donnent une ligne par mot.
+state()
+{
+	od -An -v -tu4 "$1" | awk '
+		{ for (i = 1; i <= NF; i++) w[n++] = $i }
+		END {
+			if (w[0] != 1212367171 || w[1] != 2) {
+				print "unknown cache entry format"
+				exit
+			}
+			print "instrs", w[6] + w[7] * 4294967296
+			for (r = 0; r < 16; r++)
+				printf "R%02d %s\n", r, w[12 + r]
+			print "pc", w[30]
+			print "cc", w[31]
+			print "error", w[32]
+			print "addr", w[33]
+			nruns = w[34]
+			v = 36 + 2 * nruns
+			for (r = 0; r < nruns; r++)
+				for (a = 0; a < w[37 + 2 * r]; a++)
+					printf "data[%d] %s\n", w[36 + 2 * r] + a, w[v++]
+		}'
+}
+
+#Un mot de 32 bits, dans l'ordre des octets de l'hôte (petit-boutiste).
+le32()
+{
+	printf "$(printf '\\%03o\\%03o\\%03o\\%03o' $(($1 & 255)) $(($1 >> 8 & 255)) \
+		$(($1 >> 16 & 255)) $(($1 >> 24 & 255)))"
+}
+
+#Fichier d'images de données pour batch_simul -s (voir Sweep_Header dans
+#batch.h) : IMAGES variantes de l'image du programme $1, écrites dans $2.
+images()
+{
+	set -- "$1" "$2" $(od -An -tu4 -N12 "$1")
+	textsize=$3
+	dataend=$5
+	n=$(od -An -tu4 -j$((12 + 4 * textsize)) -N4 "$1")
+	{
+		le32 1346721619	# SWEEP_MAGIC
+		le32 1
+		le32 $IMAGES
+		le32 $dataend
+		k=0
+		while [ $k -lt $IMAGES ]; do
+			le32 $((n + k))
+			dd if="$1" bs=4 skip=$((3 + textsize + 1)) count=$((dataend - 1)) 2>/dev/null
+			k=$((k + 1))
+		done
+	} > "$2"
+}
+
+for source in "$root"/tests/*.s; do
+	name=$(basename "$source" .s)
+	dir=$work/$name
+	mkdir "$dir"
+
+	#Assemblage (asm écrit toujours output.bin dans le répertoire courant) :
+	(cd "$dir" && "$ASM" "$source" > asm.out 2>&1)
+	tests=$((tests + 1))
+	if [ ! -f "$dir/output.bin" ]; then
+		fail "$name: assembly"
+		continue
+	fi
+	bin=$dir/$name.bin
+	mv "$dir/output.bin" "$bin"
+
+	#État final et traces avec chaque moteur :
+	for engine in $ENGINES; do
+		run=$dir/$engine
+		mkdir "$run" "$run/cache"
+		(cd "$run" && $limit "$TEST_SIMUL" -t off -e $engine -c cache -b "$bin" > off.out 2>&1)
+		entry=$(ls "$run/cache")
+		if [ -z "$entry" ]; then
+			tests=$((tests + 1))
+			fail "$name: -e $engine left no result in the cache"
+		else
+			state "$run/cache/$entry" > "$run/state"
+			check "$name: -e $engine final state" "$dir/call/state" "$run/state"
+		fi
+
+		(cd "$run" && $limit "$TEST_SIMUL" -t full -e $engine -b "$bin" 2>/dev/null) | grep '^TRACE: ' > "$run/trace"
+		check "$name: -e $engine -t full" "$dir/call/trace" "$run/trace"
+		for format in $TRACES; do
+			rm -f "$run/trace.bin"
+			(cd "$run" && $limit "$TEST_SIMUL" -t $format -e $engine -b "$bin" > /dev/null 2>&1)
+			"$TRACE_DECODE" "$run/trace.bin" > "$run/$format" 2>&1
+			check "$name: -e $engine -t $format decoded" "$dir/call/trace" "$run/$format"
+		done
+	done
+
+	#Exécution groupée sur plusieurs images, avec et sans lockstep :
+	images "$bin" "$dir/images.bin"
+	for engine in threaded lockstep; do
+		mkdir "$dir/batch-$engine"
+		$limit "$BATCH_SIMUL" -e $engine -c "$dir/batch-$engine" -o "$dir/$engine.results" \
+			-s "$bin" "$dir/images.bin" > "$dir/$engine.out" 2>&1
+	done
+	check "$name: -e lockstep results" "$dir/threaded.results" "$dir/lockstep.results"
+	tests=$((tests + 1))
+	if [ $(ls "$dir/batch-threaded" | wc -l) -ne $IMAGES ]; then
+		fail "$name: -e threaded did not store $IMAGES results"
+	fi
+	for entry in $(ls "$dir/batch-threaded"); do
+		if [ ! -f "$dir/batch-lockstep/$entry" ]; then
+			tests=$((tests + 1))
+			fail "$name: -e lockstep missed image $entry"
+			continue
+		fi
+		state "$dir/batch-threaded/$entry" > "$dir/threaded.state"
+		state "$dir/batch-lockstep/$entry" > "$dir/lockstep.state"
+		check "$name: -e lockstep final state of image $entry" \
+		      "$dir/threaded.state" "$dir/lockstep.state"
+	done
+done
+
+echo "*** $tests tests, $failures failures ***"
+[ $failures -eq 0 ]
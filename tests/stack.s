@@ -0,0 +1,24 @@
+// Pile : somme récursive de n à 1. Chaque niveau empile l'adresse de retour
+// et sa valeur de R1 : au-delà de la profondeur que permet la pile, l'appel
+// échoue (erreur de pile).
+TEXT
+	LOAD R1, @n
+	LOAD R2, #0
+	CALL NC, @sum
+	STORE R2, @res
+	HALT
+sum	SUB R1, #0
+	BRANCH EQ, @leave
+	STORE R1, @tmp
+	PUSH @tmp
+	SUB R1, #1
+	CALL NC, @sum
+	POP @tmp
+	ADD R2, @tmp
+leave	RET
+END
+DATA
+n	WORD 6
+tmp	WORD 0
+res	WORD 0
+END
@@ -0,0 +1,21 @@
+// Fin hors du segment de texte : après une boucle, un branchement indexé
+// mène, selon n, à la dernière instruction, qui n'est pas un HALT, au HALT,
+// ou au-delà du texte.
+TEXT
+	LOAD R1, @n
+	LOAD R2, #0
+loop	ADD R2, @n
+	SUB R1, #1
+	BRANCH NE, @loop
+	LOAD R1, @n
+	SUB R1, #3
+	BRANCH NC, stop[R1]
+stop	BRANCH NC, @tail
+	HALT
+	ADD R2, #1
+tail	STORE R2, @res
+END
+DATA
+n	WORD 3
+res	WORD 0
+END
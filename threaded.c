@@ -0,0 +1,111 @@
+/*!
+ * \file threaded.c
+ * \brief Moteur d'exécution à dispatch direct (\e direct \e threading).
+ */
+
+#include "threaded.h"
+#include "exec.h"
+#include "exec_inline.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+//! Boucle de dispatch direct jusqu'à \c HALT
+/*!
+ * \param pmach la machine en cours d'exécution
+ * \param pcode reçoit le tableau des adresses de code, à libérer par
+ * l'appelant (même après une erreur)
+ */
+static void run_threaded(Machine *pmach, void **volatile *pcode)
+{
+	const Micro_Op *uops = pmach->_uops;
+	const Micro_Op *uop;
+
+#ifdef __GNUC__
+	//Code associé à chaque sorte de micro-opération, sans et avec trace :
+	static void *const kind_labels[UOP_NKINDS] = {
+#	define X(kind, name, op, mode, base) [kind] = &&do_##name,
+		UOP_KINDS(X)
+#	undef X
+	};
+	static void *const trace_labels[UOP_NKINDS] = {
+#	define X(kind, name, op, mode, base) [kind] = &&trace_##name,
+		UOP_KINDS(X)
+#	undef X
+	};
+
+	//Traduction des micro-opérations en adresses de code. Le niveau de trace
+	//est résolu ici, une fois pour toutes : une instruction non tracée saute
+	//directement à sa routine.
+	void **code = *pcode = malloc((pmach->_textsize ? pmach->_textsize : 1) * sizeof(void *));
+	if (code == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <threaded.c:run_threaded>\n");
+		exit(1);
+	}
+	for (unsigned i = 0; i < pmach->_textsize; i++)
+		code[i] = trace_wanted(pmach->_trace, pmach->_text[i])
+			? trace_labels[uops[i]._kind] : kind_labels[uops[i]._kind];
+
+	//Recherche de l'instruction suivante et saut vers son code :
+#	define DISPATCH()							\
+	do {									\
+		if (pmach->_pc >= pmach->_textsize)				\
+			error(ERR_SEGTEXT, pmach->_pc - 1);			\
+		uop = &uops[pmach->_pc];					\
+		pmach->_instrs++;						\
+		goto *code[pmach->_pc++];					\
+	} while (0)
+
+	DISPATCH();
+
+	//Une copie de chaque routine spécialisée, précédée de sa trace et suivie
+	//de son propre dispatch :
+#	define X(kind, name, op, mode, base)					\
+trace_##name:								\
+	trace_exec(pmach, pmach->_pc - 1);					\
+do_##name:								\
+	if (!exec_##op(pmach, uop, mode))				\
+		goto done;						\
+	DISPATCH();
+	UOP_KINDS(X)
+#	undef X
+
+done:
+	return;
+#	undef DISPATCH
+#else
+	(void) pcode;
+	bool stop = true;
+	while (stop) {
+		if (pmach->_pc >= pmach->_textsize)
+			error(ERR_SEGTEXT, pmach->_pc - 1);
+		if (trace_wanted(pmach->_trace, pmach->_text[pmach->_pc]))
+			trace_exec(pmach, pmach->_pc);
+		uop = &uops[pmach->_pc++];
+		pmach->_instrs++;
+		stop = uop->_handler(pmach, uop);
+	}
+#endif
+}
+
+//! Exécution par dispatch direct jusqu'à \c HALT
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_threaded(Machine *pmach)
+{
+	void **volatile code = NULL;
+
+	//Sur une erreur, le tableau est libéré avant de transmettre l'erreur
+	//(volatile : après longjmp(), code vaut ce qu'y a rangé run_threaded()) :
+	Fault_Handler handler;
+	fault_push(&handler);
+	if (setjmp(handler._env)) {
+		free(code);
+		fault_raise(handler._fault);
+	}
+
+	run_threaded(pmach, &code);
+
+	fault_pop(&handler);
+	free(code);
+}
@@ -0,0 +1,27 @@
+#ifndef _THREADED_H_
+#define _THREADED_H_
+
+/*!
+ * \file threaded.h
+ * \brief Moteur d'exécution à dispatch direct (\e direct \e threading).
+ */
+
+#include "machine.h"
+
+//! Exécution par dispatch direct jusqu'à \c HALT
+/*!
+ * Chaque micro-opération est associée à l'adresse du code qui l'exécute
+ * (extension \e labels-as-values de GNU C). Chaque routine se termine par son
+ * propre saut indirect vers la micro-opération suivante, au lieu de revenir à
+ * un unique point de dispatch : le prédicteur de branchement de l'hôte dispose
+ * ainsi d'un historique par routine. L'état final de la machine est
+ * identique à celui produit par la boucle de simul().
+ *
+ * Sans GNU C, on se replie sur l'appel de la routine de chaque
+ * micro-opération.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_threaded(Machine *pmach);
+
+#endif
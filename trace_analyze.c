@@ -0,0 +1,147 @@
+/*!
+ * \file trace_analyze.c
+ * \brief Analyse d'une trace binaire (voir tracefile.h).
+ *
+ * Affiche la répartition des instructions exécutées par code opération, puis
+ * les adresses d'instruction les plus exécutées. La trace est lue une seule
+ * fois, séquentiellement, depuis le fichier projeté en mémoire : l'analyse va
+ * à la vitesse du disque, sans relancer la simulation.
+ *
+ * À compiler avec tracefile.c et instruction.c seulement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bintrace.h"
+#include "tracefile.h"
+#include "instruction.h"
+
+//! Nombre de codes opération possibles (champ de 6 bits)
+#define NCOPS 64
+
+//! Nombre d'adresses affichées par défaut
+#define DEFAULT_TOP 10
+
+//! Adresse d'instruction et nombre d'exécutions
+typedef struct
+{
+    unsigned _pc;		//!< Adresse de l'instruction
+    unsigned long long _count;	//!< Nombre d'exécutions
+} PC_Count;
+
+//! Comparaison par nombre d'exécutions décroissant, puis par adresse.
+static int compare_pc_count(const void *a, const void *b)
+{
+    const PC_Count *x = a, *y = b;
+    if (x->_count != y->_count)
+        return x->_count < y->_count ? 1 : -1;
+    return x->_pc < y->_pc ? -1 : x->_pc > y->_pc;
+}
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: trace_analyze [options] [tracefile]\n");
+    printf("where options are:\n"
+           "\t-n N\tShow the N most executed addresses (default %d, 0 for all)\n"
+           "\t-h\tprint this help message\n"
+           "The trace file defaults to " BINTRACE_FILE ".\n", DEFAULT_TOP);
+}
+
+//! Analyseur de trace binaire
+/*!
+ * \param argc nombre d'arguments
+ * \param argv options, puis nom du fichier de trace
+ */
+int main(int argc, char *argv[])
+{
+    unsigned top = DEFAULT_TOP;
+    const char *tracefile = BINTRACE_FILE;
+
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        if (strcmp(argv[iarg], "-n") == 0 && iarg + 1 < argc)
+            top = strtoul(argv[++iarg], NULL, 0);
+        else if (strcmp(argv[iarg], "-h") == 0) {
+            usage();
+            exit(EXIT_SUCCESS);
+        }
+        else if (argv[iarg][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        else
+            tracefile = argv[iarg];
+    }
+
+    Trace_File tf;
+    tracefile_open(&tf, tracefile);
+
+    //Au format brut, le segment de texte n'est pas dans le fichier : on garde
+    //la dernière instruction vue à chaque adresse.
+    unsigned long long *counts = calloc(tf._textsize ? tf._textsize : 1, sizeof(*counts));
+    Instruction *text = calloc(tf._textsize ? tf._textsize : 1, sizeof(*text));
+    if (counts == NULL || text == NULL) {
+        fprintf(stderr, "Erreur d'allocation dans <trace_analyze.c:main>\n");
+        exit(1);
+    }
+
+    unsigned long long ops[NCOPS] = { 0 };
+    unsigned long long total = 0, outside = 0;
+    while (tracefile_next(&tf))
+    {
+        ops[tf._instr.instr_generic._cop]++;
+        if (tf._pc < tf._textsize) {
+            counts[tf._pc]++;
+            text[tf._pc] = tf._instr;
+        } else
+            outside++;
+        total++;
+    }
+
+    printf("*** %s: %llu instructions, %s format, %.2f bytes per instruction ***\n",
+           tracefile, total, tf._format == BINTRACE_DELTA ? "delta" : "raw",
+           total ? (double) tf._size / total : 0.0);
+
+    printf("\n*** Opcode mix ***\n");
+    for (unsigned cop = 0; cop < NCOPS; cop++)
+        if (ops[cop])
+            printf("%-8s %12llu  %6.2f%%\n", cop <= LAST_COP ? cop_names[cop] : "???",
+                   ops[cop], 100.0 * ops[cop] / total);
+
+    PC_Count *pcs = malloc((tf._textsize ? tf._textsize : 1) * sizeof(*pcs));
+    if (pcs == NULL) {
+        fprintf(stderr, "Erreur d'allocation dans <trace_analyze.c:main>\n");
+        exit(1);
+    }
+    unsigned npcs = 0;
+    for (unsigned pc = 0; pc < tf._textsize; pc++)
+        if (counts[pc])
+            pcs[npcs++] = (PC_Count) { pc, counts[pc] };
+    qsort(pcs, npcs, sizeof(*pcs), compare_pc_count);
+    if (top == 0 || top > npcs)
+        top = npcs;
+
+    printf("\n*** Most executed addresses (%u of %u) ***\n", top, npcs);
+    char buf[INSTR_TEXT_SIZE];
+    for (unsigned i = 0; i < top; i++)
+    {
+        sprint_instruction(buf, text[pcs[i]._pc], pcs[i]._pc);
+        printf("0x%04x %12llu  %6.2f%%  %s\n", pcs[i]._pc, pcs[i]._count,
+               100.0 * pcs[i]._count / total, buf);
+    }
+    if (outside)
+        printf("(%llu instructions outside the text segment)\n", outside);
+
+    free(pcs);
+    free(text);
+    free(counts);
+    tracefile_close(&tf);
+    return 0;
+}
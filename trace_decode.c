@@ -0,0 +1,87 @@
+/*!
+ * \file trace_decode.c
+ * \brief Décodage d'une trace binaire (voir tracefile.h) en trace textuelle.
+ *
+ * Le texte produit est celui de trace() : une ligne <tt>TRACE: Executing:</tt>
+ * par instruction exécutée. Avec l'option \c -v, chaque ligne est suivie de la
+ * valeur du registre destination et du code condition après l'instruction.
+ * L'option <tt>-s N</tt> commence au N-ième enregistrement (à partir de 0).
+ *
+ * À compiler avec tracefile.c et instruction.c seulement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bintrace.h"
+#include "tracefile.h"
+#include "instruction.h"
+
+//! Forme imprimable des codes condition
+static const char *cc_names[] = { "U", "Z", "P", "N" };
+
+//! Help message.
+/*!
+ * Printed with option \c -h.
+ */
+static void usage()
+{
+    printf("Usage: trace_decode [options] [tracefile]\n");
+    printf("where options are:\n"
+           "\t-v\tAlso print the destination register value and CC\n"
+           "\t-s N\tStart at record N (counting from 0)\n"
+           "\t-h\tprint this help message\n"
+           "The trace file defaults to " BINTRACE_FILE ".\n");
+}
+
+//! Décodeur de trace binaire
+/*!
+ * \param argc nombre d'arguments
+ * \param argv options, puis nom du fichier de trace
+ */
+int main(int argc, char *argv[])
+{
+    bool verbose = false;
+    unsigned long long start = 0;
+    const char *tracefile = BINTRACE_FILE;
+
+    for (int iarg = 1; iarg < argc; ++iarg)
+    {
+        if (strcmp(argv[iarg], "-v") == 0)
+            verbose = true;
+        else if (strcmp(argv[iarg], "-s") == 0 && iarg + 1 < argc)
+            start = strtoull(argv[++iarg], NULL, 0);
+        else if (strcmp(argv[iarg], "-h") == 0) {
+            usage();
+            exit(EXIT_SUCCESS);
+        }
+        else if (argv[iarg][0] == '-') {
+            fprintf(stderr, "Unknown option: %s\n", argv[iarg]);
+            usage();
+            exit(EXIT_FAILURE);
+        }
+        else
+            tracefile = argv[iarg];
+    }
+
+    Trace_File tf;
+    tracefile_open(&tf, tracefile);
+    if (!tracefile_seek(&tf, start)) {
+        fprintf(stderr, "Erreur : la trace a moins de %llu enregistrements <trace_decode.c:main>\n", start);
+        exit(1);
+    }
+
+    char buf[INSTR_TEXT_SIZE];
+    while (tracefile_next(&tf))
+    {
+        sprint_instruction(buf, tf._instr, tf._pc);
+        printf("TRACE: Executing: 0x%04x: %s\n", tf._pc, buf);
+        if (verbose)
+            printf("\tvalue = 0x%08x, CC = %s\n", tf._value,
+                   tf._cc <= CC_N ? cc_names[tf._cc] : "?");
+    }
+
+    tracefile_close(&tf);
+    return 0;
+}
@@ -0,0 +1,302 @@
+/*!
+ * \file tracefile.c
+ * \brief Lecture des fichiers de trace binaire (voir tracefile.h).
+ */
+
+#define _POSIX_C_SOURCE 200112L	// posix_madvise()
+
+#include "tracefile.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//! Fichier de trace mal formé : erreur fatale.
+/*!
+ * \param what ce qui est mal formé
+ * \param where la fonction qui l'a lu
+ */
+static void malformed(const char *what, const char *where)
+{
+	fprintf(stderr, "Erreur : trace binaire mal formée (%s) dans <tracefile.c:%s>\n", what, where);
+	exit(1);
+}
+
+//! Lecture d'un entier codé en varint.
+/*!
+ * \param tf le lecteur
+ * \return l'entier
+ */
+static inline uint64_t get_varint(Trace_File *tf)
+{
+	const uint8_t *p = tf->_cur;
+	uint64_t value = 0;
+	int shift = 0;
+
+	do {
+		if (p >= tf->_end || shift > 63)
+			malformed("varint", "get_varint");
+		value |= (uint64_t) (*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	tf->_cur = p;
+	return value;
+}
+
+//! Lecture d'une image complète de l'état.
+/*!
+ * \param tf le lecteur, positionné après l'étiquette
+ */
+static void read_keyframe(Trace_File *tf)
+{
+	tf->_count = get_varint(tf);
+	tf->_next_pc = get_varint(tf);
+	for (int i = 0; i < NREGISTERS; i++)
+		tf->_registers[i] = get_varint(tf);
+	if (tf->_cur >= tf->_end)
+		malformed("image complète", "read_keyframe");
+	tf->_cc = *tf->_cur++;
+	for (unsigned i = 0; i < tf->_datasize; i++)
+		tf->_data[i] = get_varint(tf);
+}
+
+//! Lecture d'un enregistrement au format compressé.
+/*!
+ * \param tf le lecteur
+ * \return faux à la fin de la trace
+ */
+static bool next_delta(Trace_File *tf)
+{
+	uint8_t tag;
+
+	for (;;) {
+		if (tf->_cur >= tf->_end)
+			return false;	// trace interrompue, sans DELTA_END
+		tag = *tf->_cur++;
+		if (tag == DELTA_END) {
+			tf->_cur--;
+			return false;
+		}
+		if (tag != DELTA_KEYFRAME)
+			break;
+		read_keyframe(tf);
+	}
+
+	tf->_pc = tf->_next_pc;
+	if (tag & DELTA_JUMP)
+		tf->_pc += unzigzag(get_varint(tf));
+	if (tf->_pc >= tf->_textsize)
+		malformed("adresse d'instruction", "next_delta");
+	tf->_instr = tf->_text[tf->_pc];
+	tf->_next_pc = tf->_pc + 1;
+
+	tf->_reg = trace_dest_register(tf->_instr);
+	if (tag & DELTA_REG) {
+		if (tf->_reg < 0)
+			malformed("registre destination", "next_delta");
+		tf->_registers[tf->_reg] += unzigzag(get_varint(tf));
+		Code_Op cop = tf->_instr.instr_generic._cop;
+		if (cop == LOAD || cop == ADD || cop == SUB)
+			tf->_cc = tf->_registers[tf->_reg] ? CC_P : CC_Z;
+	}
+	if (tf->_reg >= 0)
+		tf->_value = tf->_registers[tf->_reg];
+	else
+		tf->_value = 0;
+
+	tf->_data_addr = -1;
+	if (tag & DELTA_DATA) {
+		uint64_t addr = get_varint(tf);
+		if (addr >= tf->_datasize)
+			malformed("adresse de données", "next_delta");
+		tf->_data[addr] += unzigzag(get_varint(tf));
+		tf->_data_addr = addr;
+	}
+
+	tf->_index = tf->_count++;
+	return true;
+}
+
+//! Lecture d'un enregistrement au format brut.
+/*!
+ * \param tf le lecteur
+ * \return faux à la fin de la trace
+ */
+static bool next_raw(Trace_File *tf)
+{
+	if ((size_t) (tf->_end - tf->_cur) < sizeof(Trace_Record))
+		return false;
+
+	Trace_Record rec;
+	memcpy(&rec, tf->_cur, sizeof(rec));
+	tf->_cur += sizeof(rec);
+
+	tf->_pc = rec._pc;
+	tf->_instr._raw = rec._raw;
+	tf->_reg = trace_dest_register(tf->_instr);
+	tf->_value = rec._value;
+	tf->_cc = rec._cc;
+	tf->_data_addr = -1;
+	tf->_next_pc = rec._pc + 1;
+	tf->_index = tf->_count++;
+	return true;
+}
+
+//! Ouverture d'un fichier de trace binaire
+/*!
+ * \param tf le lecteur à initialiser
+ * \param filename le nom du fichier
+ */
+void tracefile_open(Trace_File *tf, const char *filename)
+{
+	memset(tf, 0, sizeof(*tf));
+
+	int fd = open(filename, O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		fprintf(stderr, "Erreur d'ouverture du fichier de trace dans <tracefile.c:tracefile_open>\n");
+		exit(1);
+	}
+	tf->_size = st.st_size;
+	if (tf->_size < sizeof(Trace_Header))
+		malformed("en-tête", "tracefile_open");
+
+	void *base = mmap(NULL, tf->_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		fprintf(stderr, "Erreur de projection du fichier de trace dans <tracefile.c:tracefile_open>\n");
+		exit(1);
+	}
+	posix_madvise(base, tf->_size, POSIX_MADV_SEQUENTIAL);
+	tf->_base = base;
+	tf->_end = tf->_base + tf->_size;
+
+	Trace_Header header;
+	memcpy(&header, tf->_base, sizeof(header));
+	if (header._magic != BINTRACE_MAGIC)
+		malformed("identification", "tracefile_open");
+	tf->_format = header._version;
+	tf->_textsize = header._textsize;
+	tf->_cur = tf->_base + sizeof(header);
+
+	if (tf->_format == BINTRACE_RAW) {
+		if (header._record_size != sizeof(Trace_Record))
+			malformed("taille d'enregistrement", "tracefile_open");
+		return;
+	}
+	if (tf->_format != BINTRACE_DELTA)
+		malformed("version", "tracefile_open");
+
+	Delta_Header delta;
+	if ((size_t) (tf->_end - tf->_cur) < sizeof(delta) + (size_t) tf->_textsize * sizeof(Instruction))
+		malformed("en-tête", "tracefile_open");
+	memcpy(&delta, tf->_cur, sizeof(delta));
+	tf->_cur += sizeof(delta);
+	tf->_datasize = delta._datasize;
+	tf->_dataend = delta._dataend;
+	//Le segment de texte est aligné sur 4 octets dans le fichier :
+	tf->_text = (const Instruction *) tf->_cur;
+	tf->_cur += (size_t) tf->_textsize * sizeof(Instruction);
+
+	tf->_data = calloc(tf->_datasize ? tf->_datasize : 1, sizeof(Word));
+	if (tf->_data == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <tracefile.c:tracefile_open>\n");
+		exit(1);
+	}
+
+	//Index des images complètes, s'il est complet :
+	Delta_Trailer trailer;
+	size_t items = tf->_cur - tf->_base;
+	if (tf->_size - items >= sizeof(trailer)) {
+		memcpy(&trailer, tf->_end - sizeof(trailer), sizeof(trailer));
+		if (trailer._magic == BINTRACE_MAGIC && trailer._index_offset >= items
+		    && trailer._index_offset < tf->_size - sizeof(trailer)
+		    && tf->_base[trailer._index_offset] == DELTA_END) {
+			const uint8_t *index = tf->_base + trailer._index_offset;
+			tf->_cur = index + 1;
+			tf->_end = tf->_base + tf->_size - sizeof(trailer);
+			tf->_nkeyframes = get_varint(tf);
+			tf->_keyframes = tf->_cur;
+			if (tf->_nkeyframes > (uint64_t) (tf->_end - tf->_cur) / 8)
+				malformed("index", "tracefile_open");
+			tf->_end = index;
+			tf->_cur = tf->_base + items;
+		}
+	}
+}
+
+//! Lecture de l'enregistrement suivant
+/*!
+ * \param tf le lecteur
+ * \return faux à la fin de la trace
+ */
+bool tracefile_next(Trace_File *tf)
+{
+	if (tf->_format == BINTRACE_RAW)
+		return next_raw(tf);
+	return next_delta(tf);
+}
+
+//! Positionnement avant un enregistrement
+/*!
+ * \param tf le lecteur
+ * \param index numéro de l'enregistrement
+ * \return faux si la trace a moins de \c index enregistrements
+ */
+bool tracefile_seek(Trace_File *tf, uint64_t index)
+{
+	const uint8_t *start = tf->_base + sizeof(Trace_Header);
+
+	if (tf->_format == BINTRACE_RAW) {
+		uint64_t count = (tf->_end - start) / sizeof(Trace_Record);
+		if (index > count)
+			return false;
+		tf->_cur = start + index * sizeof(Trace_Record);
+		tf->_count = index;
+		return true;
+	}
+
+	//Dernière image complète avant index (la première ouvre la trace) :
+	uint64_t lo = 0, hi = tf->_nkeyframes;
+	const uint8_t *keyframe = (const uint8_t *) (tf->_text + tf->_textsize);
+	if (keyframe >= tf->_end || *keyframe != DELTA_KEYFRAME) {
+		//Trace vide :
+		tf->_cur = tf->_end;
+		return index == 0;
+	}
+	while (lo < hi) {
+		uint64_t mid = lo + (hi - lo) / 2;
+		uint64_t offset;
+		memcpy(&offset, tf->_keyframes + 8 * mid, 8);
+		const uint8_t *p = tf->_base + offset;
+		if (p < keyframe || p >= tf->_end || *p != DELTA_KEYFRAME)
+			malformed("index", "tracefile_seek");
+		//Numéro de l'enregistrement qui suit l'image :
+		tf->_cur = p + 1;
+		if (get_varint(tf) <= index) {
+			keyframe = p;
+			lo = mid + 1;
+		} else
+			hi = mid;
+	}
+
+	tf->_cur = keyframe + 1;
+	read_keyframe(tf);
+	while (tf->_count < index)
+		if (!next_delta(tf))
+			return false;
+	return true;
+}
+
+//! Fermeture d'un fichier de trace binaire
+/*!
+ * \param tf le lecteur
+ */
+void tracefile_close(Trace_File *tf)
+{
+	munmap((void *) tf->_base, tf->_size);
+	free(tf->_data);
+}
@@ -0,0 +1,247 @@
+#ifndef _TRACEFILE_H_
+#define _TRACEFILE_H_
+
+/*!
+ * \file tracefile.h
+ * \brief Formats des fichiers de trace binaire et lecture de ces fichiers.
+ *
+ * Deux formats partagent le même en-tête (\link Trace_Header \endlink) :
+ *
+ *   - le format brut (\c BINTRACE_RAW), une suite d'enregistrements
+ *   \link Trace_Record \endlink de taille fixe ;
+ *
+ *   - le format compressé (\c BINTRACE_DELTA), décrit ci-dessous.
+ *
+ * <b>Format compressé.</b> L'en-tête est suivi de \link Delta_Header \endlink
+ * et du segment de texte, puis d'une suite d'éléments. Chaque élément commence
+ * par un octet d'étiquette :
+ *
+ *   - \c DELTA_KEYFRAME : image complète de l'état \e avant l'enregistrement
+ *   suivant, pour se positionner au milieu de la trace : numéro de
+ *   l'enregistrement suivant, adresse attendue de l'instruction suivante,
+ *   les \c NREGISTERS registres, le code condition (un octet) et les
+ *   \c datasize mots du segment de données ;
+ *
+ *   - \c DELTA_END : fin des éléments, suivie de l'index des images
+ *   complètes : leur nombre puis, pour chacune, sa position dans le fichier
+ *   (8 octets), et enfin de \link Delta_Trailer \endlink ;
+ *
+ *   - sinon, un enregistrement, c'est-à-dire une instruction exécutée. Les
+ *   bits de l'étiquette indiquent les champs présents, dans cet ordre :
+ *   \c DELTA_JUMP, l'écart entre l'adresse de l'instruction et l'adresse qui
+ *   suit la précédente ; \c DELTA_REG, la variation du registre destination ;
+ *   \c DELTA_DATA, l'adresse du mot de données écrit puis sa variation.
+ *
+ * L'instruction elle-même n'est pas enregistrée : elle est lue dans le
+ * segment de texte. Le registre destination s'en déduit aussi (celui de LOAD,
+ * ADD et SUB, le pointeur de pile pour PUSH, POP, CALL et RET), ainsi que le
+ * code condition : seuls LOAD, ADD et SUB le modifient, selon leur résultat.
+ * Un LOAD, ADD ou SUB a toujours \c DELTA_REG, même si le registre ne change
+ * pas ; les autres enregistrements n'ont un champ que s'il change.
+ *
+ * Les entiers des éléments sont codés en \e varint (7 bits par octet, poids
+ * faibles d'abord) ; les écarts et variations, signés, sont d'abord
+ * transformés par zigzag(). Un enregistrement typique occupe 2 octets, contre
+ * 16 au format brut.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "machine.h"
+
+//! Identification d'un fichier de trace binaire
+#define BINTRACE_MAGIC 0x43525453	// "STRC"
+
+//! Format d'un fichier de trace binaire (champ \c _version de l'en-tête)
+typedef enum
+{
+    BINTRACE_RAW = 1,		//!< Enregistrements bruts de taille fixe
+    BINTRACE_DELTA = 2,		//!< Enregistrements compressés et images complètes
+} Bintrace_Format;
+
+//! En-tête d'un fichier de trace binaire
+/*!
+ * Tous les entiers de taille fixe sont écrits dans l'ordre des octets de
+ * l'hôte.
+ */
+typedef struct
+{
+    uint32_t _magic;		//!< \c BINTRACE_MAGIC
+    uint32_t _version;		//!< Format (\link Bintrace_Format \endlink)
+    uint32_t _record_size;	//!< sizeof(Trace_Record) au format brut, 0 sinon
+    uint32_t _textsize;		//!< Taille du segment de texte tracé
+} Trace_Header;
+
+//! Enregistrement du format brut : une instruction exécutée
+/*!
+ * \c _value et \c _cc décrivent l'état \e après l'exécution de l'instruction.
+ * Le registre destination est celui de LOAD, ADD et SUB, et le pointeur de
+ * pile (R15) pour PUSH, POP, CALL et RET ; \c _value vaut 0 pour les autres
+ * instructions. \c _cc est le code condition architectural, même lorsque le
+ * moteur d'exécution a omis de le calculer (voir \c UOP_CC_DEAD).
+ *
+ * Si le simulateur s'arrête sur une erreur, le dernier enregistrement est
+ * celui de l'instruction fautive, avec l'état au moment de l'erreur.
+ */
+typedef struct
+{
+    uint32_t _pc;		//!< Adresse de l'instruction
+    uint32_t _raw;		//!< L'instruction (Instruction._raw)
+    Word _value;		//!< Valeur du registre destination
+    uint8_t _cc;		//!< Code condition (\link Condition_Code \endlink)
+    uint8_t _pad[3];		//!< Alignement sur 16 octets
+} Trace_Record;
+
+//! Suite de l'en-tête au format compressé
+typedef struct
+{
+    uint32_t _datasize;		//!< Taille du segment de données
+    uint32_t _dataend;		//!< Première adresse libre après les données statiques
+    uint32_t _keyframe_interval;//!< Nombre d'enregistrements entre deux images complètes
+    uint32_t _pad;		//!< Alignement sur 8 octets
+} Delta_Header;
+
+//! Fin d'un fichier au format compressé
+typedef struct
+{
+    uint64_t _index_offset;	//!< Position de l'index des images complètes
+    uint32_t _magic;		//!< \c BINTRACE_MAGIC
+    uint32_t _pad;		//!< Alignement sur 8 octets
+} Delta_Trailer;
+
+//! Étiquettes des éléments du format compressé
+enum
+{
+    DELTA_KEYFRAME = 0x01,	//!< Image complète de l'état
+    DELTA_JUMP = 0x02,		//!< L'instruction ne suit pas la précédente
+    DELTA_REG = 0x04,		//!< Le registre destination est présent
+    DELTA_DATA = 0x08,		//!< Un mot de données est présent
+    DELTA_END = 0x80,		//!< Fin des éléments
+};
+
+//! Transformation zigzag d'un entier signé : les petites valeurs absolues
+//! donnent de petits entiers non signés (0, -1, 1, -2... donnent 0, 1, 2, 3...).
+static inline uint32_t zigzag(int32_t value)
+{
+    return ((uint32_t) value << 1) ^ (uint32_t) (value >> 31);
+}
+
+//! Transformation inverse de zigzag().
+static inline int32_t unzigzag(uint32_t value)
+{
+    return (int32_t) (value >> 1) ^ -(int32_t) (value & 1);
+}
+
+//! Écriture d'un entier en varint.
+/*!
+ * \param buf tampon de destination (au moins 10 octets libres)
+ * \param value l'entier
+ * \return la fin de l'entier écrit dans \c buf
+ */
+static inline uint8_t *put_varint(uint8_t *buf, uint64_t value)
+{
+    while (value >= 0x80) {
+        *buf++ = (uint8_t) value | 0x80;
+        value >>= 7;
+    }
+    *buf++ = (uint8_t) value;
+    return buf;
+}
+
+//! Registre destination d'une instruction dans la trace
+/*!
+ * \param instr l'instruction
+ * \return le registre de LOAD, ADD et SUB, le pointeur de pile pour PUSH,
+ * POP, CALL et RET, -1 pour les autres instructions
+ */
+static inline int trace_dest_register(Instruction instr)
+{
+    switch (instr.instr_generic._cop) {
+    case LOAD:
+    case ADD:
+    case SUB:
+        return instr.instr_generic._regcond;
+    case PUSH:
+    case POP:
+    case CALL:
+    case RET:
+        return NREGISTERS - 1;
+    default:
+        return -1;
+    }
+}
+
+//! Lecteur de fichier de trace binaire, dans l'un ou l'autre format.
+/*!
+ * Le fichier est projeté en mémoire et lu séquentiellement par
+ * tracefile_next(). Après chaque appel, les champs \c _pc à \c _cc décrivent
+ * l'instruction lue et l'état après son exécution. Au format compressé,
+ * l'état complet (registres et segment de données) est maintenu ; au format
+ * brut, seuls le registre destination et le code condition sont connus.
+ */
+typedef struct
+{
+    const uint8_t *_base;	//!< Début du fichier projeté
+    size_t _size;		//!< Taille du fichier
+    const uint8_t *_cur;	//!< Prochain élément à lire
+    const uint8_t *_end;	//!< Fin des éléments
+
+    Bintrace_Format _format;	//!< Format du fichier
+    const Instruction *_text;	//!< Segment de texte (format compressé)
+    unsigned _textsize;		//!< Taille du segment de texte
+    unsigned _datasize;		//!< Taille du segment de données (format compressé)
+    unsigned _dataend;		//!< Fin des données statiques (format compressé)
+
+    uint64_t _nkeyframes;	//!< Nombre d'images complètes indexées
+    const uint8_t *_keyframes;	//!< Index des images complètes (positions sur 8 octets)
+
+    uint64_t _count;		//!< Nombre d'enregistrements lus
+    uint64_t _index;		//!< Numéro de l'enregistrement lu (à partir de 0)
+    unsigned _pc;		//!< Adresse de l'instruction lue
+    Instruction _instr;		//!< Instruction lue
+    int _reg;			//!< Registre destination, ou -1
+    Word _value;		//!< Valeur du registre destination
+    Condition_Code _cc;		//!< Code condition après l'instruction
+    int64_t _data_addr;		//!< Mot de données écrit, ou -1
+    unsigned _next_pc;		//!< Adresse attendue de l'instruction suivante
+    Word _registers[NREGISTERS];//!< Registres après l'instruction (format compressé)
+    Word *_data;		//!< Segment de données après l'instruction (format compressé)
+} Trace_File;
+
+//! Ouverture d'un fichier de trace binaire
+/*!
+ * Un fichier mal formé est une erreur fatale.
+ *
+ * \param tf le lecteur à initialiser
+ * \param filename le nom du fichier
+ */
+void tracefile_open(Trace_File *tf, const char *filename);
+
+//! Lecture de l'enregistrement suivant
+/*!
+ * \param tf le lecteur
+ * \return faux à la fin de la trace
+ */
+bool tracefile_next(Trace_File *tf);
+
+//! Positionnement avant un enregistrement
+/*!
+ * Au format compressé, la lecture reprend à l'image complète qui précède
+ * \c index puis avance jusqu'à lui ; au format brut, elle reprend directement
+ * à \c index. L'appel suivant à tracefile_next() lit l'enregistrement
+ * \c index.
+ *
+ * \param tf le lecteur
+ * \param index numéro de l'enregistrement
+ * \return faux si la trace a moins de \c index enregistrements
+ */
+bool tracefile_seek(Trace_File *tf, uint64_t index);
+
+//! Fermeture d'un fichier de trace binaire
+/*!
+ * \param tf le lecteur
+ */
+void tracefile_close(Trace_File *tf);
+
+#endif
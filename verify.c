@@ -0,0 +1,117 @@
+/*!
+ * \file verify.c
+ * \brief Vérification des routines spécialisées par le décodeur de référence.
+ */
+
+#include "verify.h"
+#include "exec.h"
+#include "decode.h"
+#include "error.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//! Signale une divergence entre les deux exécutions et termine le simulateur.
+/*!
+ * \param what l'élément de l'état qui diffère
+ * \param addr adresse de l'instruction en cause
+ * \param expected valeur obtenue par decode_execute()
+ * \param found valeur obtenue par la micro-opération
+ */
+static void diverge(const char *what, unsigned addr, Word expected, Word found)
+{
+	fprintf(stderr, "Divergence de %s apres l'instruction 0x%04x : 0x%08x attendu, 0x%08x obtenu <verify.c:simul_verify>\n",
+		what, addr, expected, found);
+	exit(1);
+}
+
+//! Compare un mot de données des deux machines, s'il est dans le segment.
+/*!
+ * \param ref la machine de référence
+ * \param pmach la machine exécutée par micro-opérations
+ * \param data_addr l'adresse du mot
+ * \param addr adresse de l'instruction en cause
+ */
+static void compare_word(Machine *ref, Machine *pmach, unsigned data_addr, unsigned addr)
+{
+	if (data_addr < pmach->_datasize && ref->_data[data_addr] != pmach->_data[data_addr])
+		diverge("donnee", addr, ref->_data[data_addr], pmach->_data[data_addr]);
+}
+
+//! Exécution vérifiée jusqu'à \c HALT
+/*!
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_verify(Machine *pmach)
+{
+	//Copie de la machine ; check_data_addr() autorise l'adresse _datasize :
+	Machine ref = *pmach;
+	ref._data = calloc(pmach->_datasize + 1, sizeof(Word));
+	if (ref._data == NULL) {
+		fprintf(stderr, "Erreur d'allocation dans <verify.c:simul_verify>\n");
+		exit(1);
+	}
+	memcpy(ref._data, pmach->_data, pmach->_datasize * sizeof(Word));
+	//Les appels ne sont suivis qu'une fois, par la machine vérifiée :
+	ref._calls = NULL;
+
+	//Code condition laissé faux par une micro-opération _NOCC :
+	volatile bool cc_dead = false;
+
+	//Une erreur rend la machine dans son état courant, qui doit donc être
+	//exact, code condition compris :
+	Fault_Handler handler;
+	fault_push(&handler);
+	if (setjmp(handler._env)) {
+		if (cc_dead && ref._cc != pmach->_cc)
+			diverge("CC", handler._fault._addr, ref._cc, pmach->_cc);
+		free(ref._data);
+		fault_raise(handler._fault);
+	}
+
+	bool stop = true;
+	while (stop) {
+		if (pmach->_pc >= pmach->_textsize)
+			error(ERR_SEGTEXT, pmach->_pc - 1);
+		if (trace_wanted(pmach->_trace, pmach->_text[pmach->_pc]))
+			trace_exec(pmach, pmach->_pc);
+
+		unsigned addr = pmach->_pc;
+		Instruction instr = pmach->_text[addr];
+		//Mots que l'instruction peut modifier, calculés avant l'exécution :
+		unsigned target = get_address(&ref, instr);
+		unsigned sp = ref._sp;
+
+		//Une superinstruction est vérifiée instruction par instruction :
+		const Micro_Op *uop = &pmach->_uops[pmach->_pc++];
+		Uop_Kind kind = uop_base_kinds[uop->_kind];
+		pmach->_instrs++;
+		//Un code condition non calculé ne doit jamais être observé :
+		if (cc_dead && uop_reads_cc(uop) && ref._cc != pmach->_cc)
+			diverge("CC", addr, ref._cc, pmach->_cc);
+		stop = uop_handlers[kind](pmach, uop);
+		if (uop_cc_effects[kind] != UOP_CC_KEEP)
+			cc_dead = uop_cc_effects[kind] == UOP_CC_DEAD;
+		//HALT n'a pas d'autre effet que d'avancer le compteur ordinal :
+		if (stop)
+			decode_execute(&ref, ref._text[ref._pc++]);
+		else
+			ref._pc++;
+
+		if (ref._pc != pmach->_pc)
+			diverge("PC", addr, ref._pc, pmach->_pc);
+		if (!cc_dead && ref._cc != pmach->_cc)
+			diverge("CC", addr, ref._cc, pmach->_cc);
+		for (int i = 0; i < NREGISTERS; i++)
+			if (ref._registers[i] != pmach->_registers[i])
+				diverge("registre", addr, ref._registers[i], pmach->_registers[i]);
+		compare_word(&ref, pmach, target, addr);
+		compare_word(&ref, pmach, sp, addr);
+		compare_word(&ref, pmach, sp + 1, addr);
+	}
+
+	fault_pop(&handler);
+	for (unsigned i = 0; i < pmach->_datasize; i++)
+		compare_word(&ref, pmach, i, pmach->_pc - 1);
+	free(ref._data);
+}
@@ -0,0 +1,26 @@
+#ifndef _VERIFY_H_
+#define _VERIFY_H_
+
+/*!
+ * \file verify.h
+ * \brief Vérification des routines spécialisées par le décodeur de référence.
+ */
+
+#include "machine.h"
+
+//! Exécution vérifiée jusqu'à \c HALT
+/*!
+ * Chaque instruction est exécutée deux fois : par la routine spécialisée de
+ * sa micro-opération sur la machine, et par decode_execute() sur une copie de
+ * la machine (registres et segment de données). Après chaque instruction on
+ * compare le compteur ordinal, le code condition, les registres et les mots
+ * de données que l'instruction a pu modifier ; à la fin on compare tout le
+ * segment de données. Toute divergence est signalée et termine le
+ * simulateur : elle révèle une erreur dans le prédécodage ou dans une routine
+ * spécialisée, pas dans le programme simulé.
+ *
+ * \param pmach la machine en cours d'exécution
+ */
+void simul_verify(Machine *pmach);
+
+#endif